@@ -339,6 +339,10 @@ int main(void)
 
     glCullFace(GL_FRONT);
 
+    int texLocation = glGetUniformLocation(ShaderProgram, "tex");
+    int projectionLocation = glGetUniformLocation(ShaderProgram, "projection");
+    int viewLocation = glGetUniformLocation(ShaderProgram, "view");
+
     while (!glfwWindowShouldClose(window))
     {
         glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
@@ -367,16 +371,13 @@ int main(void)
 
         glUseProgram(ShaderProgram);
 
-        glEnable(GL_TEXTURE_2D);
-
         glActiveTexture(GL_TEXTURE0);
         glBindTexture(GL_TEXTURE_2D, texture);
-        glUniform1i(glGetUniformLocation(ShaderProgram, "tex"), 0);
+        glUniform1i(texLocation, 0);
 
 
 
         glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)(xWindow / yWindow), 0.1f, 100.0f);
-        int projectionLocation = glGetUniformLocation(ShaderProgram, "projection");
         glUniformMatrix4fv(projectionLocation, 1, GL_FALSE, &projection[0][0]);
 
         glm::mat4 view = glm::mat4(1.0f);
@@ -385,7 +386,6 @@ int main(void)
         float viewY = cameraRadius * std::cos(camElevation);
         float viewZ = cameraRadius * std::sin(camElevation) * std::sin(alpha);
         view = glm::lookAt(glm::vec3(viewX, viewY, viewZ), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-        int viewLocation = glGetUniformLocation(ShaderProgram, "view");
         glUniformMatrix4fv(viewLocation, 1, GL_FALSE, &view[0][0]);
 
 
@@ -0,0 +1,210 @@
+#pragma once
+#ifndef SPHERICAL_HARMONICS_H
+#define SPHERICAL_HARMONICS_H
+
+#include <GL/glew.h>
+#include <glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include <vector>
+
+// Diffuse irradiance as 9 RGB spherical harmonics coefficients (bands 0-2, 27 floats).
+// Projection is one pass over the environment, split across threads; evaluation is a
+// handful of multiply-adds in the fragment shader against the SHIrradiance uniform block:
+//
+//   layout(std140) uniform SHIrradiance { vec4 shCoefficients[9]; };
+//   vec3 shIrradiance(vec3 n)
+//   {
+//       return shCoefficients[0].rgb
+//            + shCoefficients[1].rgb * n.y + shCoefficients[2].rgb * n.z + shCoefficients[3].rgb * n.x
+//            + shCoefficients[4].rgb * (n.x * n.y) + shCoefficients[5].rgb * (n.y * n.z)
+//            + shCoefficients[6].rgb * (3.0 * n.z * n.z - 1.0)
+//            + shCoefficients[7].rgb * (n.x * n.z) + shCoefficients[8].rgb * (n.x * n.x - n.y * n.y);
+//   }
+//
+// The uploaded coefficients already include the basis constants and the cosine lobe
+// convolution, and are divided by pi so shIrradiance matches the old irradiance cubemap.
+
+const GLuint SH_IRRADIANCE_BINDING = 1;   // uniform buffer binding point of SHIrradiance
+
+struct SH9Color {
+    glm::vec3 c[9];
+
+    SH9Color()
+    {
+        for (glm::vec3& v : c)
+            v = glm::vec3(0.0f);
+    }
+
+    SH9Color& operator+=(const SH9Color& other)
+    {
+        for (int i = 0; i < 9; ++i)
+            c[i] += other.c[i];
+        return *this;
+    }
+};
+
+// real SH basis up to band 2, dir normalized
+// ------------------------------------------------------------------------
+inline void shBasis9(const glm::vec3& d, float y[9])
+{
+    y[0] = 0.282095f;
+    y[1] = 0.488603f * d.y;
+    y[2] = 0.488603f * d.z;
+    y[3] = 0.488603f * d.x;
+    y[4] = 1.092548f * d.x * d.y;
+    y[5] = 1.092548f * d.y * d.z;
+    y[6] = 0.315392f * (3.0f * d.z * d.z - 1.0f);
+    y[7] = 1.092548f * d.x * d.z;
+    y[8] = 0.546274f * (d.x * d.x - d.y * d.y);
+}
+
+inline void shAddSample(SH9Color& sh, const glm::vec3& dir, const glm::vec3& radiance, float solidAngle)
+{
+    float y[9];
+    shBasis9(dir, y);
+    for (int i = 0; i < 9; ++i)
+        sh.c[i] += radiance * (y[i] * solidAngle);
+}
+
+// runs fn(row, partialSum) over [0, rows) on all cores and adds up the partial sums
+// ------------------------------------------------------------------------
+template <typename Fn>
+SH9Color shParallelSum(int rows, Fn fn)
+{
+    int threads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    threads = std::max(1, std::min(threads, rows));
+    std::vector<SH9Color> partial(threads);
+    std::vector<std::thread> workers;
+    for (int t = 1; t < threads; ++t)
+    {
+        workers.emplace_back([&, t]() {
+            for (int row = rows * t / threads; row < rows * (t + 1) / threads; ++row)
+                fn(row, partial[t]);
+        });
+    }
+    for (int row = 0; row < rows / threads; ++row)
+        fn(row, partial[0]);
+    for (std::thread& worker : workers)
+        worker.join();
+
+    SH9Color sum;
+    for (const SH9Color& p : partial)
+        sum += p;
+    return sum;
+}
+
+// Projects an equirectangular RGB float image (bottom-up rows, same mapping as the
+// equirect-to-cubemap shader) onto SH9. Every texel is weighted by its solid angle.
+// ------------------------------------------------------------------------
+inline SH9Color projectSH9Equirect(const float* rgb, int width, int height)
+{
+    const float pi = 3.14159265f;
+    return shParallelSum(height, [&](int row, SH9Color& sh) {
+        float elevation = ((row + 0.5f) / height - 0.5f) * pi;
+        float solidAngle = (2.0f * pi / width) * (pi / height) * std::cos(elevation);
+        const float* texels = rgb + static_cast<size_t>(row) * width * 3;
+        for (int x = 0; x < width; ++x)
+        {
+            float azimuth = ((x + 0.5f) / width - 0.5f) * 2.0f * pi;
+            glm::vec3 dir(std::cos(elevation) * std::cos(azimuth), std::sin(elevation), std::cos(elevation) * std::sin(azimuth));
+            shAddSample(sh, dir, glm::vec3(texels[3 * x], texels[3 * x + 1], texels[3 * x + 2]), solidAngle);
+        }
+    });
+}
+
+// Projects an analytic environment radiance(dir) sampled on a rows x 2*rows lat-long grid.
+// ------------------------------------------------------------------------
+template <typename Fn>
+SH9Color projectSH9(Fn radiance, int rows = 64)
+{
+    const float pi = 3.14159265f;
+    const int columns = 2 * rows;
+    return shParallelSum(rows, [&](int row, SH9Color& sh) {
+        float elevation = ((row + 0.5f) / rows - 0.5f) * pi;
+        float solidAngle = (2.0f * pi / columns) * (pi / rows) * std::cos(elevation);
+        for (int x = 0; x < columns; ++x)
+        {
+            float azimuth = ((x + 0.5f) / columns) * 2.0f * pi;
+            glm::vec3 dir(std::cos(elevation) * std::cos(azimuth), std::sin(elevation), std::cos(elevation) * std::sin(azimuth));
+            shAddSample(sh, dir, radiance(dir), solidAngle);
+        }
+    });
+}
+
+// Hanning window over the bands to tame ringing from bright, small light sources.
+// width is in bands; larger is sharper, width <= 0 leaves the coefficients as they are.
+// ------------------------------------------------------------------------
+inline void windowSH9(SH9Color& sh, float width)
+{
+    if (width <= 0.0f)
+        return;
+    const int band[9] = { 0, 1, 1, 1, 2, 2, 2, 2, 2 };
+    for (int i = 0; i < 9; ++i)
+    {
+        float l = static_cast<float>(band[i]);
+        float w = l < width ? 0.5f * (1.0f + std::cos(3.14159265f * l / width)) : 0.0f;
+        sh.c[i] *= w;
+    }
+}
+
+// Coefficients for the SHIrradiance block: cosine lobe convolution (pi, 2pi/3, pi/4),
+// divided by pi, with the basis constants folded in. std140 pads each vec3 to a vec4.
+// ------------------------------------------------------------------------
+inline void shIrradianceCoefficients(const SH9Color& sh, glm::vec4 out[9])
+{
+    const float band0 = 1.0f, band1 = 2.0f / 3.0f, band2 = 0.25f;
+    const float scale[9] = {
+        band0 * 0.282095f,
+        band1 * 0.488603f, band1 * 0.488603f, band1 * 0.488603f,
+        band2 * 1.092548f, band2 * 1.092548f, band2 * 0.315392f, band2 * 1.092548f, band2 * 0.546274f,
+    };
+    for (int i = 0; i < 9; ++i)
+        out[i] = glm::vec4(sh.c[i] * scale[i], 0.0f);
+}
+
+// CPU version of shIrradiance(), for checks against a brute force integral
+// ------------------------------------------------------------------------
+inline glm::vec3 evaluateSH9Irradiance(const SH9Color& sh, const glm::vec3& n)
+{
+    glm::vec4 k[9];
+    shIrradianceCoefficients(sh, k);
+    glm::vec3 e = glm::vec3(k[0]) + glm::vec3(k[1]) * n.y + glm::vec3(k[2]) * n.z + glm::vec3(k[3]) * n.x
+                + glm::vec3(k[4]) * (n.x * n.y) + glm::vec3(k[5]) * (n.y * n.z) + glm::vec3(k[6]) * (3.0f * n.z * n.z - 1.0f)
+                + glm::vec3(k[7]) * (n.x * n.z) + glm::vec3(k[8]) * (n.x * n.x - n.y * n.y);
+    return e;
+}
+
+// Creates (when *buffer is 0) or updates the SHIrradiance uniform buffer and binds it
+// to SH_IRRADIANCE_BINDING.
+// ------------------------------------------------------------------------
+inline void uploadSH9Irradiance(GLuint* buffer, const SH9Color& sh)
+{
+    glm::vec4 coefficients[9];
+    shIrradianceCoefficients(sh, coefficients);
+    if (*buffer == 0)
+    {
+        glGenBuffers(1, buffer);
+        glBindBuffer(GL_UNIFORM_BUFFER, *buffer);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(coefficients), coefficients, GL_DYNAMIC_DRAW);
+    }
+    else
+    {
+        glBindBuffer(GL_UNIFORM_BUFFER, *buffer);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(coefficients), coefficients);
+    }
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    glBindBufferBase(GL_UNIFORM_BUFFER, SH_IRRADIANCE_BINDING, *buffer);
+}
+
+// points a program's SHIrradiance block at SH_IRRADIANCE_BINDING (GL 3.3 has no layout(binding))
+// ------------------------------------------------------------------------
+inline void bindSH9IrradianceBlock(GLuint program)
+{
+    GLuint index = glGetUniformBlockIndex(program, "SHIrradiance");
+    if (index != GL_INVALID_INDEX)
+        glUniformBlockBinding(program, index, SH_IRRADIANCE_BINDING);
+}
+#endif
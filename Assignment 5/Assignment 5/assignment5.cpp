@@ -10,6 +10,8 @@
 #include <gtx/string_cast.hpp>
 #include <gtc/type_ptr.hpp>
 
+#include "SphericalHarmonics.h"
+
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 
@@ -52,11 +54,26 @@ const char* srcFS = R"HERE(
     uniform vec3 viewPos;
     uniform vec3 specularColor;
 
+    layout(std140) uniform SHIrradiance
+    {
+        vec4 shCoefficients[9];
+    };
+
+    // ambient irradiance / pi from the SH9 coefficients (see SphericalHarmonics.h)
+    vec3 shIrradiance(vec3 n)
+    {
+        return shCoefficients[0].rgb
+             + shCoefficients[1].rgb * n.y + shCoefficients[2].rgb * n.z + shCoefficients[3].rgb * n.x
+             + shCoefficients[4].rgb * (n.x * n.y) + shCoefficients[5].rgb * (n.y * n.z)
+             + shCoefficients[6].rgb * (3.0 * n.z * n.z - 1.0)
+             + shCoefficients[7].rgb * (n.x * n.z) + shCoefficients[8].rgb * (n.x * n.x - n.y * n.y);
+    }
+
 	void main () 
 	{
 	    vec3 materialColor = texture(tex, fragUVs).rgb; 
 
-        vec3 ambientLight = 0.1 * materialColor;
+        vec3 ambientLight = shIrradiance(normalize(fragNormal)) * materialColor;
 
         vec3 lightDirection = normalize(lightPos - fragPos);
         float diffuseLightVal = max(dot(lightDirection, fragNormal), 0.0);
@@ -308,6 +325,15 @@ int main(void)
     glDeleteShader(shaderObjVS);
     glDeleteShader(shaderObjFS);
 
+    // Ambient light: a dim sky/ground gradient projected to SH9, averaging the old flat
+    // 0.1 term but brighter on surfaces facing up.
+    SH9Color ambientSH = projectSH9([](const glm::vec3& dir) {
+        return glm::mix(glm::vec3(0.06f, 0.055f, 0.05f), glm::vec3(0.11f, 0.12f, 0.15f), 0.5f + 0.5f * dir.y);
+    });
+    GLuint shIrradianceBuffer = 0;
+    uploadSH9Irradiance(&shIrradianceBuffer, ambientSH);
+    bindSH9IrradianceBlock(ShaderProgram);
+
     std::vector<glm::vec3> positions;
     std::vector<glm::vec3> normals;
     std::vector<unsigned int> indices;
@@ -419,6 +445,13 @@ int main(void)
 
     glCullFace(GL_FRONT);
 
+    int texLocation = glGetUniformLocation(ShaderProgram, "tex");
+    int projectionLocation = glGetUniformLocation(ShaderProgram, "projection");
+    int viewLocation = glGetUniformLocation(ShaderProgram, "view");
+    int lightLocation = glGetUniformLocation(ShaderProgram, "lightPos");
+    int viewPositionLocation = glGetUniformLocation(ShaderProgram, "viewPos");
+    int specularColorLocation = glGetUniformLocation(ShaderProgram, "specularColor");
+
     while (!glfwWindowShouldClose(window))
     {
         glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
@@ -446,16 +479,13 @@ int main(void)
 
         glUseProgram(ShaderProgram);
 
-        glEnable(GL_TEXTURE_2D);
-
         glActiveTexture(GL_TEXTURE0);
         glBindTexture(GL_TEXTURE_2D, texture);
-        glUniform1i(glGetUniformLocation(ShaderProgram, "tex"), 0);
+        glUniform1i(texLocation, 0);
 
 
 
         glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)(xWindow / yWindow), 0.1f, 100.0f);
-        int projectionLocation = glGetUniformLocation(ShaderProgram, "projection");
         glUniformMatrix4fv(projectionLocation, 1, GL_FALSE, &projection[0][0]);
 
         glm::mat4 view = glm::mat4(1.0f);
@@ -464,7 +494,6 @@ int main(void)
         float viewY = cameraRadius * std::cos(camElevation);
         float viewZ = cameraRadius * std::sin(camElevation) * std::sin(alpha);
         view = glm::lookAt(glm::vec3(viewX, viewY, viewZ), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-        int viewLocation = glGetUniformLocation(ShaderProgram, "view");
         glUniformMatrix4fv(viewLocation, 1, GL_FALSE, &view[0][0]);
 
         glm::vec3 lightPos = glm::vec3(0.0f, 0.0f, 0.0f);
@@ -473,13 +502,10 @@ int main(void)
         lightPos = glm::vec3(viewX, viewY, viewZ);
 
         std::cout << glm::to_string(lightPos) << std::endl;
-        int lightLocation = glGetUniformLocation(ShaderProgram, "lightPos");
         glUniform3f(lightLocation, xLight, yLight, 5.0f);
 
-        int viewPositionLocation = glGetUniformLocation(ShaderProgram, "viewPos");
         glUniform3f(viewPositionLocation, 0.0f, 0.0f, 5.0f);
 
-        int specularColorLocation = glGetUniformLocation(ShaderProgram, "specularColor");
         glUniform3f(specularColorLocation, specularColor.x, specularColor.y, specularColor.z);
 
 
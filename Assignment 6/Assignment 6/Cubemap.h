@@ -0,0 +1,330 @@
+#pragma once
+#ifndef CUBEMAP_H
+#define CUBEMAP_H
+
+#include <GL/glew.h>
+#include <stb_image.h>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Six-face cubemap kept as one contiguous block of 8-bit texels, mip-major:
+// mip 0 faces +X, -X, +Y, -Y, +Z, -Z, then mip 1 faces, and so on. That is also the
+// layout of the packed .cube file, so a cached skybox is one header read plus one
+// sequential read of the whole payload.
+struct CubemapImage {
+    int size = 0;       // width and height of a mip 0 face
+    int channels = 0;   // 1 to 4, 8 bits each
+    int mipLevels = 0;
+    std::vector<unsigned char> data;
+
+    int mipSize(int mip) const
+    {
+        int s = size >> mip;
+        return s > 0 ? s : 1;
+    }
+
+    size_t faceBytes(int mip) const
+    {
+        return static_cast<size_t>(mipSize(mip)) * mipSize(mip) * channels;
+    }
+
+    size_t faceOffset(int mip, int face) const
+    {
+        size_t offset = 0;
+        for (int m = 0; m < mip; ++m)
+            offset += 6 * faceBytes(m);
+        return offset + face * faceBytes(mip);
+    }
+};
+
+struct CubemapFileHeader {
+    char magic[4];          // "CUBE"
+    uint32_t version;
+    uint32_t size;
+    uint32_t channels;
+    uint32_t mipLevels;
+    uint32_t reserved;
+    uint64_t sourceStamp;   // fingerprint of the face images the file was built from
+    uint64_t payloadBytes;
+};
+
+const uint32_t CUBEMAP_FILE_VERSION = 1;
+
+// fingerprint of the face files (size and modification time), used to spot a stale cache
+// ------------------------------------------------------------------------
+inline uint64_t cubemapSourceStamp(const std::vector<std::string>& faces)
+{
+    uint64_t hash = 1469598103934665603ull;
+    auto mix = [&hash](uint64_t value) {
+        for (int i = 0; i < 8; ++i)
+        {
+            hash ^= (value >> (8 * i)) & 0xff;
+            hash *= 1099511628211ull;
+        }
+    };
+    for (const std::string& face : faces)
+    {
+        struct stat st;
+        if (stat(face.c_str(), &st) != 0)
+            return 0;
+        mix(static_cast<uint64_t>(st.st_size));
+        mix(static_cast<uint64_t>(st.st_mtime));
+    }
+    return hash;
+}
+
+// Decodes the six faces at once, one worker thread per face, and checks that every face
+// is square with the same size and channel count. Only mip 0 is filled in.
+// ------------------------------------------------------------------------
+inline bool loadCubemapFaces(const std::vector<std::string>& faces, CubemapImage& cube)
+{
+    if (faces.size() != 6)
+    {
+        std::cout << "Cubemap needs exactly 6 faces, got " << faces.size() << std::endl;
+        return false;
+    }
+
+    struct DecodedFace {
+        unsigned char* pixels = nullptr;
+        int width = 0;
+        int height = 0;
+        int channels = 0;
+    };
+    DecodedFace decoded[6];
+
+    std::vector<std::thread> workers;
+    for (int i = 0; i < 6; ++i)
+    {
+        workers.emplace_back([&faces, &decoded, i]() {
+            decoded[i].pixels = stbi_load(faces[i].c_str(), &decoded[i].width, &decoded[i].height, &decoded[i].channels, 0);
+        });
+    }
+    for (std::thread& worker : workers)
+        worker.join();
+
+    bool ok = true;
+    for (int i = 0; i < 6; ++i)
+    {
+        if (!decoded[i].pixels)
+        {
+            std::cout << "Cubemap texture failed to load at path: " << faces[i] << std::endl;
+            ok = false;
+        }
+        else if (decoded[i].width != decoded[i].height)
+        {
+            std::cout << "Cubemap face is not square: " << faces[i] << " (" << decoded[i].width << "x" << decoded[i].height << ")" << std::endl;
+            ok = false;
+        }
+        else if (decoded[0].pixels && (decoded[i].width != decoded[0].width || decoded[i].channels != decoded[0].channels))
+        {
+            std::cout << "Cubemap face " << faces[i] << " is " << decoded[i].width << "x" << decoded[i].height << "x" << decoded[i].channels
+                      << ", expected " << decoded[0].width << "x" << decoded[0].height << "x" << decoded[0].channels << std::endl;
+            ok = false;
+        }
+    }
+
+    if (ok)
+    {
+        cube.size = decoded[0].width;
+        cube.channels = decoded[0].channels;
+        cube.mipLevels = 1;
+        cube.data.resize(6 * cube.faceBytes(0));
+        for (int i = 0; i < 6; ++i)
+            std::memcpy(&cube.data[cube.faceOffset(0, i)], decoded[i].pixels, cube.faceBytes(0));
+    }
+
+    for (int i = 0; i < 6; ++i)
+    {
+        if (decoded[i].pixels)
+            stbi_image_free(decoded[i].pixels);
+    }
+    return ok;
+}
+
+// Builds the full mip chain with a 2x2 box filter, one worker thread per face.
+// ------------------------------------------------------------------------
+inline void buildCubemapMips(CubemapImage& cube)
+{
+    int levels = 1;
+    while ((cube.size >> (levels - 1)) > 1)
+        ++levels;
+
+    // keep mip 0 and make room for the rest of the chain
+    std::vector<unsigned char> base(cube.data.begin(), cube.data.begin() + 6 * cube.faceBytes(0));
+    cube.mipLevels = levels;
+    cube.data.assign(cube.faceOffset(levels - 1, 6), 0);
+    std::memcpy(cube.data.data(), base.data(), base.size());
+
+    std::vector<std::thread> workers;
+    for (int face = 0; face < 6; ++face)
+    {
+        workers.emplace_back([&cube, face, levels]() {
+            const int c = cube.channels;
+            for (int mip = 1; mip < levels; ++mip)
+            {
+                const int srcSize = cube.mipSize(mip - 1);
+                const int dstSize = cube.mipSize(mip);
+                const unsigned char* src = &cube.data[cube.faceOffset(mip - 1, face)];
+                unsigned char* dst = &cube.data[cube.faceOffset(mip, face)];
+                for (int y = 0; y < dstSize; ++y)
+                {
+                    const unsigned char* row0 = src + static_cast<size_t>(2 * y) * srcSize * c;
+                    const unsigned char* row1 = row0 + static_cast<size_t>(srcSize) * c;
+                    for (int x = 0; x < dstSize; ++x)
+                    {
+                        for (int k = 0; k < c; ++k)
+                        {
+                            int sum = row0[2 * x * c + k] + row0[(2 * x + 1) * c + k] + row1[2 * x * c + k] + row1[(2 * x + 1) * c + k];
+                            dst[(static_cast<size_t>(y) * dstSize + x) * c + k] = static_cast<unsigned char>((sum + 2) >> 2);
+                        }
+                    }
+                }
+            }
+        });
+    }
+    for (std::thread& worker : workers)
+        worker.join();
+}
+
+// ------------------------------------------------------------------------
+inline bool writeCubemapFile(const char* path, const CubemapImage& cube, uint64_t sourceStamp)
+{
+    CubemapFileHeader header;
+    std::memcpy(header.magic, "CUBE", 4);
+    header.version = CUBEMAP_FILE_VERSION;
+    header.size = static_cast<uint32_t>(cube.size);
+    header.channels = static_cast<uint32_t>(cube.channels);
+    header.mipLevels = static_cast<uint32_t>(cube.mipLevels);
+    header.reserved = 0;
+    header.sourceStamp = sourceStamp;
+    header.payloadBytes = cube.data.size();
+
+    FILE* file = std::fopen(path, "wb");
+    if (!file)
+    {
+        std::cout << "Could not write cubemap file: " << path << std::endl;
+        return false;
+    }
+    bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1 &&
+              std::fwrite(cube.data.data(), 1, cube.data.size(), file) == cube.data.size();
+    return std::fclose(file) == 0 && ok;
+}
+
+// Reads a packed cubemap. A nonzero expectedStamp rejects files built from other faces.
+// The header is checked against the GL limits and the file length before anything is
+// allocated, so a truncated or corrupt cache is rebuilt instead of trusted.
+// ------------------------------------------------------------------------
+inline bool readCubemapFile(const char* path, CubemapImage& cube, uint64_t expectedStamp = 0)
+{
+    FILE* file = std::fopen(path, "rb");
+    if (!file)
+        return false;
+
+    GLint maxSize = 0;
+    glGetIntegerv(GL_MAX_CUBE_MAP_TEXTURE_SIZE, &maxSize);
+
+    CubemapFileHeader header;
+    bool ok = std::fread(&header, sizeof(header), 1, file) == 1 &&
+              std::memcmp(header.magic, "CUBE", 4) == 0 &&
+              header.version == CUBEMAP_FILE_VERSION &&
+              header.channels >= 1 && header.channels <= 4 &&
+              header.size > 0 && header.size <= static_cast<uint32_t>(maxSize) &&
+              (expectedStamp == 0 || header.sourceStamp == expectedStamp);
+
+    if (ok)
+    {
+        // floor(log2(size)) + 1 levels down to 1x1
+        uint32_t maxLevels = 1;
+        while ((header.size >> maxLevels) > 0)
+            ++maxLevels;
+        ok = header.mipLevels > 0 && header.mipLevels <= maxLevels;
+    }
+    if (ok)
+    {
+        cube.size = static_cast<int>(header.size);
+        cube.channels = static_cast<int>(header.channels);
+        cube.mipLevels = static_cast<int>(header.mipLevels);
+        ok = header.payloadBytes == cube.faceOffset(cube.mipLevels - 1, 6);
+    }
+    if (ok)
+    {
+        // the payload has to be in the file before it is allocated
+        long start = std::ftell(file);
+        ok = start >= 0 && std::fseek(file, 0, SEEK_END) == 0;
+        long end = ok ? std::ftell(file) : -1;
+        ok = ok && end >= start && static_cast<uint64_t>(end - start) >= header.payloadBytes &&
+             std::fseek(file, start, SEEK_SET) == 0;
+    }
+    if (ok)
+    {
+        cube.data.resize(static_cast<size_t>(header.payloadBytes));
+        ok = std::fread(cube.data.data(), 1, cube.data.size(), file) == cube.data.size();
+    }
+    std::fclose(file);
+    return ok;
+}
+
+// Uploads every face and mip level to a new GL cubemap texture.
+// ------------------------------------------------------------------------
+inline unsigned int uploadCubemap(const CubemapImage& cube)
+{
+    const GLenum formats[] = { GL_RED, GL_RG, GL_RGB, GL_RGBA };
+    const GLenum internalFormats[] = { GL_R8, GL_RG8, GL_RGB8, GL_RGBA8 };
+    GLenum format = formats[cube.channels - 1];
+    GLenum internalFormat = internalFormats[cube.channels - 1];
+
+    unsigned int texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, texture);
+
+    // rows of 1 and 3 channel faces are not 4-byte aligned at small mips
+    GLint alignment;
+    glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (int mip = 0; mip < cube.mipLevels; ++mip)
+    {
+        for (int face = 0; face < 6; ++face)
+        {
+            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, mip, internalFormat, cube.mipSize(mip), cube.mipSize(mip), 0,
+                         format, GL_UNSIGNED_BYTE, &cube.data[cube.faceOffset(mip, face)]);
+        }
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, cube.mipLevels - 1);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, cube.mipLevels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    return texture;
+}
+
+// Loads a cubemap texture, preferring the packed file at cachePath. When the cache is
+// missing or older than the faces, the faces are decoded in parallel, mipmapped and
+// written back to cachePath. Returns 0 if the faces are missing or mismatched.
+// ------------------------------------------------------------------------
+inline unsigned int loadCubemap(const std::vector<std::string>& faces, const char* cachePath)
+{
+    CubemapImage cube;
+    uint64_t stamp = cubemapSourceStamp(faces);
+    if (!readCubemapFile(cachePath, cube, stamp))
+    {
+        if (!loadCubemapFaces(faces, cube))
+            return 0;
+        buildCubemapMips(cube);
+        if (stamp != 0)
+            writeCubemapFile(cachePath, cube, stamp);
+    }
+    return uploadCubemap(cube);
+}
+#endif
@@ -0,0 +1,138 @@
+#pragma once
+#ifndef SHADER_LIBRARY_H
+#define SHADER_LIBRARY_H
+
+#include <GL/glew.h>
+
+#include "ProgramCache.h"
+
+#include <functional>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+// Named programs whose compiles are all submitted up front and checked only when a program
+// is first used. add() hands the sources to the driver (ProgramCache::begin) and returns
+// immediately: no GL_COMPILE_STATUS or GL_LINK_STATUS query sits between two submissions,
+// so with KHR_parallel_shader_compile the driver compiles them side by side while the
+// application goes on loading models and textures.
+//
+//   ShaderLibrary library(programCache);
+//   library.add("skybox", { { GL_VERTEX_SHADER, skyboxVS }, { GL_FRAGMENT_SHADER, skyboxFS } });
+//   ...                                  // other startup work
+//   GLuint skybox = library.get("skybox");   // errors are reported here, on first use
+//
+// poll() finishes whatever the driver reports done without waiting on the rest; get() only
+// blocks for a program that is still compiling.
+
+class ShaderLibrary
+{
+public:
+    // called once a program is linked, before get() returns it; for uniforms that never change
+    typedef std::function<void(GLuint)> LinkedCallback;
+
+    explicit ShaderLibrary(ProgramCache& cache) : cache(cache) {}
+
+    ~ShaderLibrary() { release(); }
+
+    // submits the compile of a named program; a second add() with the same name replaces it
+    // ------------------------------------------------------------------------
+    void add(const std::string& name, const std::vector<ProgramStage>& stages, const std::string& defines = std::string(),
+             LinkedCallback onLinked = nullptr)
+    {
+        Entry& entry = entries[name];
+        if (entry.program || entry.pending.program)
+            std::cout << "ERROR::SHADER_LIBRARY::DUPLICATE_NAME: " << name << std::endl;
+        discard(entry);
+        entry.pending = cache.begin(name.c_str(), stages, defines);
+        entry.onLinked = std::move(onLinked);
+        entry.submitted = true;
+        ++submitted;
+    }
+
+    // true once get(name) would not block
+    bool ready(const std::string& name) const
+    {
+        auto found = entries.find(name);
+        if (found == entries.end())
+            return false;
+        return !found->second.submitted || cache.ready(found->second.pending);
+    }
+
+    // the linked program, waiting for it if the driver is not done yet; 0 for unknown names
+    // ------------------------------------------------------------------------
+    GLuint get(const std::string& name)
+    {
+        auto found = entries.find(name);
+        if (found == entries.end())
+        {
+            std::cout << "ERROR::SHADER_LIBRARY::UNKNOWN_PROGRAM: " << name << std::endl;
+            return 0;
+        }
+        Entry& entry = found->second;
+        if (entry.submitted)
+            complete(entry, !cache.ready(entry.pending));
+        return entry.program;
+    }
+
+    // finishes every program the driver has completed, without waiting on any other
+    // ------------------------------------------------------------------------
+    void poll()
+    {
+        for (auto& named : entries)
+        {
+            if (named.second.submitted && cache.ready(named.second.pending))
+                complete(named.second, false);
+        }
+    }
+
+    // deletes every program; call while the context is still current
+    void release()
+    {
+        for (auto& named : entries)
+            discard(named.second);
+        entries.clear();
+    }
+
+    // how many programs get() had to wait for, against those that were done by first use
+    void printReport() const
+    {
+        std::cout << "Shader library: " << submitted << " programs submitted up front ("
+                  << (cache.isParallel() ? "parallel compile" : "no parallel compile") << "), " << (submitted - waited)
+                  << " ready by first use, " << waited << " waited for" << std::endl;
+    }
+
+private:
+    struct Entry {
+        PendingProgram pending;
+        GLuint program = 0;
+        bool submitted = false;
+        LinkedCallback onLinked;
+    };
+
+    ProgramCache& cache;
+    std::map<std::string, Entry> entries;
+    int submitted = 0, waited = 0;
+
+    void complete(Entry& entry, bool blocking)
+    {
+        if (blocking)
+            ++waited;
+        entry.program = cache.finish(entry.pending);
+        entry.submitted = false;
+        if (entry.onLinked && !entry.pending.failed)
+            entry.onLinked(entry.program);
+    }
+
+    void discard(Entry& entry)
+    {
+        if (entry.submitted)
+            complete(entry, false);
+        if (entry.program)
+            glDeleteProgram(entry.program);
+        entry.program = 0;
+        entry.submitted = false;
+    }
+};
+#endif
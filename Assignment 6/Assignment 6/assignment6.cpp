@@ -10,6 +10,10 @@
 #include <gtx/string_cast.hpp>
 #include <gtc/type_ptr.hpp>
 
+#include "Cubemap.h"
+#include "ProgramCache.h"
+#include "ShaderLibrary.h"
+
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 
@@ -312,119 +316,13 @@ int main(void)
     glfwSetKeyCallback(window, key_callback);
 
 
-    // Compile vertex shaders
-
-    unsigned int shaderObjVS = glCreateShader(GL_VERTEX_SHADER);
-    int lengthVS = (int)strlen(srcVS);
-    glShaderSource(shaderObjVS, 1, &srcVS, &lengthVS);
-    glCompileShader(shaderObjVS);
-
-
-
-    // Error handling for the vertex shaders
-
-    int success;
-    glGetShaderiv(shaderObjVS, GL_COMPILE_STATUS, &success);
-    if (!success) {
-        char message[1024];
-        glGetShaderInfoLog(shaderObjVS, sizeof(message), NULL, message);
-        std::cout << "Failed to compile: Vertex Shader" << std::endl;
-        std::cout << message << std::endl;
-    }
-
-
-    // Compile fragment shaders
-
-    unsigned int shaderObjFS = glCreateShader(GL_FRAGMENT_SHADER);
-    int lengthFS = (int)strlen(srcFS);
-    glShaderSource(shaderObjFS, 1, &srcFS, &lengthFS);
-    glCompileShader(shaderObjFS);
-
-
-    // Error handing for the vertex shaders
-
-    glGetShaderiv(shaderObjFS, GL_COMPILE_STATUS, &success);
-    if (!success) {
-        char message[1024];
-        glGetShaderInfoLog(shaderObjFS, sizeof(message), NULL, message);
-        std::cout << "Failed to compile: Fragment Shader" << std::endl;
-        std::cout << message << std::endl;
-    }
-
-    // Link vertex and fragment shader to shader program
-
-    unsigned int ShaderProgram = glCreateProgram();
-    glAttachShader(ShaderProgram, shaderObjVS);
-    glAttachShader(ShaderProgram, shaderObjFS);
-
-    glLinkProgram(ShaderProgram);
-    glGetProgramiv(ShaderProgram, GL_LINK_STATUS, &success);
-
-    glValidateProgram(ShaderProgram);
-
-    // Error handling for shader program
-
-    if (success == GL_FALSE) {
-        char message[1024];
-        glGetProgramInfoLog(ShaderProgram,
-            sizeof(message), NULL, message);
-        std::cout << "Failed to link shaders:" << std::endl;
-        std::cout << message << std::endl;
-    }
-
-    glDeleteShader(shaderObjVS);
-    glDeleteShader(shaderObjFS);
-
-    // Skybox VS, FS, Shader Program
-
-    unsigned int skyShaderObjVS = glCreateShader(GL_VERTEX_SHADER);
-    int skyVertexLength = (int)strlen(skyboxSrcVS);
-    glShaderSource(skyShaderObjVS, 1, &skyboxSrcVS, &skyVertexLength);
-    glCompileShader(skyShaderObjVS);
-    int skyVertexSuccess;
-    glGetShaderiv(skyShaderObjVS, GL_COMPILE_STATUS, &skyVertexSuccess);
-
-    if (skyVertexSuccess == GL_FALSE) {
-        char message[1024];
-        glGetShaderInfoLog(skyShaderObjVS, sizeof(message), NULL, message);
-        std::cout << "Failed to compile: Sky Vertex Shader" << std::endl;
-        std::cout << message << std::endl;
-        glDeleteShader(skyShaderObjVS);
-    }
-
-    unsigned int skyShaderObjFS = glCreateShader(GL_FRAGMENT_SHADER);
-    int skyFragmentLength = (int)strlen(skyboxSrcFS);
-    glShaderSource(skyShaderObjFS, 1, &skyboxSrcFS, &skyFragmentLength);
-    glCompileShader(skyShaderObjFS);
-    int skyFragmentSuccess;
-    glGetShaderiv(skyShaderObjFS, GL_COMPILE_STATUS, &skyFragmentSuccess);
+    // Submit both programs now (or load their binaries from the last launch) and pick them
+    // up once the sphere and the skybox are loaded; see ShaderLibrary.h
 
-    if (skyFragmentSuccess == GL_FALSE) {
-        char message[1024];
-        glGetShaderInfoLog(skyShaderObjFS, sizeof(message), NULL, message);
-        std::cout << "Failed to compile: Sky Fragment Shader" << std::endl;
-        std::cout << message << std::endl;
-        glDeleteShader(skyShaderObjFS);
-    }
-
-    unsigned int skyboxShaderProgram = glCreateProgram();
-    glAttachShader(skyboxShaderProgram, skyShaderObjVS);
-    glAttachShader(skyboxShaderProgram, skyShaderObjFS);
-    glLinkProgram(skyboxShaderProgram);
-
-    int skyboxShaderSuccess;
-    glGetProgramiv(skyboxShaderProgram, GL_LINK_STATUS, &skyboxShaderSuccess);
-
-    if (skyboxShaderSuccess == GL_FALSE) {
-        char message[1024];
-        glGetProgramInfoLog(skyboxShaderProgram,
-            sizeof(message), NULL, message);
-        std::cout << "Failed to link sky shaders:"
-            << std::endl;
-        std::cout << message << std::endl;
-    }
-
-    glValidateProgram(skyboxShaderProgram);
+    ProgramCache programCache("assignment6.programs");
+    ShaderLibrary shaderLibrary(programCache);
+    shaderLibrary.add("sphere", { { GL_VERTEX_SHADER, srcVS }, { GL_FRAGMENT_SHADER, srcFS } });
+    shaderLibrary.add("skybox", { { GL_VERTEX_SHADER, skyboxSrcVS }, { GL_FRAGMENT_SHADER, skyboxSrcFS } });
 
 
     std::vector<glm::vec3> positions;
@@ -511,8 +409,6 @@ int main(void)
     glEnableVertexAttribArray(1);
     glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void*)(3 * sizeof(float)));
 
-    int width, height, channels;
-
     // Create VAO and VBO for the skybox.
     unsigned int skyboxVAO, skyboxVBO;
     glGenVertexArrays(1, &skyboxVAO);
@@ -534,30 +430,19 @@ int main(void)
         "back.jpg"
     };
 
-    // Creates the cubemap texture object
-    unsigned int cubemapTexture;
-    glGenTextures(1, &cubemapTexture);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
-
-    for (unsigned int i = 0; i < skyboxFaces.size(); i++)
+    // Creates the cubemap texture object. The faces are decoded together on worker threads
+    // the first time and packed (with mips) into skybox.cube, which later runs read instead.
+    unsigned int cubemapTexture = loadCubemap(skyboxFaces, "skybox.cube");
+    if (cubemapTexture == 0)
     {
-        unsigned char* faceData = stbi_load(skyboxFaces[i].c_str(), &width, &height, &channels, 0);
-        if (faceData)
-        {
-            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, faceData);
-            stbi_image_free(faceData);
-        }
-        else
-        {
-            std::cout << "Cubemap texture failed to load at path: " << skyboxFaces[i] << std::endl;
-            stbi_image_free(faceData);
-        }
+        std::cout << "Failed to create the skybox cubemap" << std::endl;
     }
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+
+    unsigned int ShaderProgram = shaderLibrary.get("sphere");
+    unsigned int skyboxShaderProgram = shaderLibrary.get("skybox");
+    shaderLibrary.printReport();
+    programCache.save();
+    programCache.printReport();
 
     glUseProgram(ShaderProgram);
     glUniform1i(glGetUniformLocation(ShaderProgram, "skybox"), 0);
@@ -565,6 +450,14 @@ int main(void)
     glUseProgram(skyboxShaderProgram);
     glUniform1i(glGetUniformLocation(skyboxShaderProgram, "skybox"), 0);
 
+    int modelLocation = glGetUniformLocation(ShaderProgram, "model");
+    int projectionLocation = glGetUniformLocation(ShaderProgram, "projection");
+    int viewLocation = glGetUniformLocation(ShaderProgram, "view");
+    int cameraLocation = glGetUniformLocation(ShaderProgram, "cameraPosition");
+    int skyboxLocation = glGetUniformLocation(ShaderProgram, "skybox");
+    int skyViewLocation = glGetUniformLocation(skyboxShaderProgram, "view");
+    int skyProjectionLocation = glGetUniformLocation(skyboxShaderProgram, "projection");
+
     while (!glfwWindowShouldClose(window))
     {
         glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
@@ -592,11 +485,9 @@ int main(void)
 
         glUseProgram(ShaderProgram);
         glm::mat4 model = glm::mat4(1.0f);
-        int location = glGetUniformLocation(ShaderProgram, "model");
-        glUniformMatrix4fv(location, 1, GL_FALSE, &model[0][0]);
+        glUniformMatrix4fv(modelLocation, 1, GL_FALSE, &model[0][0]);
 
         glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)(xWindow / yWindow), 0.1f, 100.0f);
-        int projectionLocation = glGetUniformLocation(ShaderProgram, "projection");
         glUniformMatrix4fv(projectionLocation, 1, GL_FALSE, &projection[0][0]);
 
         glm::mat4 view = glm::mat4(1.0f);
@@ -605,26 +496,22 @@ int main(void)
         float viewY = cameraRadius * std::cos(camElevation);
         float viewZ = cameraRadius * std::sin(camElevation) * std::sin(alpha);
         view = glm::lookAt(glm::vec3(viewX, viewY, viewZ), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-        int viewLocation = glGetUniformLocation(ShaderProgram, "view");
         glUniformMatrix4fv(viewLocation, 1, GL_FALSE, &view[0][0]);
 
         glm::vec3 cameraPosition = glm::vec3(viewX, viewY, viewZ);
-        int cameraLocation = glGetUniformLocation(ShaderProgram, "cameraPosition");
         glUniform3fv(cameraLocation, 1, &cameraPosition[0]);
 
         glBindVertexArray(VAO);
         glActiveTexture(GL_TEXTURE0);
         glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
-        glUniform1i(glGetUniformLocation(ShaderProgram, "skybox"), 0);
+        glUniform1i(skyboxLocation, 0);
         glDrawElements(GL_TRIANGLE_STRIP, indexCount, GL_UNSIGNED_INT, 0);
         glBindVertexArray(0);
 
         glDepthFunc(GL_LEQUAL); 
         glUseProgram(skyboxShaderProgram); 
-        int skyViewLocation = glGetUniformLocation(skyboxShaderProgram, "view");
         glUniformMatrix4fv(skyViewLocation, 1, GL_FALSE, &view[0][0]);
 
-        int skyProjectionLocation = glGetUniformLocation(skyboxShaderProgram, "projection");
         glUniformMatrix4fv(skyProjectionLocation, 1, GL_FALSE, &projection[0][0]);
 
  
@@ -643,6 +530,7 @@ int main(void)
         glfwSwapBuffers(window);
     }
 
+    shaderLibrary.release();
     glfwTerminate();
 
     return 0;
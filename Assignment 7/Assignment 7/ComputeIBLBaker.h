@@ -0,0 +1,396 @@
+#pragma once
+#ifndef COMPUTE_IBL_BAKER_H
+#define COMPUTE_IBL_BAKER_H
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "HDRFormats.h"
+#include "IBLBaker.h"
+#include "SphericalHarmonics.h"
+
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// GL 4.3 compute version of the GPU IBL bake. Every pass writes its cubemap level through
+// a layered image binding (face = gl_GlobalInvocationID.z), so there is no capture
+// framebuffer, cube mesh or depth buffer:
+//   - environment: equirect texture -> cubemap level 0, then glGenerateMipmap
+//   - irradiance: SH9 projection of a 64^2 environment level; each 16x16 work group
+//     reduces its texels' contributions in shared memory and writes one partial sum
+//   - prefilter: one dispatch per mip. The GGX sample set of every mip is built once on the
+//     CPU (prefilterSampleTable, same as the CPU baker) into its own SSBO; work groups copy
+//     it through shared memory a tile at a time, so the 64 texels of a group fetch each
+//     sample once instead of 64 times.
+// Each pass ends with glFinish and is timed on the CPU clock: the bake runs once at startup,
+// and timer queries are not reliable on every driver.
+//
+// Image stores need a 1 or 4 component format, so RGB16F/RGB32F targets become RGBA and
+// RGB9E5 (not storable) becomes R11G11B10F; see computeStorageFormat.
+
+struct ComputeStorageFormat {
+    GLenum internalFormat;
+    const char* layoutQualifier;
+    int bytesPerTexel;
+};
+
+inline ComputeStorageFormat computeStorageFormat(HDRStorage storage)
+{
+    switch (storage)
+    {
+    case HDRStorage::RGB16F: return { GL_RGBA16F, "rgba16f", 8 };
+    case HDRStorage::R11G11B10F:
+    case HDRStorage::RGB9E5: return { GL_R11F_G11F_B10F, "r11f_g11f_b10f", 4 };
+    default: return { GL_RGBA32F, "rgba32f", 16 };
+    }
+}
+
+// hdrCubemapBytes for a cubemap the compute bake allocates in place of `storage`
+inline size_t computeCubemapBytes(HDRStorage storage, int size, int mipLevels = 1)
+{
+    size_t bytes = 0;
+    for (int mip = 0; mip < mipLevels && (size >> mip) > 0; ++mip)
+        bytes += 6 * static_cast<size_t>(size >> mip) * (size >> mip) * computeStorageFormat(storage).bytesPerTexel;
+    return bytes;
+}
+
+// cubemapTexelDirection in GLSL
+const char* const COMPUTE_CUBEMAP_GLSL = R"(
+vec3 cubemapTexelDirection(int face, vec2 texel, float size)
+{
+    vec2 st = 2.0 * (texel + 0.5) / size - 1.0;
+    vec3 dir;
+    if (face == 0) dir = vec3(1.0, -st.y, -st.x);
+    else if (face == 1) dir = vec3(-1.0, -st.y, st.x);
+    else if (face == 2) dir = vec3(st.x, 1.0, st.y);
+    else if (face == 3) dir = vec3(st.x, -1.0, -st.y);
+    else if (face == 4) dir = vec3(st.x, -st.y, 1.0);
+    else dir = vec3(-st.x, -st.y, -1.0);
+    return normalize(dir);
+}
+)";
+
+const char* const COMPUTE_EQUIRECT_GLSL = R"(
+layout (local_size_x = 8, local_size_y = 8) in;
+
+layout (binding = 0) uniform sampler2D equirect;
+layout (IMAGE_FORMAT, binding = 0) uniform writeonly imageCube target;
+uniform int size;
+
+void main()
+{
+    ivec3 id = ivec3(gl_GlobalInvocationID);
+    if (id.x >= size || id.y >= size)
+        return;
+    vec3 dir = cubemapTexelDirection(id.z, vec2(id.xy), float(size));
+    vec2 uv = vec2(atan(dir.z, dir.x) * 0.1591, asin(dir.y) * 0.3183) + 0.5;
+    imageStore(target, id, vec4(textureLod(equirect, uv, 0.0).rgb, 1.0));
+}
+)";
+
+const char* const COMPUTE_SH9_GLSL = R"(
+layout (local_size_x = 16, local_size_y = 16) in;
+
+layout (binding = 0) uniform samplerCube environment;
+layout (std430, binding = 0) writeonly buffer SHPartials { vec4 partials[]; };
+uniform int size;
+uniform float lod;
+
+shared vec3 tile[256];
+
+void main()
+{
+    ivec3 id = ivec3(gl_GlobalInvocationID);
+    vec2 st = 2.0 * (vec2(id.xy) + 0.5) / float(size) - 1.0;
+    float solidAngle = 4.0 / (float(size * size) * pow(1.0 + dot(st, st), 1.5));
+    vec3 d = cubemapTexelDirection(id.z, vec2(id.xy), float(size));
+    // invocations past a level smaller than the tile add nothing but stay for the barriers
+    vec3 radiance = vec3(0.0);
+    if (id.x < size && id.y < size)
+        radiance = textureLod(environment, d, lod).rgb * solidAngle;
+
+    float basis[9] = float[9](0.282095, 0.488603 * d.y, 0.488603 * d.z, 0.488603 * d.x,
+                              1.092548 * d.x * d.y, 1.092548 * d.y * d.z, 0.315392 * (3.0 * d.z * d.z - 1.0),
+                              1.092548 * d.x * d.z, 0.546274 * (d.x * d.x - d.y * d.y));
+
+    uint local = gl_LocalInvocationIndex;
+    uint group = (gl_WorkGroupID.z * gl_NumWorkGroups.y + gl_WorkGroupID.y) * gl_NumWorkGroups.x + gl_WorkGroupID.x;
+    for (int k = 0; k < 9; ++k)
+    {
+        tile[local] = radiance * basis[k];
+        barrier();
+        for (uint stride = 128u; stride > 0u; stride >>= 1)
+        {
+            if (local < stride)
+                tile[local] += tile[local + stride];
+            barrier();
+        }
+        if (local == 0u)
+            partials[group * 9u + uint(k)] = vec4(tile[0], 0.0);
+        barrier();
+    }
+}
+)";
+
+const char* const COMPUTE_PREFILTER_GLSL = R"(
+layout (local_size_x = 8, local_size_y = 8) in;
+
+layout (binding = 0) uniform samplerCube environment;
+layout (IMAGE_FORMAT, binding = 0) uniform writeonly imageCube target;
+layout (std430, binding = 1) readonly buffer PrefilterSamples { vec4 samples[]; };   // tangent-space light, source lod
+uniform int size;
+uniform int sampleCount;
+
+const int TILE = 64;
+shared vec4 sampleTile[TILE];
+
+void main()
+{
+    ivec3 id = ivec3(gl_GlobalInvocationID);
+    bool inside = id.x < size && id.y < size;
+    vec3 n = cubemapTexelDirection(id.z, vec2(id.xy), float(size));
+    vec3 up = abs(n.z) < 0.999 ? vec3(0.0, 0.0, 1.0) : vec3(1.0, 0.0, 0.0);
+    vec3 tangent = normalize(cross(up, n));
+    vec3 bitangent = cross(n, tangent);
+
+    vec3 color = vec3(0.0);
+    float weight = 0.0;
+    for (int base = 0; base < sampleCount; base += TILE)
+    {
+        // every invocation stays in the loop for the barriers, even outside the level
+        int i = base + int(gl_LocalInvocationIndex);
+        sampleTile[gl_LocalInvocationIndex] = i < sampleCount ? samples[i] : vec4(0.0);
+        barrier();
+        int count = min(TILE, sampleCount - base);
+        for (int j = 0; j < count; ++j)
+        {
+            vec4 s = sampleTile[j];
+            vec3 l = tangent * s.x + bitangent * s.y + n * s.z;
+            color += textureLod(environment, l, s.w).rgb * s.z;
+            weight += s.z;
+        }
+        barrier();
+    }
+    if (inside)
+        imageStore(target, id, vec4(color / weight, 1.0));
+}
+)";
+
+class ComputeIBLBaker
+{
+public:
+    static bool supported()
+    {
+        return GLEW_VERSION_4_3 != 0;
+    }
+
+    ComputeIBLBaker(HDRStorage environmentStorage, HDRStorage prefilterStorage)
+        : environmentFormat(computeStorageFormat(environmentStorage)), prefilterFormat(computeStorageFormat(prefilterStorage))
+    {
+        equirectProgram = link(COMPUTE_EQUIRECT_GLSL, environmentFormat.layoutQualifier);
+        shProgram = link(COMPUTE_SH9_GLSL, nullptr);
+        prefilterProgram = link(COMPUTE_PREFILTER_GLSL, prefilterFormat.layoutQualifier);
+    }
+
+    // the baked cubemaps belong to the caller and stay; call while the context is current
+    ~ComputeIBLBaker()
+    {
+        glDeleteProgram(equirectProgram);
+        glDeleteProgram(shProgram);
+        glDeleteProgram(prefilterProgram);
+    }
+
+    // equirect (any 2D texture, rows bottom-up) -> size^2 cubemap with a full mip chain
+    // ------------------------------------------------------------------------
+    unsigned int bakeEnvironment(unsigned int equirect, int size)
+    {
+        int mips = 1;
+        while ((size >> mips) > 0)
+            ++mips;
+        unsigned int cubemap = createCubemap(environmentFormat.internalFormat, size, mips);
+
+        beginPass("environment");
+        glUseProgram(equirectProgram);
+        glUniform1i(glGetUniformLocation(equirectProgram, "size"), size);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, equirect);
+        glBindImageTexture(0, cubemap, 0, GL_TRUE, 0, GL_WRITE_ONLY, environmentFormat.internalFormat);
+        glDispatchCompute((size + 7) / 8, (size + 7) / 8, 6);
+        glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, cubemap);
+        glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
+        endPass();
+        return cubemap;
+    }
+
+    // SH9 radiance projection (same scale as projectSH9Equirect) of the environment level
+    // closest to 64^2
+    // ------------------------------------------------------------------------
+    SH9Color projectIrradiance(unsigned int environment, int environmentSize)
+    {
+        const int size = std::min(environmentSize, 64);
+        const int groups = (size + 15) / 16;
+        const int partialCount = groups * groups * 6 * 9;
+        unsigned int partialBuffer;
+        glGenBuffers(1, &partialBuffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, partialBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, partialCount * sizeof(glm::vec4), nullptr, GL_DYNAMIC_READ);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, partialBuffer);
+
+        beginPass("SH9 irradiance");
+        glUseProgram(shProgram);
+        glUniform1i(glGetUniformLocation(shProgram, "size"), size);
+        glUniform1f(glGetUniformLocation(shProgram, "lod"), std::log2(static_cast<float>(environmentSize) / size));
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, environment);
+        glDispatchCompute(groups, groups, 6);
+        glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+        endPass();
+
+        std::vector<glm::vec4> partials(partialCount);
+        glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, partialCount * sizeof(glm::vec4), partials.data());
+        glDeleteBuffers(1, &partialBuffer);
+
+        SH9Color sh;
+        for (int i = 0; i < partialCount; ++i)
+            sh.c[i % 9] += glm::vec3(partials[i]);
+        return sh;
+    }
+
+    // GGX prefiltered cubemap, mip m at roughness m / (mips - 1) with prefilterSampleCount samples
+    // ------------------------------------------------------------------------
+    unsigned int bakePrefilter(unsigned int environment, int environmentSize, int size, int mips, int maxSamples, float density = 1.0f)
+    {
+        unsigned int cubemap = createCubemap(prefilterFormat.internalFormat, size, mips);
+
+        // sample tables for every mip, built once from the shared GGX table
+        const SampleTable table = buildSampleTable(maxSamples);
+        std::vector<unsigned int> sampleBuffers(mips);
+        std::vector<int> sampleCounts(mips);
+        glGenBuffers(mips, sampleBuffers.data());
+        for (int mip = 0; mip < mips; ++mip)
+        {
+            const float roughness = mips > 1 ? static_cast<float>(mip) / (mips - 1) : 0.0f;
+            const int mipSize = std::max(size >> mip, 1);
+            std::vector<glm::vec4> samples = prefilterSampleTable(table, environmentSize, mipSize, roughness,
+                                                                  prefilterSampleCount(roughness, mipSize, maxSamples, density));
+            sampleCounts[mip] = static_cast<int>(samples.size());
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, sampleBuffers[mip]);
+            glBufferData(GL_SHADER_STORAGE_BUFFER, samples.size() * sizeof(glm::vec4), samples.data(), GL_STATIC_DRAW);
+        }
+
+        glUseProgram(prefilterProgram);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, environment);
+        for (int mip = 0; mip < mips; ++mip)
+        {
+            const int mipSize = std::max(size >> mip, 1);
+            beginPass("prefilter mip " + std::to_string(mip));
+            glUniform1i(glGetUniformLocation(prefilterProgram, "size"), mipSize);
+            glUniform1i(glGetUniformLocation(prefilterProgram, "sampleCount"), sampleCounts[mip]);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, sampleBuffers[mip]);
+            glBindImageTexture(0, cubemap, mip, GL_TRUE, 0, GL_WRITE_ONLY, prefilterFormat.internalFormat);
+            glDispatchCompute((mipSize + 7) / 8, (mipSize + 7) / 8, 6);
+            endPass();
+        }
+        glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+        glDeleteBuffers(mips, sampleBuffers.data());
+        return cubemap;
+    }
+
+    // time of every pass since construction
+    // ------------------------------------------------------------------------
+    void printTimings()
+    {
+        double total = 0.0;
+        std::cout << "Compute IBL bake:";
+        for (const Pass& pass : passes)
+        {
+            std::cout << " " << pass.name << " " << pass.ms << " ms,";
+            total += pass.ms;
+        }
+        std::cout << " total " << total << " ms" << std::endl;
+        passes.clear();
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Pass {
+        std::string name;
+        double ms;
+    };
+
+    ComputeStorageFormat environmentFormat;
+    ComputeStorageFormat prefilterFormat;
+    unsigned int equirectProgram = 0;
+    unsigned int shProgram = 0;
+    unsigned int prefilterProgram = 0;
+    std::vector<Pass> passes;
+    Clock::time_point passStart;
+
+    void beginPass(const std::string& name)
+    {
+        glFinish();
+        passes.push_back({ name, 0.0 });
+        passStart = Clock::now();
+    }
+
+    void endPass()
+    {
+        glFinish();
+        passes.back().ms = std::chrono::duration<double, std::milli>(Clock::now() - passStart).count();
+    }
+
+    static unsigned int createCubemap(GLenum internalFormat, int size, int mips)
+    {
+        unsigned int cubemap;
+        glGenTextures(1, &cubemap);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, cubemap);
+        glTexStorage2D(GL_TEXTURE_CUBE_MAP, mips, internalFormat, size, size);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, mips > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        return cubemap;
+    }
+
+    static unsigned int link(const char* body, const char* imageFormat)
+    {
+        std::string source = "#version 430 core\n";
+        if (imageFormat)
+            source += std::string("#define IMAGE_FORMAT ") + imageFormat + "\n";
+        source += COMPUTE_CUBEMAP_GLSL;
+        source += body;
+        const char* text = source.c_str();
+
+        unsigned int shader = glCreateShader(GL_COMPUTE_SHADER);
+        glShaderSource(shader, 1, &text, NULL);
+        glCompileShader(shader);
+        int success;
+        glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+        if (!success)
+        {
+            char message[1024];
+            glGetShaderInfoLog(shader, sizeof(message), NULL, message);
+            std::cout << "ERROR::COMPUTE_IBL::COMPILATION_FAILED\n" << message << std::endl;
+        }
+        unsigned int program = glCreateProgram();
+        glAttachShader(program, shader);
+        glLinkProgram(program);
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+        if (!success)
+        {
+            char message[1024];
+            glGetProgramInfoLog(program, sizeof(message), NULL, message);
+            std::cout << "ERROR::COMPUTE_IBL::LINKING_FAILED\n" << message << std::endl;
+        }
+        glDeleteShader(shader);
+        return program;
+    }
+};
+#endif
@@ -0,0 +1,95 @@
+#pragma once
+#ifndef DEPTH_PREPASS_H
+#define DEPTH_PREPASS_H
+
+#include <GL/glew.h>
+
+#include "PassQueries.h"
+#include "ProgramCache.h"
+
+#include <iostream>
+#include <vector>
+
+// Depth pre-pass for the IBL shading: every model is first drawn depth only from its
+// position stream (Mesh::DrawDepth), with color writes off and an empty fragment shader.
+// The shading pass then runs with glDepthFunc(GL_EQUAL) and depth writes off, so only
+// the front-most fragment of each pixel reaches the 16-128 texture fetches of the PBR
+// shader; early depth testing drops the occluded ones before they are shaded.
+//
+// GL_EQUAL needs both passes to produce bit-identical depth. The vertex shaders therefore
+// compute gl_Position with the same expression and declare it invariant.
+
+inline std::vector<ProgramStage> depthPrepassStages()
+{
+    const char* vertexSource = R"HERE(
+#version 330 core
+layout (location = 0) in vec3 aPos;
+
+layout(std140) uniform FrameUniforms
+{
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    vec4 cameraPosition;
+};
+layout(std140) uniform ObjectUniforms
+{
+    mat4 model;
+    mat4 normalMatrix;
+};
+
+invariant gl_Position;
+
+void main()
+{
+    vec4 worldPosition = model * vec4(aPos, 1.0);
+    gl_Position = viewProjection * worldPosition;
+}
+)HERE";
+    const char* fragmentSource = R"HERE(
+#version 330 core
+void main()
+{
+}
+)HERE";
+    return { { GL_VERTEX_SHADER, vertexSource }, { GL_FRAGMENT_SHADER, fragmentSource } };
+}
+
+// Fragments that pass the depth test in the shading pass, per frame and kept apart with the
+// pre-pass off (mode 0) and on (mode 1); see PassQueries.h. begin() goes after the
+// depth-only draws, whose fragments GL_SAMPLES_PASSED would count as well.
+class OverdrawCounter
+{
+public:
+    enum { MODES = 2 };
+
+    void create() { queries.create(); }
+    void destroy() { queries.destroy(); }
+
+    void begin(int mode) { queries.begin(mode); }
+    void end() { queries.end(); }
+
+    // fragments per frame and per pixel of a width x height target, for each mode measured
+    // ------------------------------------------------------------------------
+    void printReport(const char* const names[MODES], int width, int height) const
+    {
+        const double pixels = static_cast<double>(width) * height;
+        for (int mode = 0; mode < MODES; ++mode)
+        {
+            if (queries.frames(mode) == 0)
+                continue;
+            const double perFrame = queries.average(mode);
+            std::cout << "Shaded fragments (" << names[mode] << "): " << static_cast<long long>(perFrame) << " per frame, "
+                      << perFrame / pixels << " per pixel over " << queries.frames(mode) << " frames" << std::endl;
+        }
+        if (queries.frames(0) > 0 && queries.average(1) > 0.0)
+        {
+            std::cout << "Shaded fragments: " << names[0] << " shades " << queries.average(0) / queries.average(1) << "x as many as "
+                      << names[1] << std::endl;
+        }
+    }
+
+private:
+    PassQueries queries{ GL_SAMPLES_PASSED, MODES };
+};
+#endif
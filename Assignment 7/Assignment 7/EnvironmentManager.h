@@ -0,0 +1,236 @@
+#pragma once
+#ifndef ENVIRONMENT_MANAGER_H
+#define ENVIRONMENT_MANAGER_H
+
+#include <GL/glew.h>
+
+#include "IBLBaker.h"
+#include "SphericalHarmonics.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+
+// Swaps the image based lighting environment at runtime without stalling the frame:
+//   1. request() decodes the HDR and bakes (or reads the cached) IBL products on a worker
+//      thread through loadOrBakeIBL
+//   2. update(), once per frame on the GL thread, uploads the new cubemaps one face of one
+//      mip at a time until the frame's upload budget is spent. Rendering keeps using the
+//      current maps meanwhile
+//   3. once every face is resident blend() ramps from 0 to 1 over fadeSeconds. Shaders mix
+//      current() and next() by it; the SH irradiance block is lerped on the CPU
+//   4. at 1 the next set becomes current and the old textures are deleted
+// A request made while a swap is running is remembered and started after it.
+
+struct EnvironmentMaps {
+    unsigned int environment = 0;
+    unsigned int prefilter = 0;
+    SH9Color irradianceSH;
+};
+
+class EnvironmentManager
+{
+public:
+    EnvironmentManager(const IBLBakeSettings& settings, double uploadBudgetMs = 2.0, float fadeSeconds = 1.0f)
+        : settings(settings), uploadBudgetMs(uploadBudgetMs), fadeSeconds(fadeSeconds)
+    {
+    }
+
+    ~EnvironmentManager()
+    {
+        if (worker.joinable())
+            worker.join();
+    }
+
+    // takes ownership of an already uploaded set and makes it current
+    // ------------------------------------------------------------------------
+    void adopt(const EnvironmentMaps& maps)
+    {
+        currentMaps = maps;
+        uploadSH9Irradiance(&shBuffer, currentMaps.irradianceSH);
+        ++currentGeneration;
+    }
+
+    // starts loading hdrPath in the background; the bake is cached next to it as .ibl
+    // ------------------------------------------------------------------------
+    void request(const std::string& hdrPath)
+    {
+        if (state != State::Idle)
+        {
+            pendingPath = hdrPath;
+            return;
+        }
+        if (worker.joinable())
+            worker.join();
+
+        requestedPath = hdrPath;
+        state = State::Baking;
+        workerDone = false;
+        requestStart = Clock::now();
+        std::cout << "Environment: loading " << hdrPath << " in the background" << std::endl;
+        worker = std::thread([this]() {
+            std::string cachePath = requestedPath.substr(0, requestedPath.find_last_of('.')) + ".ibl";
+            workerSucceeded = loadOrBakeIBL(requestedPath.c_str(), cachePath.c_str(), settings, products);
+            workerDone = true;
+        });
+    }
+
+    // call once per frame from the GL thread
+    // ------------------------------------------------------------------------
+    void update(float deltaTime)
+    {
+        if (state == State::Baking && workerDone)
+        {
+            worker.join();
+            bakeMs = milliseconds(requestStart, Clock::now());
+            if (!workerSucceeded)
+            {
+                std::cout << "Environment: failed to load " << requestedPath << ", keeping the current one" << std::endl;
+                finishSwap();
+                return;
+            }
+            nextMaps.environment = allocateCubemap(products.environment);
+            nextMaps.prefilter = allocateCubemap(products.prefilter);
+            nextMaps.irradianceSH = products.irradianceSH;
+            uploadChunk = 0;
+            uploadFrames = 0;
+            uploadMs = 0.0;
+            state = State::Uploading;
+        }
+
+        if (state == State::Uploading)
+        {
+            auto start = Clock::now();
+            const int environmentChunks = 6 * products.environment.mipLevels;
+            const int totalChunks = environmentChunks + 6 * products.prefilter.mipLevels;
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+            do
+            {
+                // environment faces first, then the prefiltered mips
+                if (uploadChunk < environmentChunks)
+                    uploadFace(nextMaps.environment, products.environment, uploadChunk / 6, uploadChunk % 6);
+                else
+                    uploadFace(nextMaps.prefilter, products.prefilter, (uploadChunk - environmentChunks) / 6, (uploadChunk - environmentChunks) % 6);
+                ++uploadChunk;
+            } while (uploadChunk < totalChunks && milliseconds(start, Clock::now()) < uploadBudgetMs);
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+            uploadMs += milliseconds(start, Clock::now());
+            ++uploadFrames;
+
+            if (uploadChunk == totalChunks)
+            {
+                products = IBLProducts();
+                fade = 0.0f;
+                state = State::Fading;
+                std::cout << "Environment: " << requestedPath << " baked/loaded in " << bakeMs << " ms, uploaded in "
+                          << uploadMs << " ms over " << uploadFrames << " frames" << std::endl;
+            }
+            return;
+        }
+
+        if (state == State::Fading)
+        {
+            fade = std::min(fade + deltaTime / std::max(fadeSeconds, 1e-3f), 1.0f);
+            SH9Color blended;
+            for (int i = 0; i < 9; ++i)
+                blended.c[i] = glm::mix(currentMaps.irradianceSH.c[i], nextMaps.irradianceSH.c[i], fade);
+            uploadSH9Irradiance(&shBuffer, blended);
+            if (fade >= 1.0f)
+            {
+                glDeleteTextures(1, &currentMaps.environment);
+                glDeleteTextures(1, &currentMaps.prefilter);
+                currentMaps = nextMaps;
+                ++currentGeneration;
+                finishSwap();
+            }
+        }
+    }
+
+    const EnvironmentMaps& current() const { return currentMaps; }
+    // the incoming set while fading, otherwise the current one
+    const EnvironmentMaps& next() const { return state == State::Fading ? nextMaps : currentMaps; }
+    float blend() const { return state == State::Fading ? fade : 0.0f; }
+    bool busy() const { return state != State::Idle; }
+    // changes whenever current() does; unlike the GL names, which the driver reuses once the
+    // fade has deleted the old maps
+    unsigned int generation() const { return currentGeneration; }
+
+private:
+    enum class State { Idle, Baking, Uploading, Fading };
+    using Clock = std::chrono::steady_clock;
+
+    IBLBakeSettings settings;
+    double uploadBudgetMs;
+    float fadeSeconds;
+
+    State state = State::Idle;
+    EnvironmentMaps currentMaps;
+    EnvironmentMaps nextMaps;
+    unsigned int currentGeneration = 0;
+    GLuint shBuffer = 0;
+    std::string requestedPath;
+    std::string pendingPath;
+
+    std::thread worker;
+    std::atomic<bool> workerDone{ false };
+    bool workerSucceeded = false;
+    IBLProducts products;   // written by the worker until workerDone
+
+    Clock::time_point requestStart;
+    double bakeMs = 0.0;
+    double uploadMs = 0.0;
+    int uploadFrames = 0;
+    int uploadChunk = 0;
+    float fade = 0.0f;
+
+    static double milliseconds(Clock::time_point a, Clock::time_point b)
+    {
+        return std::chrono::duration<double, std::milli>(b - a).count();
+    }
+
+    void finishSwap()
+    {
+        nextMaps = EnvironmentMaps();
+        state = State::Idle;
+        if (!pendingPath.empty())
+        {
+            std::string path = pendingPath;
+            pendingPath.clear();
+            request(path);
+        }
+    }
+
+    // storage for every mip, filled in later by uploadFace
+    static unsigned int allocateCubemap(const PackedCubemap& cube)
+    {
+        HDRGLFormat format = hdrGLFormat(cube.storage);
+        unsigned int texture;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, texture);
+        for (int mip = 0; mip < cube.mipLevels; ++mip)
+        {
+            for (int face = 0; face < 6; ++face)
+                glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, mip, format.internalFormat, cube.mipSize(mip), cube.mipSize(mip), 0,
+                             format.format, format.type, nullptr);
+        }
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, cube.mipLevels - 1);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, cube.mipLevels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        return texture;
+    }
+
+    static void uploadFace(unsigned int texture, const PackedCubemap& cube, int mip, int face)
+    {
+        HDRGLFormat format = hdrGLFormat(cube.storage);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, texture);
+        glTexSubImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, mip, 0, 0, cube.mipSize(mip), cube.mipSize(mip),
+                        format.format, format.type, &cube.data[cube.faceOffset(mip, face)]);
+    }
+};
+#endif
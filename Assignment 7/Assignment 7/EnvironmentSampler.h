@@ -0,0 +1,367 @@
+#pragma once
+#ifndef ENVIRONMENT_SAMPLER_H
+#define ENVIRONMENT_SAMPLER_H
+
+#include <glm/glm.hpp>
+
+#include "IBLBaker.h"
+#include "SampleTables.h"
+#include "SphericalHarmonics.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+// Importance sampling of an equirectangular HDR environment, for CPU reference renders
+// and convergence checks of the baked maps. Texels are picked in proportion to
+// luminance * sin(theta) (theta from the pole, i.e. the texel's solid angle) with a
+// marginal distribution over rows and a conditional one per row, both Walker/Vose alias
+// tables, so drawing a sample is O(1). pdf() returns the solid angle density of any
+// direction for multiple importance sampling.
+//
+// Same mapping as the equirect-to-cubemap bake and projectSH9Equirect: rows bottom-up,
+// u = atan(z, x) / 2pi + 0.5, v = asin(y) / pi + 0.5.
+
+// Walker's alias method with Vose's construction: bucket i is kept with probability
+// threshold[i], otherwise alias[i] is taken
+struct AliasTable {
+    std::vector<float> threshold;
+    std::vector<uint32_t> alias;
+    std::vector<float> pmf;     // normalized weights
+
+    void build(const std::vector<float>& weights)
+    {
+        const size_t n = weights.size();
+        threshold.assign(n, 1.0f);
+        alias.resize(n);
+        pmf.resize(n);
+
+        double total = 0.0;
+        for (float w : weights)
+            total += w;
+        std::vector<double> scaled(n);
+        std::vector<uint32_t> small, large;
+        for (size_t i = 0; i < n; ++i)
+        {
+            pmf[i] = total > 0.0 ? static_cast<float>(weights[i] / total) : 1.0f / n;
+            scaled[i] = total > 0.0 ? weights[i] * n / total : 1.0;
+            alias[i] = static_cast<uint32_t>(i);
+            (scaled[i] < 1.0 ? small : large).push_back(static_cast<uint32_t>(i));
+        }
+        while (!small.empty() && !large.empty())
+        {
+            uint32_t s = small.back();
+            small.pop_back();
+            uint32_t l = large.back();
+            large.pop_back();
+            threshold[s] = static_cast<float>(scaled[s]);
+            alias[s] = l;
+            scaled[l] = (scaled[l] + scaled[s]) - 1.0;
+            (scaled[l] < 1.0 ? small : large).push_back(l);
+        }
+        // whatever is left is 1 up to rounding
+    }
+
+    // bucket for u in [0, 1); *remapped is a fresh uniform in [0, 1) for the caller
+    uint32_t sample(float u, float* remapped) const
+    {
+        const size_t n = threshold.size();
+        float x = u * n;
+        uint32_t i = std::min(static_cast<uint32_t>(x), static_cast<uint32_t>(n - 1));
+        float f = std::min(x - i, 0.99999994f);
+        if (f < threshold[i])
+        {
+            *remapped = f / threshold[i];
+            return i;
+        }
+        *remapped = std::min((f - threshold[i]) / (1.0f - threshold[i]), 0.99999994f);
+        return alias[i];
+    }
+};
+
+struct EnvironmentSample {
+    glm::vec3 direction;
+    glm::vec3 radiance;
+    float pdf;          // per steradian
+};
+
+class EnvironmentSampler
+{
+public:
+    // rgb: width x height RGB floats, copied
+    EnvironmentSampler(const float* rgb, int width, int height)
+        : width(width), height(height), texels(rgb, rgb + static_cast<size_t>(width) * height * 3), columns(height)
+    {
+        const float pi = 3.14159265358979f;
+        std::vector<float> rowWeights(height);
+        std::vector<float> weights(width);
+        for (int y = 0; y < height; ++y)
+        {
+            const float sinTheta = std::cos(((y + 0.5f) / height - 0.5f) * pi);
+            double rowSum = 0.0;
+            for (int x = 0; x < width; ++x)
+            {
+                const float* c = &texels[3 * (static_cast<size_t>(y) * width + x)];
+                weights[x] = (0.2126f * c[0] + 0.7152f * c[1] + 0.0722f * c[2]) * sinTheta;
+                rowSum += weights[x];
+            }
+            columns[y].build(weights);
+            rowWeights[y] = static_cast<float>(rowSum);
+        }
+        rows.build(rowWeights);
+    }
+
+    // direction for the 2D uniform u (a low-discrepancy point works best), with its
+    // radiance and pdf
+    // ------------------------------------------------------------------------
+    EnvironmentSample sample(glm::vec2 u) const
+    {
+        float dv, du;
+        uint32_t y = rows.sample(u.y, &dv);
+        uint32_t x = columns[y].sample(u.x, &du);
+        EnvironmentSample s;
+        s.direction = texelDirection((x + du) / width, (y + dv) / height);
+        // on a texel edge the direction can round into the neighbour; report that texel
+        // so pdf() and radiance() agree with the sample
+        s.radiance = radiance(s.direction);
+        s.pdf = pdf(s.direction);
+        return s;
+    }
+
+    // solid angle density sample() draws direction with
+    // ------------------------------------------------------------------------
+    float pdf(const glm::vec3& direction) const
+    {
+        int x, y;
+        texelCoords(direction, x, y);
+        return texelPdf(x, y, direction);
+    }
+
+    // piecewise constant like the distribution
+    glm::vec3 radiance(const glm::vec3& direction) const
+    {
+        int x, y;
+        texelCoords(direction, x, y);
+        return texel(x, y);
+    }
+
+private:
+    int width, height;
+    std::vector<float> texels;
+    AliasTable rows;
+    std::vector<AliasTable> columns;
+
+    glm::vec3 texel(int x, int y) const
+    {
+        const float* c = &texels[3 * (static_cast<size_t>(y) * width + x)];
+        return glm::vec3(c[0], c[1], c[2]);
+    }
+
+    static glm::vec3 texelDirection(float u, float v)
+    {
+        const float pi = 3.14159265358979f;
+        float elevation = (v - 0.5f) * pi;
+        float azimuth = (u - 0.5f) * 2.0f * pi;
+        return glm::vec3(std::cos(elevation) * std::cos(azimuth), std::sin(elevation), std::cos(elevation) * std::sin(azimuth));
+    }
+
+    void texelCoords(const glm::vec3& d, int& x, int& y) const
+    {
+        float u = std::atan2(d.z, d.x) * 0.15915494f + 0.5f;
+        float v = std::asin(std::min(std::max(d.y, -1.0f), 1.0f)) * 0.31830989f + 0.5f;
+        x = std::min(std::max(static_cast<int>(u * width), 0), width - 1);
+        y = std::min(std::max(static_cast<int>(v * height), 0), height - 1);
+    }
+
+    // (u, v) density is pmf * width * height; d omega = 2 pi^2 sin(theta) du dv
+    float texelPdf(int x, int y, const glm::vec3& direction) const
+    {
+        const float pi = 3.14159265358979f;
+        float sinTheta = std::sqrt(std::max(1.0f - direction.y * direction.y, 0.0f));
+        if (sinTheta <= 0.0f)
+            return 0.0f;
+        float uvPdf = rows.pmf[y] * columns[y].pmf[x] * width * height;
+        return uvPdf / (2.0f * pi * pi * sinTheta);
+    }
+};
+
+// ------------------------------------------------------------------------
+// Monte Carlo references built on the sampler. Points come from the Owen-scrambled Sobol
+// sequence of SampleTables.h.
+
+// irradiance / pi at normal n (what shIrradiance returns), environment samples only
+// ------------------------------------------------------------------------
+inline glm::vec3 estimateIrradiance(const EnvironmentSampler& environment, const glm::vec3& n, int samples)
+{
+    const float pi = 3.14159265358979f;
+    glm::vec3 sum(0.0f);
+    for (int i = 0; i < samples; ++i)
+    {
+        EnvironmentSample s = environment.sample(sequencePoint(SampleSequence::OwenSobol, static_cast<uint32_t>(i), static_cast<uint32_t>(samples)));
+        float cosine = glm::dot(n, s.direction);
+        if (cosine > 0.0f && s.pdf > 0.0f)
+            sum += s.radiance * cosine / s.pdf;
+    }
+    return sum / (pi * samples);
+}
+
+// Specular reflection of the environment off a GGX surface: the integral of
+// L(l) f(v, l) NoL with the Cook-Torrance BRDF used by the split-sum LUT (Smith-Schlick G,
+// k = roughness^2 / 2, Schlick Fresnel). Each iteration takes one environment sample and
+// one GGX half vector sample and combines them with the balance heuristic, so both bright
+// small lights and tight lobes converge.
+// ------------------------------------------------------------------------
+inline glm::vec3 estimateSpecular(const EnvironmentSampler& environment, const glm::vec3& n, const glm::vec3& v, float roughness,
+                                  const glm::vec3& F0, int samples)
+{
+    const float pi = 3.14159265358979f;
+    const float a2 = std::max(roughness * roughness * roughness * roughness, 1e-6f);
+    const float k = roughness * roughness / 2.0f;
+    const float NoV = std::max(glm::dot(n, v), 1e-4f);
+    glm::vec3 up = std::abs(n.z) < 0.999f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+    glm::vec3 tangent = glm::normalize(glm::cross(up, n));
+    glm::vec3 bitangent = glm::cross(n, tangent);
+
+    // f * NoL and the GGX sampling pdf of l
+    auto evaluate = [&](const glm::vec3& l, float* brdfPdf) {
+        *brdfPdf = 0.0f;
+        float NoL = glm::dot(n, l);
+        if (NoL <= 0.0f)
+            return glm::vec3(0.0f);
+        glm::vec3 h = glm::normalize(v + l);
+        float NoH = std::max(glm::dot(n, h), 0.0f);
+        float VoH = std::max(glm::dot(v, h), 1e-4f);
+        float denom = NoH * NoH * (a2 - 1.0f) + 1.0f;
+        float D = a2 / (pi * denom * denom);
+        float G = (NoV / (NoV * (1.0f - k) + k)) * (NoL / (NoL * (1.0f - k) + k));
+        glm::vec3 F = F0 + (glm::vec3(1.0f) - F0) * std::pow(1.0f - VoH, 5.0f);
+        *brdfPdf = D * NoH / (4.0f * VoH);
+        return F * (D * G / (4.0f * NoV));
+    };
+
+    glm::vec3 sum(0.0f);
+    for (int i = 0; i < samples; ++i)
+    {
+        glm::vec2 u = sequencePoint(SampleSequence::OwenSobol, static_cast<uint32_t>(i), static_cast<uint32_t>(samples));
+
+        EnvironmentSample s = environment.sample(u);
+        float brdfPdf;
+        glm::vec3 f = evaluate(s.direction, &brdfPdf);
+        if (s.pdf > 0.0f)
+            sum += s.radiance * f / (s.pdf + brdfPdf);
+
+        glm::vec3 hLocal = ggxHalfVector(glm::vec2(u.y, u.x), roughness);
+        glm::vec3 h = tangent * hLocal.x + bitangent * hLocal.y + n * hLocal.z;
+        glm::vec3 l = 2.0f * glm::dot(v, h) * h - v;
+        f = evaluate(l, &brdfPdf);
+        if (brdfPdf > 0.0f)
+            sum += environment.radiance(l) * f / (brdfPdf + environment.pdf(l));
+    }
+    return sum / static_cast<float>(samples);
+}
+
+// Convergence of the sampler and SH9 irradiance error along the six axes, against a
+// referenceSamples estimate.
+// ------------------------------------------------------------------------
+inline void printEnvironmentReferenceReport(const EnvironmentSampler& environment, const SH9Color& sh, int referenceSamples = 1 << 16)
+{
+    const glm::vec3 axes[6] = { glm::vec3(1, 0, 0), glm::vec3(-1, 0, 0), glm::vec3(0, 1, 0),
+                                glm::vec3(0, -1, 0), glm::vec3(0, 0, 1), glm::vec3(0, 0, -1) };
+    glm::vec3 reference[6];
+    float shError = 0.0f;
+    for (int a = 0; a < 6; ++a)
+    {
+        reference[a] = estimateIrradiance(environment, axes[a], referenceSamples);
+        glm::vec3 e = evaluateSH9Irradiance(sh, axes[a]);
+        shError = std::max(shError, glm::length(e - reference[a]) / std::max(glm::length(reference[a]), 1e-6f));
+    }
+    std::cout << "Environment reference (" << referenceSamples << " samples): SH9 irradiance max rel error " << shError << std::endl;
+    std::cout << "  sampler convergence, mean rel error:";
+    for (int samples = 16; samples < referenceSamples; samples *= 4)
+    {
+        float error = 0.0f;
+        for (int a = 0; a < 6; ++a)
+        {
+            glm::vec3 e = estimateIrradiance(environment, axes[a], samples);
+            error += glm::length(e - reference[a]) / std::max(glm::length(reference[a]), 1e-6f) / 6.0f;
+        }
+        std::cout << " " << samples << ": " << error;
+    }
+    std::cout << std::endl;
+}
+
+// The split-sum specular the viewer computes from the baked products, prefiltered radiance
+// along the reflection vector at lod roughness * (mips - 1) times F0 * scale + bias from
+// the BRDF LUT, against estimateSpecular with referenceSamples, for a dielectric (F0 0.04)
+// at a grid of roughness and NoV, averaged over the six axes as normals. The error
+// includes the split-sum approximation itself, which grows at grazing angles. The last
+// line is how fast estimateSpecular converges, over the same points.
+// ------------------------------------------------------------------------
+inline void printSplitSumReferenceReport(const EnvironmentSampler& environment, const IBLProducts& products, int referenceSamples = 1 << 14)
+{
+    const FloatCubemap prefilter = unpackCubemap(products.prefilter);
+    const int lutSize = products.brdfLUTSize;
+    std::vector<float> lut(static_cast<size_t>(lutSize) * lutSize * 3, 0.0f);
+    for (size_t i = 0; i < static_cast<size_t>(lutSize) * lutSize; ++i)
+    {
+        lut[3 * i + 0] = decodeHalf(products.brdfLUT[2 * i + 0]);
+        lut[3 * i + 1] = decodeHalf(products.brdfLUT[2 * i + 1]);
+    }
+
+    const glm::vec3 axes[6] = { glm::vec3(1, 0, 0), glm::vec3(-1, 0, 0), glm::vec3(0, 1, 0),
+                                glm::vec3(0, -1, 0), glm::vec3(0, 0, 1), glm::vec3(0, 0, -1) };
+    const float roughnesses[3] = { 0.25f, 0.5f, 0.75f };
+    const float NoVs[3] = { 0.25f, 0.5f, 0.95f };
+    const glm::vec3 F0(0.04f);
+    auto viewVector = [](const glm::vec3& n, float NoV) {
+        glm::vec3 up = std::abs(n.y) < 0.999f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+        glm::vec3 tangent = glm::normalize(glm::cross(up, n));
+        return n * NoV + tangent * std::sqrt(1.0f - NoV * NoV);
+    };
+    auto relativeError = [](const glm::vec3& value, const glm::vec3& reference) {
+        return glm::length(value - reference) / std::max(glm::length(reference), 1e-6f);
+    };
+
+    std::vector<glm::vec3> reference;
+    std::cout << "Split-sum reference (" << referenceSamples << " samples, F0 0.04), mean rel error:";
+    for (float roughness : roughnesses)
+    {
+        std::cout << std::endl << "  roughness " << roughness << ":";
+        for (float NoV : NoVs)
+        {
+            float error = 0.0f;
+            for (const glm::vec3& n : axes)
+            {
+                glm::vec3 v = viewVector(n, NoV);
+                glm::vec3 r = 2.0f * glm::dot(n, v) * n - v;
+                reference.push_back(estimateSpecular(environment, n, v, roughness, F0, referenceSamples));
+                glm::vec3 prefiltered = sampleCubemapLod(prefilter, r, roughness * (prefilter.mipLevels - 1));
+                glm::vec3 environmentBRDF = sampleBilinear(lut.data(), lutSize, lutSize, NoV, roughness);
+                error += relativeError(prefiltered * (F0 * environmentBRDF.x + environmentBRDF.y), reference.back()) / 6.0f;
+            }
+            std::cout << " NoV " << NoV << ": " << error;
+        }
+    }
+    std::cout << std::endl << "  estimator convergence, mean rel error:";
+    for (int samples = 16; samples < referenceSamples; samples *= 4)
+    {
+        float error = 0.0f;
+        size_t point = 0;
+        for (float roughness : roughnesses)
+        {
+            for (float NoV : NoVs)
+            {
+                for (const glm::vec3& n : axes)
+                {
+                    glm::vec3 v = viewVector(n, NoV);
+                    error += relativeError(estimateSpecular(environment, n, v, roughness, F0, samples), reference[point++]) / reference.size();
+                }
+            }
+        }
+        std::cout << " " << samples << ": " << error;
+    }
+    std::cout << std::endl;
+}
+#endif
@@ -0,0 +1,198 @@
+#pragma once
+#ifndef FILE_WATCHER_H
+#define FILE_WATCHER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Calls back, on its own thread, when one of a set of files is rewritten. The thread sleeps
+// on the directories holding the files (inotify on Linux, a change notification handle on
+// Windows) and, when woken, compares each file's last write time against the one it saw
+// before. Directories are watched rather than the files themselves because most editors
+// save by writing a new file and renaming it over the old one.
+//
+// An editor's save can come as several writes, so the watcher waits settleMs after the
+// first event for the rest before it looks at the files.
+class FileWatcher
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+    // runs on the watcher thread; `changed` is when the first event of the save arrived
+    typedef std::function<void(const std::string& path, Clock::time_point changed)> ChangedCallback;
+
+    ~FileWatcher() { stop(); }
+
+    // starts watching; returns false if the platform would not watch the directories
+    // ------------------------------------------------------------------------
+    bool start(const std::vector<std::string>& paths, ChangedCallback onChanged, int settleMs = 30)
+    {
+        stop();
+        files.clear();
+        std::set<std::string> directories;
+        for (const std::string& path : paths)
+        {
+            files.push_back({ path, lastWrite(path) });
+            directories.insert(directoryOf(path));
+        }
+        if (!open(directories))
+        {
+            std::cout << "ERROR::FILE_WATCHER::COULD_NOT_WATCH: " << *directories.begin() << std::endl;
+            close();
+            return false;
+        }
+        running = true;
+        worker = std::thread([this, onChanged, settleMs]() {
+            while (running)
+            {
+                if (!wait(100))
+                    continue;
+                const Clock::time_point changed = Clock::now();
+                std::this_thread::sleep_for(std::chrono::milliseconds(settleMs));
+                while (wait(0)) {}
+                for (File& file : files)
+                {
+                    const uint64_t written = lastWrite(file.path);
+                    if (written == 0 || written == file.written)
+                        continue;
+                    file.written = written;
+                    onChanged(file.path, changed);
+                }
+            }
+        });
+        return true;
+    }
+
+    // joins the thread; no callback runs after this returns
+    // ------------------------------------------------------------------------
+    void stop()
+    {
+        running = false;
+        if (worker.joinable())
+            worker.join();
+        close();
+    }
+
+private:
+    struct File {
+        std::string path;
+        uint64_t written;
+    };
+
+    std::vector<File> files;
+    std::thread worker;
+    std::atomic<bool> running{ false };
+
+    static std::string directoryOf(const std::string& path)
+    {
+        const size_t slash = path.find_last_of("/\\");
+        return slash == std::string::npos ? std::string(".") : path.substr(0, slash);
+    }
+
+#ifdef _WIN32
+    std::vector<HANDLE> handles;
+
+    bool open(const std::set<std::string>& directories)
+    {
+        for (const std::string& directory : directories)
+        {
+            HANDLE handle = FindFirstChangeNotificationA(directory.c_str(), FALSE,
+                                                         FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME);
+            if (handle == INVALID_HANDLE_VALUE)
+                return false;
+            handles.push_back(handle);
+        }
+        return true;
+    }
+
+    void close()
+    {
+        for (HANDLE handle : handles)
+            FindCloseChangeNotification(handle);
+        handles.clear();
+    }
+
+    // true if a directory changed within timeoutMs
+    bool wait(int timeoutMs)
+    {
+        DWORD signaled = WaitForMultipleObjects(static_cast<DWORD>(handles.size()), handles.data(), FALSE, static_cast<DWORD>(timeoutMs));
+        if (signaled >= WAIT_OBJECT_0 + handles.size())
+            return false;
+        FindNextChangeNotification(handles[signaled - WAIT_OBJECT_0]);
+        return true;
+    }
+
+    // 100 ns ticks; 0 when the file is missing (mid-rename)
+    static uint64_t lastWrite(const std::string& path)
+    {
+        WIN32_FILE_ATTRIBUTE_DATA attributes;
+        if (!GetFileAttributesExA(path.c_str(), GetFileExInfoStandard, &attributes))
+            return 0;
+        return (static_cast<uint64_t>(attributes.ftLastWriteTime.dwHighDateTime) << 32) | attributes.ftLastWriteTime.dwLowDateTime;
+    }
+#else
+    int descriptor = -1;
+
+    bool open(const std::set<std::string>& directories)
+    {
+        descriptor = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (descriptor < 0)
+            return false;
+        for (const std::string& directory : directories)
+        {
+            if (inotify_add_watch(descriptor, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) < 0)
+                return false;
+        }
+        return true;
+    }
+
+    void close()
+    {
+        if (descriptor >= 0)
+            ::close(descriptor);
+        descriptor = -1;
+    }
+
+    // true if any events arrived within timeoutMs; drains them
+    bool wait(int timeoutMs)
+    {
+        pollfd watched = { descriptor, POLLIN, 0 };
+        if (poll(&watched, 1, timeoutMs) <= 0)
+            return false;
+        char events[4096];
+        while (read(descriptor, events, sizeof(events)) > 0) {}
+        return true;
+    }
+
+    // nanoseconds; 0 when the file is missing (mid-rename)
+    static uint64_t lastWrite(const std::string& path)
+    {
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0)
+            return 0;
+        return static_cast<uint64_t>(st.st_mtim.tv_sec) * 1000000000ull + static_cast<uint64_t>(st.st_mtim.tv_nsec);
+    }
+#endif
+};
+#endif
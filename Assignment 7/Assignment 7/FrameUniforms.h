@@ -0,0 +1,293 @@
+#pragma once
+#ifndef FRAME_UNIFORMS_H
+#define FRAME_UNIFORMS_H
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+// Camera and per-object transforms as std140 uniform blocks instead of per-program
+// glUniform calls. Every program that declares the blocks reads the same data:
+//
+//   layout(std140) uniform FrameUniforms
+//   {
+//       mat4 view;
+//       mat4 projection;
+//       mat4 viewProjection;
+//       vec4 cameraPosition;   // xyz
+//       mat4 previousViewProjection;
+//       vec4 previousCameraPosition;
+//   };
+//   layout(std140) uniform ObjectUniforms
+//   {
+//       mat4 model;
+//       mat4 normalMatrix;     // transpose(inverse(mat3(model))) in the upper 3x3
+//       mat4 previousModel;
+//   };
+//
+// The previous* members are last frame's values, for motion vectors; a program that has
+// no use for them may leave them out of its declaration, they come last.
+// The frame block is written once per frame and the object block once per draw, both into
+// a UniformRing and bound with glBindBufferRange. The normal matrix is computed on the CPU
+// once per object rather than by the vertex shader once per vertex.
+
+const GLuint FRAME_UNIFORMS_BINDING = 2;    // 1 is SH_IRRADIANCE_BINDING
+const GLuint OBJECT_UNIFORMS_BINDING = 3;
+
+struct FrameUniformData {
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::mat4 viewProjection;
+    glm::vec4 cameraPosition;
+    glm::mat4 previousViewProjection;
+    glm::vec4 previousCameraPosition;
+};
+
+struct ObjectUniformData {
+    glm::mat4 model;
+    glm::mat4 normalMatrix;
+    glm::mat4 previousModel;
+};
+
+// without the previous frame's camera or model matrix, it is taken to be this one (no motion)
+inline FrameUniformData frameUniforms(const glm::mat4& view, const glm::mat4& projection, const glm::vec3& cameraPosition)
+{
+    const glm::mat4 viewProjection = projection * view;
+    return { view, projection, viewProjection, glm::vec4(cameraPosition, 1.0f), viewProjection, glm::vec4(cameraPosition, 1.0f) };
+}
+
+inline FrameUniformData frameUniforms(const glm::mat4& view, const glm::mat4& projection, const glm::vec3& cameraPosition,
+                                      const glm::mat4& previousViewProjection, const glm::vec3& previousCameraPosition)
+{
+    FrameUniformData data = frameUniforms(view, projection, cameraPosition);
+    data.previousViewProjection = previousViewProjection;
+    data.previousCameraPosition = glm::vec4(previousCameraPosition, 1.0f);
+    return data;
+}
+
+inline ObjectUniformData objectUniforms(const glm::mat4& model)
+{
+    return { model, glm::mat4(glm::transpose(glm::inverse(glm::mat3(model)))), model };
+}
+
+inline ObjectUniformData objectUniforms(const glm::mat4& model, const glm::mat4& previousModel)
+{
+    ObjectUniformData data = objectUniforms(model);
+    data.previousModel = previousModel;
+    return data;
+}
+
+// points a program's FrameUniforms and ObjectUniforms blocks at their binding points
+// ------------------------------------------------------------------------
+inline void bindFrameUniformBlocks(GLuint program)
+{
+    GLuint frame = glGetUniformBlockIndex(program, "FrameUniforms");
+    if (frame != GL_INVALID_INDEX)
+        glUniformBlockBinding(program, frame, FRAME_UNIFORMS_BINDING);
+    GLuint object = glGetUniformBlockIndex(program, "ObjectUniforms");
+    if (object != GL_INVALID_INDEX)
+        glUniformBlockBinding(program, object, OBJECT_UNIFORMS_BINDING);
+}
+
+// A uniform buffer that is written linearly during a frame and bound a slice at a time.
+// With ARB_buffer_storage it is persistently mapped and split into `frames` regions, each
+// guarded by a fence, so the CPU writes region n while the GPU still reads n - 1 and n - 2.
+// Without it there is one region that beginFrame() orphans with glBufferData(NULL), and
+// push() uploads through glBufferSubData. A frame that outgrows its region moves to a new
+// buffer with twice the region size instead of writing over slices already bound; the
+// slices pushed so far that frame are copied over and bound again from there.
+class UniformRing
+{
+public:
+    ~UniformRing() { destroy(); }
+
+    // regionSize bytes per frame, rounded up to the uniform buffer offset alignment
+    // ------------------------------------------------------------------------
+    void create(GLsizeiptr regionSize, int frames = 3)
+    {
+        destroy();
+        requestedFrames = frames;
+        current = 0;
+        head = 0;
+        bound.clear();
+        GLint alignmentValue = 256;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignmentValue);
+        alignment = alignmentValue > 0 ? alignmentValue : 256;
+        region = align(regionSize);
+        persistent = GLEW_ARB_buffer_storage != 0;
+        regions = persistent ? std::max(1, std::min(frames, static_cast<int>(MAX_FRAMES))) : 1;
+
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+        if (persistent)
+        {
+            const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glBufferStorage(GL_UNIFORM_BUFFER, region * regions, nullptr, flags);
+            mapped = static_cast<char*>(glMapBufferRange(GL_UNIFORM_BUFFER, 0, region * regions, flags));
+            if (!mapped)
+            {
+                // fall back to orphaning in a fresh, mutable buffer
+                glBindBuffer(GL_UNIFORM_BUFFER, 0);
+                glDeleteBuffers(1, &buffer);
+                glGenBuffers(1, &buffer);
+                glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+                persistent = false;
+                regions = 1;
+            }
+        }
+        if (!persistent)
+            glBufferData(GL_UNIFORM_BUFFER, region, nullptr, GL_STREAM_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+    void destroy()
+    {
+        for (GLsync& fence : fences)
+        {
+            if (fence)
+                glDeleteSync(fence);
+            fence = nullptr;
+        }
+        if (buffer)
+        {
+            if (mapped)
+            {
+                glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+                glUnmapBuffer(GL_UNIFORM_BUFFER);
+                glBindBuffer(GL_UNIFORM_BUFFER, 0);
+            }
+            glDeleteBuffers(1, &buffer);
+        }
+        buffer = 0;
+        mapped = nullptr;
+    }
+
+    // moves to the next region, waiting for the GPU if it still reads it
+    // ------------------------------------------------------------------------
+    void beginFrame()
+    {
+        current = (current + 1) % regions;
+        head = 0;
+        bound.clear();
+        if (persistent)
+        {
+            GLsync& fence = fences[current];
+            if (fence)
+            {
+                while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED) {}
+                glDeleteSync(fence);
+                fence = nullptr;
+            }
+        }
+        else
+        {
+            glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+            glBufferData(GL_UNIFORM_BUFFER, region, nullptr, GL_STREAM_DRAW);
+            glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        }
+    }
+
+    // fences the region written this frame; call after its last draw
+    void endFrame()
+    {
+        if (persistent)
+            fences[current] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    // copies data into the current region and binds it to `binding`
+    // ------------------------------------------------------------------------
+    template <typename T>
+    void push(GLuint binding, const T& data)
+    {
+        const GLsizeiptr size = static_cast<GLsizeiptr>(sizeof(T));
+        if (head + size > region)
+            grow(size);
+        const GLintptr offset = current * region + head;
+        if (persistent)
+        {
+            std::memcpy(mapped + offset, &data, sizeof(T));
+        }
+        else
+        {
+            glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+            glBufferSubData(GL_UNIFORM_BUFFER, offset, size, &data);
+            glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        }
+        glBindBufferRange(GL_UNIFORM_BUFFER, binding, buffer, offset, size);
+        head += align(size);
+        auto slice = std::find_if(bound.begin(), bound.end(), [binding](const BoundRange& range) { return range.binding == binding; });
+        if (slice == bound.end())
+            bound.push_back({ binding, offset, size });
+        else
+            *slice = { binding, offset, size };
+    }
+
+    bool isPersistent() const { return persistent; }
+
+private:
+    enum { MAX_FRAMES = 4 };
+
+    GLuint buffer = 0;
+    char* mapped = nullptr;
+    bool persistent = false;
+    int requestedFrames = 3;
+    GLsizeiptr alignment = 256;
+    GLsizeiptr region = 0;
+    GLsizeiptr head = 0;
+    int regions = 1;
+    int current = 0;
+    GLsync fences[MAX_FRAMES] = {};
+
+    // what push() bound this frame, so grow() can point it at the new buffer
+    struct BoundRange {
+        GLuint binding;
+        GLintptr offset;
+        GLsizeiptr size;
+    };
+    std::vector<BoundRange> bound;
+
+    GLsizeiptr align(GLsizeiptr size) const { return (size + alignment - 1) / alignment * alignment; }
+
+    // Replaces the buffer with one whose regions are at least twice as large, copies this
+    // frame's slices to the start of its first region and binds them again there, so the
+    // frame block pushed before the overflow stays valid for the draws after it. Draws
+    // already queued keep reading the old buffer, which glDeleteBuffers only frees once
+    // they are done; the new one has no region in flight.
+    void grow(GLsizeiptr size)
+    {
+        const GLuint oldBuffer = buffer;
+        const bool oldMapped = mapped != nullptr;
+        const GLintptr oldStart = current * region;
+        const GLsizeiptr used = head;
+        const GLsizeiptr grown = std::max(2 * region, used + align(size));
+        std::cout << "Uniform ring: region of " << region << " bytes is full, growing to " << grown << " bytes" << std::endl;
+
+        std::vector<BoundRange> slices = bound;
+        buffer = 0;   // create() must not delete it yet
+        mapped = nullptr;
+        create(grown, requestedFrames);
+
+        glBindBuffer(GL_COPY_READ_BUFFER, oldBuffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        if (used > 0)
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, oldStart, 0, used);
+        if (oldMapped)
+            glUnmapBuffer(GL_COPY_READ_BUFFER);
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        glDeleteBuffers(1, &oldBuffer);
+
+        head = used;
+        bound = slices;
+        for (BoundRange& range : bound)
+        {
+            range.offset -= oldStart;
+            glBindBufferRange(GL_UNIFORM_BUFFER, range.binding, buffer, range.offset, range.size);
+        }
+    }
+};
+#endif
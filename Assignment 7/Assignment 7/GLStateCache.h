@@ -0,0 +1,235 @@
+#pragma once
+#ifndef GL_STATE_CACHE_H
+#define GL_STATE_CACHE_H
+
+#include <GL/glew.h>
+
+#include <iostream>
+
+// A shadow copy of the GL state the render loop changes per draw: program, vertex array,
+// texture bindings per unit, depth function and writes, color writes, face culling,
+// polygon mode and blending.
+// Every call compares against the copy and only reaches the driver when the value
+// changes, so the loop can state what each draw needs without paying for what is
+// already bound:
+//
+//   state.useProgram(program);                            // skipped if already current
+//   state.bindTexture(1, GL_TEXTURE_CUBE_MAP, prefilter); // glActiveTexture only if needed
+//   state.bindVertexArray(vao);
+//
+// The copy starts out unknown, so the first call of each kind is always issued. Code that
+// changes the same state behind the cache's back (bakers, program relinks, deleted
+// textures whose names get reused) must be followed by invalidate().
+//
+// beginFrame() closes the counters of the previous frame: `issued` counts calls that went
+// to the driver, `filtered` those the cache swallowed.
+
+struct GLStateCounters {
+    int issued = 0;
+    int filtered = 0;
+};
+
+class GLStateCache
+{
+public:
+    GLStateCache() { invalidate(); }
+
+    // forgets everything; the next call of each kind goes to the driver
+    // ------------------------------------------------------------------------
+    void invalidate()
+    {
+        program = UNKNOWN;
+        vertexArray = UNKNOWN;
+        activeUnit = UNKNOWN;
+        for (auto& unit : textures)
+        {
+            for (GLuint& texture : unit)
+                texture = UNKNOWN;
+        }
+        depthFunction = UNKNOWN;
+        depthWrite = colorWrite = -1;
+        cullMode = UNKNOWN;
+        polygon = UNKNOWN;
+        blendSource = blendDestination = UNKNOWN;
+        depthTest = cullFace = blend = -1;
+    }
+
+    // ------------------------------------------------------------------------
+    void useProgram(GLuint id)
+    {
+        if (filter(program == id))
+            return;
+        glUseProgram(id);
+        program = id;
+    }
+
+    void bindVertexArray(GLuint id)
+    {
+        if (filter(vertexArray == id))
+            return;
+        glBindVertexArray(id);
+        vertexArray = id;
+    }
+
+    // binds texture to `target` on texture unit `unit`; targets and units the cache does not
+    // track are always issued
+    // ------------------------------------------------------------------------
+    void bindTexture(GLuint unit, GLenum target, GLuint texture)
+    {
+        const int slot = unit < MAX_UNITS ? targetSlot(target) : -1;
+        if (filter(slot >= 0 && textures[unit][slot] == texture))
+            return;
+        activeTexture(unit);
+        glBindTexture(target, texture);
+        if (slot >= 0)
+            textures[unit][slot] = texture;
+    }
+
+    // ------------------------------------------------------------------------
+    void depthFunc(GLenum function)
+    {
+        if (filter(depthFunction == function))
+            return;
+        glDepthFunc(function);
+        depthFunction = function;
+    }
+
+    void depthMask(bool write)
+    {
+        if (filter(depthWrite == (write ? 1 : 0)))
+            return;
+        glDepthMask(write ? GL_TRUE : GL_FALSE);
+        depthWrite = write ? 1 : 0;
+    }
+
+    // all four channels at once
+    void colorMask(bool write)
+    {
+        const GLboolean value = write ? GL_TRUE : GL_FALSE;
+        if (filter(colorWrite == (write ? 1 : 0)))
+            return;
+        glColorMask(value, value, value, value);
+        colorWrite = write ? 1 : 0;
+    }
+
+    void cullFaceMode(GLenum mode)
+    {
+        if (filter(cullMode == mode))
+            return;
+        glCullFace(mode);
+        cullMode = mode;
+    }
+
+    void polygonMode(GLenum mode)
+    {
+        if (filter(polygon == mode))
+            return;
+        glPolygonMode(GL_FRONT_AND_BACK, mode);
+        polygon = mode;
+    }
+
+    void blendFunc(GLenum source, GLenum destination)
+    {
+        if (filter(blendSource == source && blendDestination == destination))
+            return;
+        glBlendFunc(source, destination);
+        blendSource = source;
+        blendDestination = destination;
+    }
+
+    // GL_DEPTH_TEST, GL_CULL_FACE and GL_BLEND are tracked; any other capability is issued
+    // ------------------------------------------------------------------------
+    void enable(GLenum capability) { setCapability(capability, true); }
+    void disable(GLenum capability) { setCapability(capability, false); }
+
+    // starts counting a new frame; lastFrame() then holds the one just finished
+    // ------------------------------------------------------------------------
+    void beginFrame()
+    {
+        if (frames > 0)
+        {
+            previous = frame;
+            total.issued += frame.issued;
+            total.filtered += frame.filtered;
+        }
+        frame = GLStateCounters();
+        ++frames;
+    }
+
+    const GLStateCounters& lastFrame() const { return previous; }
+
+    void printReport() const
+    {
+        const long long counted = frames > 1 ? frames - 1 : 1;
+        std::cout << "GL state cache: last frame " << previous.issued << " calls issued, " << previous.filtered
+                  << " filtered; average " << total.issued / counted << " issued, " << total.filtered / counted
+                  << " filtered over " << (frames > 1 ? frames - 1 : 0) << " frames" << std::endl;
+    }
+
+private:
+    static const GLuint UNKNOWN = ~0u;
+    enum { MAX_UNITS = 16, TARGET_SLOTS = 4 };
+
+    GLuint program, vertexArray, activeUnit;
+    GLuint textures[MAX_UNITS][TARGET_SLOTS];
+    GLenum depthFunction, cullMode, polygon, blendSource, blendDestination;
+    int depthTest, cullFace, blend, depthWrite, colorWrite;    // -1 unknown, 0 off, 1 on
+
+    GLStateCounters frame, previous;
+    struct {
+        long long issued = 0;
+        long long filtered = 0;
+    } total;
+    long long frames = 0;
+
+    // counts the call either way; true when it can be skipped
+    bool filter(bool redundant)
+    {
+        if (redundant)
+            ++frame.filtered;
+        else
+            ++frame.issued;
+        return redundant;
+    }
+
+    void activeTexture(GLuint unit)
+    {
+        if (activeUnit == unit)
+            return;
+        glActiveTexture(GL_TEXTURE0 + unit);
+        activeUnit = unit;
+        ++frame.issued;
+    }
+
+    static int targetSlot(GLenum target)
+    {
+        switch (target)
+        {
+        case GL_TEXTURE_2D: return 0;
+        case GL_TEXTURE_CUBE_MAP: return 1;
+        case GL_TEXTURE_2D_ARRAY: return 2;
+        case GL_TEXTURE_1D_ARRAY: return 3;
+        default: return -1;
+        }
+    }
+
+    void setCapability(GLenum capability, bool on)
+    {
+        int* tracked = nullptr;
+        switch (capability)
+        {
+        case GL_DEPTH_TEST: tracked = &depthTest; break;
+        case GL_CULL_FACE: tracked = &cullFace; break;
+        case GL_BLEND: tracked = &blend; break;
+        }
+        if (filter(tracked && *tracked == (on ? 1 : 0)))
+            return;
+        if (on)
+            glEnable(capability);
+        else
+            glDisable(capability);
+        if (tracked)
+            *tracked = on ? 1 : 0;
+    }
+};
+#endif
@@ -0,0 +1,478 @@
+#pragma once
+#ifndef HDR_FORMATS_H
+#define HDR_FORMATS_H
+
+#include <GL/glew.h>
+
+#include "Parallel.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define HDR_FORMATS_SSE2 1
+#include <emmintrin.h>
+#endif
+
+// Storage formats for HDR RGB data (the equirectangular source and the IBL cubemaps).
+// RGB32F is the float reference; the others trade precision for 2-3x less memory:
+//   RGB16F      6 bytes, sign + 5 bit exponent + 10 bit mantissa per channel
+//   R11G11B10F  4 bytes, unsigned 5 bit exponent + 6/6/5 bit mantissas
+//   RGB9E5      4 bytes, 9 bit mantissas sharing one 5 bit exponent
+// RGB9E5 is not color-renderable, so bake targets asking for it render to R11G11B10F
+// instead (see hdrRenderFormat); it remains the best choice for CPU-uploaded data.
+enum class HDRStorage {
+    RGB32F,
+    RGB16F,
+    R11G11B10F,
+    RGB9E5
+};
+
+struct HDRGLFormat {
+    GLenum internalFormat;
+    GLenum format;
+    GLenum type;
+    int bytesPerTexel;
+};
+
+inline const char* hdrStorageName(HDRStorage storage)
+{
+    switch (storage)
+    {
+    case HDRStorage::RGB16F: return "RGB16F";
+    case HDRStorage::R11G11B10F: return "R11G11B10F";
+    case HDRStorage::RGB9E5: return "RGB9E5";
+    default: return "RGB32F";
+    }
+}
+
+// GL enums for uploading texels packed by packHDR()
+inline HDRGLFormat hdrGLFormat(HDRStorage storage)
+{
+    switch (storage)
+    {
+    case HDRStorage::RGB16F: return { GL_RGB16F, GL_RGB, GL_HALF_FLOAT, 6 };
+    case HDRStorage::R11G11B10F: return { GL_R11F_G11F_B10F, GL_RGB, GL_UNSIGNED_INT_10F_11F_11F_REV, 4 };
+    case HDRStorage::RGB9E5: return { GL_RGB9_E5, GL_RGB, GL_UNSIGNED_INT_5_9_9_9_REV, 4 };
+    default: return { GL_RGB32F, GL_RGB, GL_FLOAT, 12 };
+    }
+}
+
+// storage actually used when the texture is a framebuffer attachment
+inline HDRStorage hdrRenderStorage(HDRStorage storage)
+{
+    return storage == HDRStorage::RGB9E5 ? HDRStorage::R11G11B10F : storage;
+}
+
+inline HDRGLFormat hdrRenderFormat(HDRStorage storage)
+{
+    return hdrGLFormat(hdrRenderStorage(storage));
+}
+
+// bytes of a size x size cubemap, with or without a full mip chain
+inline size_t hdrCubemapBytes(HDRStorage storage, int size, int mipLevels = 1)
+{
+    size_t bytes = 0;
+    for (int mip = 0; mip < mipLevels && (size >> mip) > 0; ++mip)
+        bytes += 6 * static_cast<size_t>(size >> mip) * (size >> mip) * hdrGLFormat(storage).bytesPerTexel;
+    return bytes;
+}
+
+inline uint32_t hdrFloatBits(float f)
+{
+    uint32_t u;
+    std::memcpy(&u, &f, 4);
+    return u;
+}
+
+inline float hdrBitsFloat(uint32_t u)
+{
+    float f;
+    std::memcpy(&f, &u, 4);
+    return f;
+}
+
+// ----------------------------------------------------------------------------
+// scalar encoders (also the reference for the SSE2 paths)
+// ----------------------------------------------------------------------------
+
+// Rounds a non-negative float to a float with a 5 bit exponent (bias 15) and
+// `mantissaBits` bits of mantissa, round-to-nearest-even, saturating to infinity.
+// The result is the bit pattern without a sign bit.
+inline uint32_t encodeSmallFloat(uint32_t bits, int mantissaBits)
+{
+    const int shift = 23 - mantissaBits;
+    const uint32_t infinity = 0x1fu << mantissaBits;
+    if (bits >= 0x7f800000u)
+        return bits > 0x7f800000u ? infinity | (1u << (mantissaBits - 1)) : infinity;
+    if (bits >= ((127u + 16u) << 23))
+        return infinity;
+    if (bits < (113u << 23))
+    {
+        // denormal: let the FPU round by adding a magic number with the right ulp
+        const uint32_t magic = static_cast<uint32_t>((127 - 15) + shift + 1) << 23;
+        return hdrFloatBits(hdrBitsFloat(bits) + hdrBitsFloat(magic)) - magic;
+    }
+    uint32_t odd = (bits >> shift) & 1u;
+    bits += (static_cast<uint32_t>(15 - 127) << 23) + ((1u << (shift - 1)) - 1u) + odd;
+    return bits >> shift;
+}
+
+inline uint16_t encodeHalf(float f)
+{
+    uint32_t bits = hdrFloatBits(f);
+    uint32_t sign = (bits >> 16) & 0x8000u;
+    return static_cast<uint16_t>(sign | encodeSmallFloat(bits & 0x7fffffffu, 10));
+}
+
+inline uint32_t encodeR11G11B10F(float r, float g, float b)
+{
+    // no sign bit: negatives and NaN clamp to zero
+    auto positive = [](float v) -> uint32_t { return v > 0.0f ? hdrFloatBits(v) : 0u; };
+    return encodeSmallFloat(positive(r), 6) | (encodeSmallFloat(positive(g), 6) << 11) | (encodeSmallFloat(positive(b), 5) << 22);
+}
+
+// shared exponent encoding from the EXT_texture_shared_exponent spec
+inline uint32_t encodeRGB9E5(float r, float g, float b)
+{
+    const float maxValue = 65408.0f; // (2^9 - 1) / 2^9 * 2^16
+    auto clampChannel = [maxValue](float v) { return v > 0.0f ? (v < maxValue ? v : maxValue) : 0.0f; };
+    r = clampChannel(r);
+    g = clampChannel(g);
+    b = clampChannel(b);
+    float maxc = std::fmax(r, std::fmax(g, b));
+
+    // floor(log2(maxc)) straight from the exponent bits, clamped to the smallest exponent
+    int exponent = static_cast<int>((hdrFloatBits(maxc) >> 23) & 0xff) - 127;
+    if (exponent < -16)
+        exponent = -16;
+    int shared = exponent + 16;                 // biased exponent, 0..31
+    float scale = hdrBitsFloat(static_cast<uint32_t>(127 + 24 - shared) << 23); // 2^(9 + 15 - shared)
+    if (static_cast<int>(maxc * scale + 0.5f) == 512)
+    {
+        ++shared;
+        scale *= 0.5f;
+    }
+    uint32_t rm = static_cast<uint32_t>(r * scale + 0.5f);
+    uint32_t gm = static_cast<uint32_t>(g * scale + 0.5f);
+    uint32_t bm = static_cast<uint32_t>(b * scale + 0.5f);
+    return rm | (gm << 9) | (bm << 18) | (static_cast<uint32_t>(shared) << 27);
+}
+
+// ----------------------------------------------------------------------------
+// decoders, used for the error report
+// ----------------------------------------------------------------------------
+
+inline float decodeSmallFloat(uint32_t v, int mantissaBits)
+{
+    uint32_t exponent = v >> mantissaBits;
+    uint32_t mantissa = v & ((1u << mantissaBits) - 1u);
+    float m = static_cast<float>(mantissa) / static_cast<float>(1u << mantissaBits);
+    if (exponent == 0)
+        return std::ldexp(m, -14);
+    if (exponent == 31)
+        return mantissa ? NAN : INFINITY;
+    return std::ldexp(1.0f + m, static_cast<int>(exponent) - 15);
+}
+
+inline float decodeHalf(uint16_t h)
+{
+    float v = decodeSmallFloat(h & 0x7fffu, 10);
+    return (h & 0x8000u) ? -v : v;
+}
+
+inline void decodeR11G11B10F(uint32_t v, float* rgb)
+{
+    rgb[0] = decodeSmallFloat(v & 0x7ffu, 6);
+    rgb[1] = decodeSmallFloat((v >> 11) & 0x7ffu, 6);
+    rgb[2] = decodeSmallFloat(v >> 22, 5);
+}
+
+inline void decodeRGB9E5(uint32_t v, float* rgb)
+{
+    float scale = std::ldexp(1.0f, static_cast<int>(v >> 27) - 15 - 9);
+    rgb[0] = (v & 0x1ffu) * scale;
+    rgb[1] = ((v >> 9) & 0x1ffu) * scale;
+    rgb[2] = ((v >> 18) & 0x1ffu) * scale;
+}
+
+// ----------------------------------------------------------------------------
+// SSE2 encoders, 4 texels per iteration
+// ----------------------------------------------------------------------------
+
+#ifdef HDR_FORMATS_SSE2
+// vector version of encodeSmallFloat, `bits` holds non-negative float bit patterns
+template <int MantissaBits>
+inline __m128i encodeSmallFloat4(__m128i bits)
+{
+    const int shift = 23 - MantissaBits;
+    const __m128i f32Infinity = _mm_set1_epi32(0x7f800000);
+    const __m128i overflow = _mm_set1_epi32((127 + 16) << 23);
+    const __m128i infinity = _mm_set1_epi32(0x1f << MantissaBits);
+    const __m128i nan = _mm_set1_epi32((0x1f << MantissaBits) | (1 << (MantissaBits - 1)));
+    const __m128i denormLimit = _mm_set1_epi32(113 << 23);
+    const __m128i magic = _mm_set1_epi32(((127 - 15) + shift + 1) << 23);
+    const __m128i rebias = _mm_set1_epi32(static_cast<int>((static_cast<uint32_t>(15 - 127) << 23) + ((1u << (shift - 1)) - 1u)));
+    const __m128i one = _mm_set1_epi32(1);
+
+    // normal range: rebias the exponent and round to nearest even
+    __m128i odd = _mm_and_si128(_mm_srli_epi32(bits, shift), one);
+    __m128i normal = _mm_srli_epi32(_mm_add_epi32(_mm_add_epi32(bits, rebias), odd), shift);
+
+    // denormal range: FPU rounding through a magic add
+    __m128i denormal = _mm_sub_epi32(_mm_castps_si128(_mm_add_ps(_mm_castsi128_ps(bits), _mm_castsi128_ps(magic))), magic);
+
+    __m128i isDenormal = _mm_cmplt_epi32(bits, denormLimit);
+    __m128i result = _mm_or_si128(_mm_and_si128(isDenormal, denormal), _mm_andnot_si128(isDenormal, normal));
+
+    __m128i isOverflow = _mm_cmpgt_epi32(bits, _mm_sub_epi32(overflow, one));
+    __m128i isNaN = _mm_cmpgt_epi32(bits, f32Infinity);
+    __m128i special = _mm_or_si128(_mm_and_si128(isNaN, nan), _mm_andnot_si128(isNaN, infinity));
+    return _mm_or_si128(_mm_and_si128(isOverflow, special), _mm_andnot_si128(isOverflow, result));
+}
+
+// loads 4 interleaved RGB texels as three channel vectors
+inline void loadRGB4(const float* rgb, __m128& r, __m128& g, __m128& b)
+{
+    __m128 a = _mm_loadu_ps(rgb);      // r0 g0 b0 r1
+    __m128 c = _mm_loadu_ps(rgb + 4);  // g1 b1 r2 g2
+    __m128 d = _mm_loadu_ps(rgb + 8);  // b2 r3 g3 b3
+    r = _mm_shuffle_ps(a, _mm_shuffle_ps(c, d, _MM_SHUFFLE(1, 1, 2, 2)), _MM_SHUFFLE(2, 0, 3, 0));
+    g = _mm_shuffle_ps(_mm_shuffle_ps(a, c, _MM_SHUFFLE(0, 0, 1, 1)), _mm_shuffle_ps(c, d, _MM_SHUFFLE(2, 2, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+    b = _mm_shuffle_ps(_mm_shuffle_ps(a, c, _MM_SHUFFLE(1, 1, 2, 2)), _mm_shuffle_ps(d, d, _MM_SHUFFLE(3, 3, 0, 0)), _MM_SHUFFLE(2, 0, 2, 0));
+}
+
+// clamps negatives (and NaN, maxps returns the second operand) to +0, returns the bit patterns
+inline __m128i positiveBits4(__m128 v)
+{
+    return _mm_castps_si128(_mm_max_ps(v, _mm_setzero_ps()));
+}
+#endif
+
+// ----------------------------------------------------------------------------
+// bulk conversion of `count` RGB float texels
+// ----------------------------------------------------------------------------
+
+inline void convertRGBToRGB16F(const float* rgb, uint16_t* out, size_t count)
+{
+    size_t i = 0;
+#ifdef HDR_FORMATS_SSE2
+    const __m128i absMask = _mm_set1_epi32(0x7fffffff);
+    const __m128i signMask = _mm_set1_epi32(static_cast<int>(0x80000000u));
+    // 12 floats (4 texels) per iteration
+    for (; i + 4 <= count; i += 4)
+    {
+        for (int k = 0; k < 3; ++k)
+        {
+            __m128i bits = _mm_castps_si128(_mm_loadu_ps(rgb + 3 * i + 4 * k));
+            __m128i half = encodeSmallFloat4<10>(_mm_and_si128(bits, absMask));
+            half = _mm_or_si128(half, _mm_srli_epi32(_mm_and_si128(bits, signMask), 16));
+            // narrow 4 x 32 bit to 4 x 16 bit (values fit in 16 bits, so sign-safe pack trick)
+            half = _mm_sub_epi32(half, _mm_set1_epi32(0x8000));
+            half = _mm_packs_epi32(half, half);
+            half = _mm_add_epi16(half, _mm_set1_epi16(static_cast<short>(0x8000)));
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(out + 3 * i + 4 * k), half);
+        }
+    }
+#endif
+    for (; i < count; ++i)
+    {
+        out[3 * i + 0] = encodeHalf(rgb[3 * i + 0]);
+        out[3 * i + 1] = encodeHalf(rgb[3 * i + 1]);
+        out[3 * i + 2] = encodeHalf(rgb[3 * i + 2]);
+    }
+}
+
+inline void convertRGBToR11G11B10F(const float* rgb, uint32_t* out, size_t count)
+{
+    size_t i = 0;
+#ifdef HDR_FORMATS_SSE2
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 r, g, b;
+        loadRGB4(rgb + 3 * i, r, g, b);
+        __m128i packed = encodeSmallFloat4<6>(positiveBits4(r));
+        packed = _mm_or_si128(packed, _mm_slli_epi32(encodeSmallFloat4<6>(positiveBits4(g)), 11));
+        packed = _mm_or_si128(packed, _mm_slli_epi32(encodeSmallFloat4<5>(positiveBits4(b)), 22));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), packed);
+    }
+#endif
+    for (; i < count; ++i)
+        out[i] = encodeR11G11B10F(rgb[3 * i], rgb[3 * i + 1], rgb[3 * i + 2]);
+}
+
+inline void convertRGBToRGB9E5(const float* rgb, uint32_t* out, size_t count)
+{
+    size_t i = 0;
+#ifdef HDR_FORMATS_SSE2
+    const __m128 maxValue = _mm_set1_ps(65408.0f);
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128i minExponent = _mm_set1_epi32(127 - 16);
+    const __m128i scaleBias = _mm_set1_epi32(127 + 24);
+    const __m128i limit = _mm_set1_epi32(512);
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 r, g, b;
+        loadRGB4(rgb + 3 * i, r, g, b);
+        r = _mm_min_ps(_mm_max_ps(r, _mm_setzero_ps()), maxValue);
+        g = _mm_min_ps(_mm_max_ps(g, _mm_setzero_ps()), maxValue);
+        b = _mm_min_ps(_mm_max_ps(b, _mm_setzero_ps()), maxValue);
+        __m128 maxc = _mm_max_ps(r, _mm_max_ps(g, b));
+
+        // biased float exponent of the largest channel, clamped to 2^-16
+        __m128i exponent = _mm_srli_epi32(_mm_castps_si128(maxc), 23);
+        __m128i tooSmall = _mm_cmplt_epi32(exponent, minExponent);
+        exponent = _mm_or_si128(_mm_and_si128(tooSmall, minExponent), _mm_andnot_si128(tooSmall, exponent));
+        __m128i shared = _mm_sub_epi32(exponent, minExponent);
+
+        // scale = 2^(24 - shared); bump the exponent when the max channel rounds to 512
+        __m128 scale = _mm_castsi128_ps(_mm_slli_epi32(_mm_sub_epi32(scaleBias, shared), 23));
+        __m128i maxMantissa = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(maxc, scale), half));
+        __m128i bump = _mm_cmpeq_epi32(maxMantissa, limit);
+        shared = _mm_sub_epi32(shared, bump);
+        scale = _mm_castsi128_ps(_mm_add_epi32(_mm_castps_si128(scale), _mm_slli_epi32(bump, 23)));
+
+        __m128i rm = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(r, scale), half));
+        __m128i gm = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(g, scale), half));
+        __m128i bm = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(b, scale), half));
+        __m128i packed = _mm_or_si128(rm, _mm_slli_epi32(gm, 9));
+        packed = _mm_or_si128(packed, _mm_slli_epi32(bm, 18));
+        packed = _mm_or_si128(packed, _mm_slli_epi32(shared, 27));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), packed);
+    }
+#endif
+    for (; i < count; ++i)
+        out[i] = encodeRGB9E5(rgb[3 * i], rgb[3 * i + 1], rgb[3 * i + 2]);
+}
+
+// Converts RGB float texels to `storage`, splitting the work across all cores.
+// The returned bytes can be handed to glTexImage2D with hdrGLFormat(storage).
+inline std::vector<unsigned char> packHDR(const float* rgb, size_t count, HDRStorage storage)
+{
+    std::vector<unsigned char> packed(count * hdrGLFormat(storage).bytesPerTexel);
+    const int chunk = 4096;
+    const int chunks = static_cast<int>((count + chunk - 1) / chunk);
+    parallelForRows(chunks, 16, [&](int begin, int end) {
+        size_t first = static_cast<size_t>(begin) * chunk;
+        size_t last = std::min(count, static_cast<size_t>(end) * chunk);
+        switch (storage)
+        {
+        case HDRStorage::RGB16F:
+            convertRGBToRGB16F(rgb + 3 * first, reinterpret_cast<uint16_t*>(packed.data()) + 3 * first, last - first);
+            break;
+        case HDRStorage::R11G11B10F:
+            convertRGBToR11G11B10F(rgb + 3 * first, reinterpret_cast<uint32_t*>(packed.data()) + first, last - first);
+            break;
+        case HDRStorage::RGB9E5:
+            convertRGBToRGB9E5(rgb + 3 * first, reinterpret_cast<uint32_t*>(packed.data()) + first, last - first);
+            break;
+        default:
+            std::memcpy(packed.data() + 12 * first, rgb + 3 * first, 12 * (last - first));
+            break;
+        }
+    });
+    return packed;
+}
+
+// texel i of packed data back to float RGB
+inline void decodeHDRTexel(const unsigned char* packed, size_t i, HDRStorage storage, float* rgb)
+{
+    switch (storage)
+    {
+    case HDRStorage::RGB16F:
+    {
+        const uint16_t* h = reinterpret_cast<const uint16_t*>(packed) + 3 * i;
+        rgb[0] = decodeHalf(h[0]);
+        rgb[1] = decodeHalf(h[1]);
+        rgb[2] = decodeHalf(h[2]);
+        break;
+    }
+    case HDRStorage::R11G11B10F:
+        decodeR11G11B10F(reinterpret_cast<const uint32_t*>(packed)[i], rgb);
+        break;
+    case HDRStorage::RGB9E5:
+        decodeRGB9E5(reinterpret_cast<const uint32_t*>(packed)[i], rgb);
+        break;
+    default:
+        std::memcpy(rgb, packed + 12 * i, 12);
+        break;
+    }
+}
+
+// Inverse of packHDR, for tools that resample packed data on the CPU.
+inline std::vector<float> unpackHDR(const unsigned char* packed, size_t count, HDRStorage storage)
+{
+    std::vector<float> rgb(count * 3);
+    const int chunk = 4096;
+    const int chunks = static_cast<int>((count + chunk - 1) / chunk);
+    parallelForRows(chunks, 16, [&](int begin, int end) {
+        size_t last = std::min(count, static_cast<size_t>(end) * chunk);
+        for (size_t i = static_cast<size_t>(begin) * chunk; i < last; ++i)
+            decodeHDRTexel(packed, i, storage, &rgb[3 * i]);
+    });
+    return rgb;
+}
+
+// ----------------------------------------------------------------------------
+// error report
+// ----------------------------------------------------------------------------
+
+struct HDRErrorReport {
+    double maxAbsError = 0.0;
+    double rmsAbsError = 0.0;
+    double maxRelError = 0.0;   // relative to the texel's largest channel
+    double meanRelError = 0.0;
+    size_t bytes = 0;
+    size_t referenceBytes = 0;
+};
+
+// Decodes packed texels and compares them against the float reference. Channels are
+// measured relative to the brightest channel of their texel, which is what matters for
+// a shared/limited exponent: a dim channel next to a bright one may lose all its bits.
+inline HDRErrorReport measureHDRError(const float* rgb, const unsigned char* packed, size_t count, HDRStorage storage)
+{
+    HDRErrorReport report;
+    report.bytes = count * hdrGLFormat(storage).bytesPerTexel;
+    report.referenceBytes = count * 12;
+
+    double sumSquared = 0.0;
+    double sumRel = 0.0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        float decoded[3];
+        decodeHDRTexel(packed, i, storage, decoded);
+
+        const float* ref = rgb + 3 * i;
+        double peak = std::fmax(std::fabs(ref[0]), std::fmax(std::fabs(ref[1]), std::fabs(ref[2])));
+        for (int c = 0; c < 3; ++c)
+        {
+            double err = std::fabs(static_cast<double>(decoded[c]) - ref[c]);
+            sumSquared += err * err;
+            report.maxAbsError = std::fmax(report.maxAbsError, err);
+            if (peak > 1e-6)
+            {
+                double rel = err / peak;
+                sumRel += rel;
+                report.maxRelError = std::fmax(report.maxRelError, rel);
+            }
+        }
+    }
+    if (count > 0)
+    {
+        report.rmsAbsError = std::sqrt(sumSquared / (3.0 * count));
+        report.meanRelError = sumRel / (3.0 * count);
+    }
+    return report;
+}
+
+inline void printHDRErrorReport(const char* label, HDRStorage storage, const HDRErrorReport& report)
+{
+    std::cout << label << " as " << hdrStorageName(storage) << ": "
+              << report.bytes / (1024.0 * 1024.0) << " MB (RGB32F " << report.referenceBytes / (1024.0 * 1024.0) << " MB), "
+              << "max abs " << report.maxAbsError << ", rms " << report.rmsAbsError
+              << ", max rel " << report.maxRelError << ", mean rel " << report.meanRelError << std::endl;
+}
+#endif
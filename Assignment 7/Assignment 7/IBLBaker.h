@@ -0,0 +1,786 @@
+#pragma once
+#ifndef IBL_BAKER_H
+#define IBL_BAKER_H
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "HDRFormats.h"
+#include "MappedFile.h"
+#include "Parallel.h"
+#include "RadianceHDR.h"
+#include "SampleTables.h"
+#include "SphericalHarmonics.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+// CPU version of the image based lighting bake in assignment7.cpp. From an equirectangular
+// HDR it produces the environment cubemap (with mips), SH9 diffuse irradiance, the GGX
+// prefiltered mips and the split-sum BRDF LUT, without a GL context. Results are stored
+// packed in a .ibl cache file keyed by a hash of the HDR file and the bake settings, so the
+// viewer only bakes once per environment. iblbake.cpp is the command line front end.
+//
+// Cubemap faces follow the GL layout: +X, -X, +Y, -Y, +Z, -Z, first row at t = 0.
+
+const float IBL_PI = 3.14159265358979f;
+
+struct IBLBakeSettings {
+    int environmentSize = 1024;
+    float irradianceWindow = 0.0f;   // Hanning window width in SH bands, 0 = off
+    int prefilterSize = 128;
+    int prefilterMips = 5;
+    int prefilterSamples = 1024;             // upper bound per mip, see prefilterSampleCount
+    float prefilterSampleDensity = 4.0f;     // samples per output texel covered by the lobe, see sweepPrefilterQuality
+    int brdfLUTSize = 128;
+    int brdfLUTSamples = 1024;
+    HDRStorage environmentStorage = HDRStorage::R11G11B10F;
+    HDRStorage prefilterStorage = HDRStorage::RGB16F;
+};
+
+// float RGB cubemap, mip-major (mip 0 faces +X..-Z, then mip 1...)
+struct FloatCubemap {
+    int size = 0;
+    int mipLevels = 0;
+    std::vector<float> data;
+
+    int mipSize(int mip) const { return std::max(size >> mip, 1); }
+    size_t faceFloats(int mip) const { return static_cast<size_t>(mipSize(mip)) * mipSize(mip) * 3; }
+    size_t faceOffset(int mip, int face) const
+    {
+        size_t offset = 0;
+        for (int m = 0; m < mip; ++m)
+            offset += 6 * faceFloats(m);
+        return offset + face * faceFloats(mip);
+    }
+    const float* face(int mip, int face) const { return &data[faceOffset(mip, face)]; }
+    float* face(int mip, int face) { return &data[faceOffset(mip, face)]; }
+};
+
+// cubemap in one of the HDRStorage formats, same texel order as FloatCubemap
+struct PackedCubemap {
+    HDRStorage storage = HDRStorage::RGB32F;
+    int size = 0;
+    int mipLevels = 0;
+    std::vector<unsigned char> data;
+
+    int mipSize(int mip) const { return std::max(size >> mip, 1); }
+    size_t faceBytes(int mip) const { return static_cast<size_t>(mipSize(mip)) * mipSize(mip) * hdrGLFormat(storage).bytesPerTexel; }
+    size_t faceOffset(int mip, int face) const
+    {
+        size_t offset = 0;
+        for (int m = 0; m < mip; ++m)
+            offset += 6 * faceBytes(m);
+        return offset + face * faceBytes(mip);
+    }
+    size_t totalBytes() const { return faceOffset(mipLevels - 1, 6); }
+};
+
+struct IBLProducts {
+    PackedCubemap environment;
+    SH9Color irradianceSH;
+    PackedCubemap prefilter;
+    int brdfLUTSize = 0;
+    std::vector<uint16_t> brdfLUT;   // RG16F, x = NoV, y = roughness
+    float prefilterSampleDensity = 0.0f;   // what the prefilter was baked with, from bakeIBL or the cache
+};
+
+// direction through the center of texel (x, y) of a cubemap face
+// ------------------------------------------------------------------------
+inline glm::vec3 cubemapTexelDirection(int face, float x, float y, int size)
+{
+    float s = 2.0f * (x + 0.5f) / size - 1.0f;
+    float t = 2.0f * (y + 0.5f) / size - 1.0f;
+    glm::vec3 dir;
+    switch (face)
+    {
+    case 0: dir = glm::vec3(1.0f, -t, -s); break;
+    case 1: dir = glm::vec3(-1.0f, -t, s); break;
+    case 2: dir = glm::vec3(s, 1.0f, t); break;
+    case 3: dir = glm::vec3(s, -1.0f, -t); break;
+    case 4: dir = glm::vec3(s, -t, 1.0f); break;
+    default: dir = glm::vec3(-s, -t, -1.0f); break;
+    }
+    return glm::normalize(dir);
+}
+
+// face and [0, 1] face coordinates hit by a direction (GL major axis selection)
+// ------------------------------------------------------------------------
+inline int cubemapFaceCoords(const glm::vec3& dir, float& u, float& v)
+{
+    glm::vec3 a = glm::abs(dir);
+    int face;
+    float sc, tc, ma;
+    if (a.x >= a.y && a.x >= a.z)
+    {
+        face = dir.x > 0.0f ? 0 : 1;
+        sc = dir.x > 0.0f ? -dir.z : dir.z;
+        tc = -dir.y;
+        ma = a.x;
+    }
+    else if (a.y >= a.z)
+    {
+        face = dir.y > 0.0f ? 2 : 3;
+        sc = dir.x;
+        tc = dir.y > 0.0f ? dir.z : -dir.z;
+        ma = a.y;
+    }
+    else
+    {
+        face = dir.z > 0.0f ? 4 : 5;
+        sc = dir.z > 0.0f ? dir.x : -dir.x;
+        tc = -dir.y;
+        ma = a.z;
+    }
+    u = 0.5f * (sc / ma + 1.0f);
+    v = 0.5f * (tc / ma + 1.0f);
+    return face;
+}
+
+// bilinear lookup in one RGB image, clamped to the edges (or wrapped horizontally)
+// ------------------------------------------------------------------------
+inline glm::vec3 sampleBilinear(const float* texels, int width, int height, float u, float v, bool wrapU = false)
+{
+    float fx = u * width - 0.5f;
+    float fy = v * height - 0.5f;
+    int x0 = static_cast<int>(std::floor(fx));
+    int y0 = static_cast<int>(std::floor(fy));
+    float wx = fx - x0;
+    float wy = fy - y0;
+    int x1 = x0 + 1;
+    int y1 = y0 + 1;
+    if (wrapU)
+    {
+        x0 = (x0 % width + width) % width;
+        x1 = (x1 % width + width) % width;
+    }
+    else
+    {
+        x0 = std::min(std::max(x0, 0), width - 1);
+        x1 = std::min(std::max(x1, 0), width - 1);
+    }
+    y0 = std::min(std::max(y0, 0), height - 1);
+    y1 = std::min(std::max(y1, 0), height - 1);
+
+    auto texel = [&](int x, int y) {
+        const float* p = texels + (static_cast<size_t>(y) * width + x) * 3;
+        return glm::vec3(p[0], p[1], p[2]);
+    };
+    return glm::mix(glm::mix(texel(x0, y0), texel(x1, y0), wx), glm::mix(texel(x0, y1), texel(x1, y1), wx), wy);
+}
+
+// trilinear lookup, lod in mip levels of the cubemap
+// ------------------------------------------------------------------------
+inline glm::vec3 sampleCubemapLod(const FloatCubemap& cube, const glm::vec3& dir, float lod)
+{
+    float u, v;
+    int face = cubemapFaceCoords(dir, u, v);
+    lod = std::min(std::max(lod, 0.0f), static_cast<float>(cube.mipLevels - 1));
+    int mip0 = static_cast<int>(lod);
+    int mip1 = std::min(mip0 + 1, cube.mipLevels - 1);
+    glm::vec3 c0 = sampleBilinear(cube.face(mip0, face), cube.mipSize(mip0), cube.mipSize(mip0), u, v);
+    if (mip1 == mip0)
+        return c0;
+    glm::vec3 c1 = sampleBilinear(cube.face(mip1, face), cube.mipSize(mip1), cube.mipSize(mip1), u, v);
+    return glm::mix(c0, c1, lod - mip0);
+}
+
+// 2x2 box filter down to 1x1, one band of faces per thread
+// ------------------------------------------------------------------------
+inline void buildFloatCubemapMips(FloatCubemap& cube)
+{
+    for (int mip = 1; mip < cube.mipLevels; ++mip)
+    {
+        const int srcSize = cube.mipSize(mip - 1);
+        const int dstSize = cube.mipSize(mip);
+        parallelForRows(6 * dstSize, 16, [&](int begin, int end) {
+            for (int row = begin; row < end; ++row)
+            {
+                int face = row / dstSize;
+                int y = row % dstSize;
+                const float* src0 = cube.face(mip - 1, face) + static_cast<size_t>(2 * y) * srcSize * 3;
+                const float* src1 = src0 + static_cast<size_t>(srcSize) * 3;
+                float* dst = cube.face(mip, face) + static_cast<size_t>(y) * dstSize * 3;
+                for (int x = 0; x < dstSize; ++x)
+                    for (int c = 0; c < 3; ++c)
+                        dst[3 * x + c] = 0.25f * (src0[6 * x + c] + src0[6 * x + 3 + c] + src1[6 * x + c] + src1[6 * x + 3 + c]);
+            }
+        });
+    }
+}
+
+// Equirectangular image (bottom-up rows, as loaded for GL) to a cubemap with a full mip
+// chain. Same mapping as convertWorldFS.
+// ------------------------------------------------------------------------
+inline FloatCubemap bakeEnvironmentCubemap(const float* equirect, int width, int height, int size)
+{
+    FloatCubemap cube;
+    cube.size = size;
+    cube.mipLevels = 1;
+    while ((size >> cube.mipLevels) > 0)
+        ++cube.mipLevels;
+    cube.data.resize(cube.faceOffset(cube.mipLevels - 1, 6));
+
+    parallelForRows(6 * size, 16, [&](int begin, int end) {
+        for (int row = begin; row < end; ++row)
+        {
+            int face = row / size;
+            int y = row % size;
+            float* dst = cube.face(0, face) + static_cast<size_t>(y) * size * 3;
+            for (int x = 0; x < size; ++x)
+            {
+                glm::vec3 dir = cubemapTexelDirection(face, static_cast<float>(x), static_cast<float>(y), size);
+                float u = std::atan2(dir.z, dir.x) * 0.15915494f + 0.5f;
+                float v = std::asin(std::min(std::max(dir.y, -1.0f), 1.0f)) * 0.31830989f + 0.5f;
+                glm::vec3 color = sampleBilinear(equirect, width, height, u, v, true);
+                dst[3 * x + 0] = color.r;
+                dst[3 * x + 1] = color.g;
+                dst[3 * x + 2] = color.b;
+            }
+        }
+    });
+    buildFloatCubemapMips(cube);
+    return cube;
+}
+
+// Diffuse irradiance cubemap (divided by pi, like irradianceSourceFS) as an exact
+// cosine-weighted sum over every texel of a small environment mip. The viewer uses SH9
+// irradiance now; this is the reference to check the SH fit against. The source texels are flattened into
+// SoA arrays with radiance pre-multiplied by solid angle, so the inner loop is four dot
+// products, a clamp and three multiply-adds per SSE step.
+// ------------------------------------------------------------------------
+inline FloatCubemap bakeIrradianceCubemap(const FloatCubemap& environment, int size, int sourceSize = 64)
+{
+    int sourceMip = 0;
+    while (sourceMip + 1 < environment.mipLevels && environment.mipSize(sourceMip) > sourceSize)
+        ++sourceMip;
+    const int n = environment.mipSize(sourceMip);
+
+    const size_t sourceCount = static_cast<size_t>(6) * n * n;
+    const size_t padded = (sourceCount + 3) & ~static_cast<size_t>(3);
+    std::vector<float> dx(padded, 0.0f), dy(padded, 0.0f), dz(padded, 0.0f);
+    std::vector<float> lr(padded, 0.0f), lg(padded, 0.0f), lb(padded, 0.0f);
+    for (int face = 0; face < 6; ++face)
+    {
+        const float* texels = environment.face(sourceMip, face);
+        for (int y = 0; y < n; ++y)
+        {
+            for (int x = 0; x < n; ++x)
+            {
+                float s = 2.0f * (x + 0.5f) / n - 1.0f;
+                float t = 2.0f * (y + 0.5f) / n - 1.0f;
+                float r2 = 1.0f + s * s + t * t;
+                float solidAngle = 4.0f / (n * n * r2 * std::sqrt(r2));
+                size_t i = (static_cast<size_t>(face) * n + y) * n + x;
+                glm::vec3 dir = cubemapTexelDirection(face, static_cast<float>(x), static_cast<float>(y), n);
+                dx[i] = dir.x;
+                dy[i] = dir.y;
+                dz[i] = dir.z;
+                lr[i] = texels[3 * (y * n + x) + 0] * solidAngle;
+                lg[i] = texels[3 * (y * n + x) + 1] * solidAngle;
+                lb[i] = texels[3 * (y * n + x) + 2] * solidAngle;
+            }
+        }
+    }
+
+    FloatCubemap irradiance;
+    irradiance.size = size;
+    irradiance.mipLevels = 1;
+    irradiance.data.resize(irradiance.faceOffset(0, 6));
+    parallelForRows(6 * size * size, 64, [&](int begin, int end) {
+        for (int i = begin; i < end; ++i)
+        {
+            int face = i / (size * size);
+            int x = i % size;
+            int y = (i / size) % size;
+            glm::vec3 normal = cubemapTexelDirection(face, static_cast<float>(x), static_cast<float>(y), size);
+            float sum[3] = { 0.0f, 0.0f, 0.0f };
+            size_t k = 0;
+#ifdef HDR_FORMATS_SSE2
+            __m128 nx = _mm_set1_ps(normal.x), ny = _mm_set1_ps(normal.y), nz = _mm_set1_ps(normal.z);
+            __m128 zero = _mm_setzero_ps();
+            __m128 accR = zero, accG = zero, accB = zero;
+            for (; k < padded; k += 4)
+            {
+                __m128 cosine = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, _mm_loadu_ps(&dx[k])), _mm_mul_ps(ny, _mm_loadu_ps(&dy[k]))),
+                                           _mm_mul_ps(nz, _mm_loadu_ps(&dz[k])));
+                cosine = _mm_max_ps(cosine, zero);
+                accR = _mm_add_ps(accR, _mm_mul_ps(cosine, _mm_loadu_ps(&lr[k])));
+                accG = _mm_add_ps(accG, _mm_mul_ps(cosine, _mm_loadu_ps(&lg[k])));
+                accB = _mm_add_ps(accB, _mm_mul_ps(cosine, _mm_loadu_ps(&lb[k])));
+            }
+            float lanes[4];
+            _mm_storeu_ps(lanes, accR);
+            sum[0] = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+            _mm_storeu_ps(lanes, accG);
+            sum[1] = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+            _mm_storeu_ps(lanes, accB);
+            sum[2] = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#endif
+            for (; k < padded; ++k)
+            {
+                float cosine = std::max(normal.x * dx[k] + normal.y * dy[k] + normal.z * dz[k], 0.0f);
+                sum[0] += cosine * lr[k];
+                sum[1] += cosine * lg[k];
+                sum[2] += cosine * lb[k];
+            }
+            float* dst = irradiance.face(0, face) + (static_cast<size_t>(y) * size + x) * 3;
+            for (int c = 0; c < 3; ++c)
+                dst[c] = sum[c] / IBL_PI;
+        }
+    });
+    return irradiance;
+}
+
+// Samples for one prefilter mip: about one per output texel the GGX lobe covers. The lobe
+// spans roughly 1 / pdf_peak = 4 pi alpha^2 sr and an output texel 4 pi / (6 size^2); as
+// every sample reads the source mip matching its own solid angle, that many already cover
+// the lobe without gaps. density scales the estimate (sweepPrefilterQuality picks it).
+// Rounded up to a power of two, at least 16: a power of two prefix of the Owen-Sobol
+// table is still stratified. Roughness 0 is a single mirror tap.
+// ------------------------------------------------------------------------
+inline int prefilterSampleCount(float roughness, int mipSize, int maxSamples, float density = 1.0f)
+{
+    if (roughness == 0.0f)
+        return 1;
+    const float alpha = roughness * roughness;
+    const float coveredTexels = density * 6.0f * alpha * alpha * mipSize * mipSize;
+    int count = 16;
+    while (count < coveredTexels && count < maxSamples)
+        count *= 2;
+    return std::min(count, maxSamples);
+}
+
+// Tangent-space sample set of one prefilter mip (N = V = R): xyz is the light direction,
+// whose z (NoL) is also its weight, and w the source LOD whose texel footprint matches the
+// sample's solid angle, never finer than the output texel (sampling below that only
+// aliases). The first sampleCount half vectors of the roughness bucket of the shared
+// SampleTable are used; the GPU bakes use the same rule.
+// ------------------------------------------------------------------------
+inline std::vector<glm::vec4> prefilterSampleTable(const SampleTable& table, int environmentSize, int mipSize, float roughness, int sampleCount)
+{
+    std::vector<glm::vec4> samples;
+    const float outputLod = std::log2(static_cast<float>(environmentSize) / mipSize);
+    if (roughness == 0.0f)
+    {
+        samples.push_back(glm::vec4(0.0f, 0.0f, 1.0f, outputLod));
+        return samples;
+    }
+
+    sampleCount = std::min(sampleCount, table.count);
+    const float texelSolidAngle = 4.0f * IBL_PI / (6.0f * environmentSize * environmentSize);
+    const glm::vec4* halfVectors = table.ggxBucket(table.bucket(roughness));
+    for (int i = 0; i < sampleCount; ++i)
+    {
+        const glm::vec4& h = halfVectors[i];
+        glm::vec3 l = glm::vec3(2.0f * h.z * h.x, 2.0f * h.z * h.y, 2.0f * h.z * h.z - 1.0f);
+        if (l.z <= 0.0f)
+            continue;
+        float pdf = h.w + 0.0001f;
+        float sampleSolidAngle = 1.0f / (sampleCount * pdf + 0.0001f);
+        samples.push_back(glm::vec4(l, std::max(0.5f * std::log2(sampleSolidAngle / texelSolidAngle), outputLod)));
+    }
+    return samples;
+}
+
+// GGX prefiltered mips, mip m at roughness m / (mips - 1). The sample set only depends on
+// roughness, so it is built once per mip in tangent space (prefilterSampleTable) and each
+// texel just rotates it into its frame. mips - 1 must divide SAMPLE_TABLE_BUCKETS - 1 for
+// every mip to get its exact roughness. Mip m takes prefilterSampleCount samples, at most
+// maxSamples.
+// ------------------------------------------------------------------------
+inline FloatCubemap bakePrefilteredCubemap(const FloatCubemap& environment, int size, int mips, int maxSamples, float density = 1.0f)
+{
+    FloatCubemap prefilter;
+    prefilter.size = size;
+    prefilter.mipLevels = mips;
+    prefilter.data.resize(prefilter.faceOffset(mips - 1, 6));
+
+    const SampleTable table = buildSampleTable(maxSamples);
+    for (int mip = 0; mip < mips; ++mip)
+    {
+        const float roughness = mips > 1 ? static_cast<float>(mip) / (mips - 1) : 0.0f;
+        const int mipSize = prefilter.mipSize(mip);
+        const int sampleCount = prefilterSampleCount(roughness, mipSize, maxSamples, density);
+        const std::vector<glm::vec4> samples = prefilterSampleTable(table, environment.size, mipSize, roughness, sampleCount);
+
+        parallelForRows(6 * mipSize, 4, [&](int begin, int end) {
+            for (int row = begin; row < end; ++row)
+            {
+                int face = row / mipSize;
+                int y = row % mipSize;
+                float* dst = prefilter.face(mip, face) + static_cast<size_t>(y) * mipSize * 3;
+                for (int x = 0; x < mipSize; ++x)
+                {
+                    glm::vec3 n = cubemapTexelDirection(face, static_cast<float>(x), static_cast<float>(y), mipSize);
+                    glm::vec3 up = std::abs(n.z) < 0.999f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+                    glm::vec3 tangent = glm::normalize(glm::cross(up, n));
+                    glm::vec3 bitangent = glm::cross(n, tangent);
+
+                    glm::vec3 color(0.0f);
+                    float weight = 0.0f;
+                    for (const glm::vec4& s : samples)
+                    {
+                        glm::vec3 l = tangent * s.x + bitangent * s.y + n * s.z;
+                        color += sampleCubemapLod(environment, l, s.w) * s.z;
+                        weight += s.z;
+                    }
+                    color /= weight;
+                    dst[3 * x + 0] = color.r;
+                    dst[3 * x + 1] = color.g;
+                    dst[3 * x + 2] = color.b;
+                }
+            }
+        });
+    }
+    return prefilter;
+}
+
+// Error-vs-time sweep of prefilterSampleDensity for one environment. Every density is
+// baked and compared, mip by mip, to a reference with referenceSamples per mip (relative
+// L2 error); the table is printed and the cheapest density whose worst mip stays under
+// tolerance is returned (the densest one if none does).
+// ------------------------------------------------------------------------
+inline float sweepPrefilterQuality(const FloatCubemap& environment, const IBLBakeSettings& settings, float tolerance = 0.01f,
+                                   int referenceSamples = 8192)
+{
+    using Clock = std::chrono::steady_clock;
+    const int size = settings.prefilterSize;
+    const int mips = settings.prefilterMips;
+    const float densities[] = { 0.0625f, 0.125f, 0.25f, 0.5f, 1.0f, 2.0f, 4.0f };
+
+    auto t0 = Clock::now();
+    FloatCubemap reference = bakePrefilteredCubemap(environment, size, mips, referenceSamples, 1e9f);
+    std::cout << "Prefilter sweep: reference (" << referenceSamples << " samples per mip) "
+              << std::chrono::duration<double, std::milli>(Clock::now() - t0).count() << " ms, tolerance " << tolerance << std::endl;
+
+    float chosen = densities[sizeof(densities) / sizeof(densities[0]) - 1];
+    bool found = false;
+    for (float density : densities)
+    {
+        auto start = Clock::now();
+        FloatCubemap prefilter = bakePrefilteredCubemap(environment, size, mips, settings.prefilterSamples, density);
+        double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+        float worst = 0.0f;
+        std::cout << "  density " << density << ": " << ms << " ms, samples/error per mip";
+        for (int mip = 0; mip < mips; ++mip)
+        {
+            const float roughness = mips > 1 ? static_cast<float>(mip) / (mips - 1) : 0.0f;
+            const float* a = prefilter.face(mip, 0);
+            const float* b = reference.face(mip, 0);
+            double diff = 0.0, norm = 0.0;
+            for (size_t i = 0; i < 6 * prefilter.faceFloats(mip); ++i)
+            {
+                diff += (a[i] - b[i]) * static_cast<double>(a[i] - b[i]);
+                norm += b[i] * static_cast<double>(b[i]);
+            }
+            float error = norm > 0.0 ? static_cast<float>(std::sqrt(diff / norm)) : 0.0f;
+            worst = std::max(worst, error);
+            std::cout << " " << prefilterSampleCount(roughness, prefilter.mipSize(mip), settings.prefilterSamples, density) << "/" << error;
+        }
+        std::cout << std::endl;
+        if (!found && worst <= tolerance)
+        {
+            chosen = density;
+            found = true;
+        }
+    }
+    std::cout << "Prefilter sweep: density " << chosen << (found ? "" : " (nothing met the tolerance)") << std::endl;
+    return chosen;
+}
+
+// Split-sum environment BRDF: (scale, bias) applied to F0, over (NoV, roughness). Rows sit
+// between the roughness buckets, so only the points come from the sample table.
+// ------------------------------------------------------------------------
+inline std::vector<float> bakeBRDFLUT(int size, int sampleCount)
+{
+    const SampleTable table = buildSampleTable(sampleCount, SampleSequence::OwenSobol, 0);
+    std::vector<float> lut(static_cast<size_t>(size) * size * 2);
+    parallelForRows(size, 1, [&](int begin, int end) {
+        for (int y = begin; y < end; ++y)
+        {
+            float roughness = (y + 0.5f) / size;
+            float k = roughness * roughness / 2.0f;
+            for (int x = 0; x < size; ++x)
+            {
+                float NoV = (x + 0.5f) / size;
+                glm::vec3 v(std::sqrt(1.0f - NoV * NoV), 0.0f, NoV);
+                float scale = 0.0f, bias = 0.0f;
+                for (int i = 0; i < sampleCount; ++i)
+                {
+                    glm::vec3 h = ggxHalfVector(table.points[i], roughness);
+                    glm::vec3 l = 2.0f * glm::dot(v, h) * h - v;
+                    float NoL = std::max(l.z, 0.0f);
+                    if (NoL <= 0.0f)
+                        continue;
+                    float NoH = std::max(h.z, 0.0f);
+                    float VoH = std::max(glm::dot(v, h), 0.0f);
+                    float g = (NoV / (NoV * (1.0f - k) + k)) * (NoL / (NoL * (1.0f - k) + k));
+                    float gVis = g * VoH / (NoH * NoV);
+                    float fc = std::pow(1.0f - VoH, 5.0f);
+                    scale += (1.0f - fc) * gVis;
+                    bias += fc * gVis;
+                }
+                lut[2 * (static_cast<size_t>(y) * size + x) + 0] = scale / sampleCount;
+                lut[2 * (static_cast<size_t>(y) * size + x) + 1] = bias / sampleCount;
+            }
+        }
+    });
+    return lut;
+}
+
+inline PackedCubemap packCubemap(const FloatCubemap& cube, HDRStorage storage)
+{
+    PackedCubemap packed;
+    packed.storage = storage;
+    packed.size = cube.size;
+    packed.mipLevels = cube.mipLevels;
+    packed.data = packHDR(cube.data.data(), cube.data.size() / 3, storage);
+    return packed;
+}
+
+inline FloatCubemap unpackCubemap(const PackedCubemap& packed)
+{
+    FloatCubemap cube;
+    cube.size = packed.size;
+    cube.mipLevels = packed.mipLevels;
+    cube.data = unpackHDR(packed.data.data(), packed.totalBytes() / hdrGLFormat(packed.storage).bytesPerTexel, packed.storage);
+    return cube;
+}
+
+// The LUT only depends on the BRDF, not on the environment, so the GL bake path can
+// take it from here as well.
+// ------------------------------------------------------------------------
+inline void packBRDFLUT(const std::vector<float>& lut, int size, IBLProducts& products)
+{
+    products.brdfLUTSize = size;
+    products.brdfLUT.resize(lut.size());
+    for (size_t i = 0; i < lut.size(); ++i)
+        products.brdfLUT[i] = encodeHalf(lut[i]);
+}
+
+// Runs every bake step on an RGB32F equirectangular image and prints how long each took.
+// ------------------------------------------------------------------------
+inline void bakeIBL(const RadianceHDRImage& image, const IBLBakeSettings& settings, IBLProducts& products)
+{
+    using Clock = std::chrono::steady_clock;
+    auto ms = [](Clock::time_point a, Clock::time_point b) { return std::chrono::duration<double, std::milli>(b - a).count(); };
+
+    auto t0 = Clock::now();
+    FloatCubemap environment = bakeEnvironmentCubemap(image.floats(), image.width, image.height, settings.environmentSize);
+    auto t1 = Clock::now();
+    products.irradianceSH = projectSH9Equirect(image.floats(), image.width, image.height);
+    windowSH9(products.irradianceSH, settings.irradianceWindow);
+    auto t2 = Clock::now();
+    FloatCubemap prefilter = bakePrefilteredCubemap(environment, settings.prefilterSize, settings.prefilterMips, settings.prefilterSamples,
+                                                    settings.prefilterSampleDensity);
+    auto t3 = Clock::now();
+    std::vector<float> lut = bakeBRDFLUT(settings.brdfLUTSize, settings.brdfLUTSamples);
+    auto t4 = Clock::now();
+
+    products.environment = packCubemap(environment, settings.environmentStorage);
+    products.prefilter = packCubemap(prefilter, settings.prefilterStorage);
+    products.prefilterSampleDensity = settings.prefilterSampleDensity;
+    packBRDFLUT(lut, settings.brdfLUTSize, products);
+    auto t5 = Clock::now();
+
+    std::cout << "IBL bake (" << parallelWorkerCount() << " threads): environment " << ms(t0, t1) << " ms, SH9 irradiance " << ms(t1, t2)
+              << " ms, prefilter " << ms(t2, t3) << " ms, BRDF LUT " << ms(t3, t4) << " ms, packing " << ms(t4, t5) << " ms" << std::endl;
+}
+
+// ------------------------------------------------------------------------
+// .ibl cache file: header, then environment, prefilter, SH9 (27 floats) and LUT payloads.
+
+struct IBLCacheHeader {
+    char magic[4];           // "IBLC"
+    uint32_t version;
+    uint64_t sourceHash;     // FNV-1a of the whole HDR file
+    int32_t environmentSize, prefilterSize, prefilterMips;
+    int32_t prefilterSamples, brdfLUTSize, brdfLUTSamples;
+    int32_t environmentStorage, prefilterStorage;
+    float irradianceWindow;
+    float prefilterSampleDensity;
+    uint64_t payloadBytes;
+};
+
+// 3: Owen-scrambled Sobol sample tables, 4: per-mip sample counts, 5: default density 4
+const uint32_t IBL_CACHE_VERSION = 5;
+
+inline uint64_t hashIBLSource(const char* path)
+{
+    MappedFile file(path);
+    if (!file.isOpen())
+        return 0;
+    uint64_t hash = 1469598103934665603ull;
+    const unsigned char* bytes = file.data();
+    for (size_t i = 0; i < file.size(); ++i)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+inline IBLCacheHeader makeIBLCacheHeader(uint64_t sourceHash, const IBLBakeSettings& settings)
+{
+    IBLCacheHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, "IBLC", 4);
+    header.version = IBL_CACHE_VERSION;
+    header.sourceHash = sourceHash;
+    header.environmentSize = settings.environmentSize;
+    header.irradianceWindow = settings.irradianceWindow;
+    header.prefilterSize = settings.prefilterSize;
+    header.prefilterMips = settings.prefilterMips;
+    header.prefilterSamples = settings.prefilterSamples;
+    header.brdfLUTSize = settings.brdfLUTSize;
+    header.brdfLUTSamples = settings.brdfLUTSamples;
+    header.prefilterSampleDensity = settings.prefilterSampleDensity;
+    header.environmentStorage = static_cast<int32_t>(settings.environmentStorage);
+    header.prefilterStorage = static_cast<int32_t>(settings.prefilterStorage);
+    return header;
+}
+
+// Whether a cache header describes the same source and bake. Every setting has to match
+// except the prefilter density, which iblbake --sweep picks per environment.
+// ------------------------------------------------------------------------
+inline bool sameIBLCacheBake(const IBLCacheHeader& a, const IBLCacheHeader& b)
+{
+    return std::memcmp(a.magic, b.magic, sizeof(a.magic)) == 0 && a.version == b.version && a.sourceHash == b.sourceHash &&
+           a.environmentSize == b.environmentSize && a.prefilterSize == b.prefilterSize && a.prefilterMips == b.prefilterMips &&
+           a.prefilterSamples == b.prefilterSamples && a.brdfLUTSize == b.brdfLUTSize && a.brdfLUTSamples == b.brdfLUTSamples &&
+           a.environmentStorage == b.environmentStorage && a.prefilterStorage == b.prefilterStorage &&
+           a.irradianceWindow == b.irradianceWindow;
+}
+
+inline bool writeIBLCache(const char* path, uint64_t sourceHash, const IBLBakeSettings& settings, const IBLProducts& products)
+{
+    IBLCacheHeader header = makeIBLCacheHeader(sourceHash, settings);
+    header.prefilterSampleDensity = products.prefilterSampleDensity;
+    header.payloadBytes = products.environment.data.size() + products.prefilter.data.size() + sizeof(SH9Color) +
+                          products.brdfLUT.size() * sizeof(uint16_t);
+
+    FILE* file = std::fopen(path, "wb");
+    if (!file)
+    {
+        std::cout << "Could not write IBL cache: " << path << std::endl;
+        return false;
+    }
+    bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1 &&
+              std::fwrite(products.environment.data.data(), 1, products.environment.data.size(), file) == products.environment.data.size() &&
+              std::fwrite(products.prefilter.data.data(), 1, products.prefilter.data.size(), file) == products.prefilter.data.size() &&
+              std::fwrite(&products.irradianceSH, sizeof(SH9Color), 1, file) == 1 &&
+              std::fwrite(products.brdfLUT.data(), sizeof(uint16_t), products.brdfLUT.size(), file) == products.brdfLUT.size();
+    return std::fclose(file) == 0 && ok;
+}
+
+// Reads a cache baked from the same HDR file with the same settings; anything else is a
+// miss. The prefilter density comes from the file.
+// ------------------------------------------------------------------------
+inline bool readIBLCache(const char* path, uint64_t sourceHash, const IBLBakeSettings& settings, IBLProducts& products)
+{
+    MappedFile file(path);
+    if (!file.isOpen() || file.size() < sizeof(IBLCacheHeader))
+        return false;
+
+    IBLCacheHeader header;
+    std::memcpy(&header, file.data(), sizeof(header));
+    if (!sameIBLCacheBake(header, makeIBLCacheHeader(sourceHash, settings)) || header.payloadBytes != file.size() - sizeof(header))
+        return false;
+
+    auto layout = [](PackedCubemap& cube, HDRStorage storage, int size, int mips) {
+        cube.storage = storage;
+        cube.size = size;
+        cube.mipLevels = mips;
+    };
+    int environmentMips = 1;
+    while ((settings.environmentSize >> environmentMips) > 0)
+        ++environmentMips;
+    layout(products.environment, settings.environmentStorage, settings.environmentSize, environmentMips);
+    layout(products.prefilter, settings.prefilterStorage, settings.prefilterSize, settings.prefilterMips);
+    products.brdfLUTSize = settings.brdfLUTSize;
+    products.prefilterSampleDensity = header.prefilterSampleDensity;
+
+    size_t lutBytes = static_cast<size_t>(settings.brdfLUTSize) * settings.brdfLUTSize * 2 * sizeof(uint16_t);
+    if (header.payloadBytes != products.environment.totalBytes() + products.prefilter.totalBytes() + sizeof(SH9Color) + lutBytes)
+        return false;
+
+    const unsigned char* p = file.data() + sizeof(header);
+    for (PackedCubemap* cube : { &products.environment, &products.prefilter })
+    {
+        cube->data.assign(p, p + cube->totalBytes());
+        p += cube->totalBytes();
+    }
+    std::memcpy(&products.irradianceSH, p, sizeof(SH9Color));
+    p += sizeof(SH9Color);
+    products.brdfLUT.resize(lutBytes / sizeof(uint16_t));
+    std::memcpy(products.brdfLUT.data(), p, lutBytes);
+    return true;
+}
+
+// Loads the cache for hdrPath, or bakes it on the CPU and writes it back when missing/stale.
+// ------------------------------------------------------------------------
+inline bool loadOrBakeIBL(const char* hdrPath, const char* cachePath, const IBLBakeSettings& settings, IBLProducts& products)
+{
+    uint64_t sourceHash = hashIBLSource(hdrPath);
+    if (sourceHash == 0)
+        return false;
+    if (readIBLCache(cachePath, sourceHash, settings, products))
+        return true;
+
+    RadianceHDRImage image;
+    if (!loadRadianceHDR(hdrPath, HDRStorage::RGB32F, image))
+        return false;
+    bakeIBL(image, settings, products);
+    writeIBLCache(cachePath, sourceHash, settings, products);
+    return true;
+}
+
+// ------------------------------------------------------------------------
+// GL upload of the cached products.
+
+inline unsigned int uploadPackedCubemap(const PackedCubemap& cube)
+{
+    HDRGLFormat format = hdrGLFormat(cube.storage);
+    unsigned int texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (int mip = 0; mip < cube.mipLevels; ++mip)
+    {
+        for (int face = 0; face < 6; ++face)
+        {
+            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, mip, format.internalFormat, cube.mipSize(mip), cube.mipSize(mip), 0,
+                         format.format, format.type, &cube.data[cube.faceOffset(mip, face)]);
+        }
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, cube.mipLevels - 1);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, cube.mipLevels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    return texture;
+}
+
+inline unsigned int uploadBRDFLUT(const IBLProducts& products)
+{
+    unsigned int texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16F, products.brdfLUTSize, products.brdfLUTSize, 0, GL_RG, GL_HALF_FLOAT, products.brdfLUT.data());
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    return texture;
+}
+#endif
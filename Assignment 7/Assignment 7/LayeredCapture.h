@@ -0,0 +1,182 @@
+#pragma once
+#ifndef LAYERED_CAPTURE_H
+#define LAYERED_CAPTURE_H
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "ProgramCache.h"
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Renders all six faces of a cubemap level in one instanced draw. The whole level is bound
+// as a layered attachment (glFramebufferTexture) and instance i goes to layer i with
+// captureViews[i]. With ARB_shader_viewport_layer_array the vertex shader writes gl_Layer
+// itself; otherwise a pass-through geometry shader does (core in GL 3.2).
+//
+// Capture fragment shaders keep their `in vec3 worldPosition` input. A layered framebuffer
+// cannot mix in a non-layered depth renderbuffer, and the inside of a cube needs no depth
+// test anyway, so capture framebuffers have only the color attachment.
+
+const char* const CAPTURE_VIEWPORT_LAYER_VS = R"(#version 330 core
+#extension GL_ARB_shader_viewport_layer_array : require
+layout (location = 0) in vec3 position;
+
+out vec3 worldPosition;
+
+uniform mat4 projection;
+uniform mat4 captureViews[6];
+
+void main()
+{
+    worldPosition = position;
+    gl_Layer = gl_InstanceID;
+    gl_Position = projection * captureViews[gl_InstanceID] * vec4(position, 1.0);
+}
+)";
+
+const char* const CAPTURE_LAYER_VS = R"(#version 330 core
+layout (location = 0) in vec3 position;
+
+out vec3 cubePosition;
+flat out int captureFace;
+
+void main()
+{
+    cubePosition = position;
+    captureFace = gl_InstanceID;
+    gl_Position = vec4(position, 1.0);
+}
+)";
+
+const char* const CAPTURE_LAYER_GS = R"(#version 330 core
+layout (triangles) in;
+layout (triangle_strip, max_vertices = 3) out;
+
+in vec3 cubePosition[];
+flat in int captureFace[];
+
+out vec3 worldPosition;
+
+uniform mat4 projection;
+uniform mat4 captureViews[6];
+
+void main()
+{
+    gl_Layer = captureFace[0];
+    for (int i = 0; i < 3; ++i)
+    {
+        worldPosition = cubePosition[i];
+        gl_Position = projection * captureViews[captureFace[0]] * vec4(cubePosition[i], 1.0);
+        EmitVertex();
+    }
+    EndPrimitive();
+}
+)";
+
+inline bool captureUsesViewportLayer()
+{
+    return GLEW_ARB_shader_viewport_layer_array != 0;
+}
+
+inline unsigned int compileCaptureStage(GLenum type, const char* source)
+{
+    unsigned int shader = glCreateShader(type);
+    glShaderSource(shader, 1, &source, NULL);
+    glCompileShader(shader);
+    int success;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+    if (!success)
+    {
+        char message[1024];
+        glGetShaderInfoLog(shader, sizeof(message), NULL, message);
+        std::cout << "ERROR::CAPTURE::COMPILATION_FAILED\n" << message << std::endl;
+    }
+    return shader;
+}
+
+// the 90 degree projection and the six face views, which never change afterwards
+// ------------------------------------------------------------------------
+inline void uploadCaptureViews(unsigned int program)
+{
+    const glm::mat4 projection = glm::perspective(glm::radians(90.0f), 1.0f, 0.1f, 10.0f);
+    const glm::mat4 views[6] = {
+        glm::lookAt(glm::vec3(0.0f), glm::vec3( 1.0f,  0.0f,  0.0f), glm::vec3(0.0f, -1.0f,  0.0f)),
+        glm::lookAt(glm::vec3(0.0f), glm::vec3(-1.0f,  0.0f,  0.0f), glm::vec3(0.0f, -1.0f,  0.0f)),
+        glm::lookAt(glm::vec3(0.0f), glm::vec3( 0.0f,  1.0f,  0.0f), glm::vec3(0.0f,  0.0f,  1.0f)),
+        glm::lookAt(glm::vec3(0.0f), glm::vec3( 0.0f, -1.0f,  0.0f), glm::vec3(0.0f,  0.0f, -1.0f)),
+        glm::lookAt(glm::vec3(0.0f), glm::vec3( 0.0f,  0.0f,  1.0f), glm::vec3(0.0f, -1.0f,  0.0f)),
+        glm::lookAt(glm::vec3(0.0f), glm::vec3( 0.0f,  0.0f, -1.0f), glm::vec3(0.0f, -1.0f,  0.0f))
+    };
+    glUseProgram(program);
+    glUniformMatrix4fv(glGetUniformLocation(program, "projection"), 1, GL_FALSE, &projection[0][0]);
+    glUniformMatrix4fv(glGetUniformLocation(program, "captureViews"), 6, GL_FALSE, &views[0][0][0]);
+}
+
+// the layered capture stages around fragmentSource, for ProgramCache or ShaderLibrary;
+// upload the views with uploadCaptureViews once the program is linked
+// ------------------------------------------------------------------------
+inline std::vector<ProgramStage> captureProgramStages(const char* fragmentSource)
+{
+    const bool viewportLayer = captureUsesViewportLayer();
+    std::vector<ProgramStage> stages;
+    stages.push_back({ GL_VERTEX_SHADER, viewportLayer ? CAPTURE_VIEWPORT_LAYER_VS : CAPTURE_LAYER_VS });
+    if (!viewportLayer)
+        stages.push_back({ GL_GEOMETRY_SHADER, CAPTURE_LAYER_GS });
+    stages.push_back({ GL_FRAGMENT_SHADER, fragmentSource });
+    return stages;
+}
+
+// Links fragmentSource with the layered capture stages and uploads the capture views.
+// With a cache the program goes through ProgramCache::build instead.
+// ------------------------------------------------------------------------
+inline unsigned int createCaptureProgram(const char* fragmentSource, ProgramCache* cache = nullptr)
+{
+    const bool viewportLayer = captureUsesViewportLayer();
+    if (cache)
+    {
+        unsigned int program = cache->build("capture", captureProgramStages(fragmentSource));
+        uploadCaptureViews(program);
+        return program;
+    }
+    unsigned int program = glCreateProgram();
+    unsigned int vs = compileCaptureStage(GL_VERTEX_SHADER, viewportLayer ? CAPTURE_VIEWPORT_LAYER_VS : CAPTURE_LAYER_VS);
+    unsigned int gs = viewportLayer ? 0 : compileCaptureStage(GL_GEOMETRY_SHADER, CAPTURE_LAYER_GS);
+    unsigned int fs = compileCaptureStage(GL_FRAGMENT_SHADER, fragmentSource);
+    glAttachShader(program, vs);
+    if (gs)
+        glAttachShader(program, gs);
+    glAttachShader(program, fs);
+    glLinkProgram(program);
+    int success;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (!success)
+    {
+        char message[1024];
+        glGetProgramInfoLog(program, sizeof(message), NULL, message);
+        std::cout << "ERROR::CAPTURE::LINKING_FAILED\n" << message << std::endl;
+    }
+    glDeleteShader(vs);
+    if (gs)
+        glDeleteShader(gs);
+    glDeleteShader(fs);
+    uploadCaptureViews(program);
+    return program;
+}
+
+// Draws drawCube(6) into all faces of cubemap level `mip` (size texels wide) with the
+// currently bound capture program. fbo must have no depth attachment.
+// ------------------------------------------------------------------------
+template <typename DrawCube>
+void captureCubemapLevel(unsigned int fbo, unsigned int cubemap, int mip, int size, DrawCube drawCube)
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, cubemap, mip);
+    glViewport(0, 0, size, size);
+    glClear(GL_COLOR_BUFFER_BIT);
+    drawCube(6);
+}
+#endif
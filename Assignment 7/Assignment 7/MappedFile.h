@@ -0,0 +1,103 @@
+#pragma once
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <iostream>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Read-only view of a whole file mapped into memory. Decoders work straight off the
+// mapped bytes, so the page cache is the only copy of the file in memory and worker
+// threads can read disjoint ranges without any locking.
+class MappedFile
+{
+public:
+    // maps the file at path, check isOpen() before touching data()
+    // ------------------------------------------------------------------------
+    explicit MappedFile(const char* path)
+    {
+#ifdef _WIN32
+        fileHandle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                                 FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if (fileHandle == INVALID_HANDLE_VALUE)
+        {
+            std::cout << "ERROR::MAPPED_FILE::COULD_NOT_OPEN: " << path << std::endl;
+            return;
+        }
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(fileHandle, &fileSize) || fileSize.QuadPart == 0)
+            return;
+        mapHandle = CreateFileMappingA(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mapHandle == NULL)
+            return;
+        bytes = static_cast<const unsigned char*>(MapViewOfFile(mapHandle, FILE_MAP_READ, 0, 0, 0));
+        if (bytes != nullptr)
+            length = static_cast<size_t>(fileSize.QuadPart);
+#else
+        fd = open(path, O_RDONLY);
+        if (fd < 0)
+        {
+            std::cout << "ERROR::MAPPED_FILE::COULD_NOT_OPEN: " << path << std::endl;
+            return;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size == 0)
+            return;
+        void* view = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (view == MAP_FAILED)
+            return;
+        madvise(view, static_cast<size_t>(st.st_size), MADV_WILLNEED);
+        bytes = static_cast<const unsigned char*>(view);
+        length = static_cast<size_t>(st.st_size);
+#endif
+    }
+
+    ~MappedFile()
+    {
+#ifdef _WIN32
+        if (bytes != nullptr)
+            UnmapViewOfFile(bytes);
+        if (mapHandle != NULL)
+            CloseHandle(mapHandle);
+        if (fileHandle != INVALID_HANDLE_VALUE)
+            CloseHandle(fileHandle);
+#else
+        if (bytes != nullptr)
+            munmap(const_cast<unsigned char*>(bytes), length);
+        if (fd >= 0)
+            close(fd);
+#endif
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool isOpen() const { return bytes != nullptr; }
+    const unsigned char* data() const { return bytes; }
+    size_t size() const { return length; }
+
+private:
+    const unsigned char* bytes = nullptr;
+    size_t length = 0;
+#ifdef _WIN32
+    HANDLE fileHandle = INVALID_HANDLE_VALUE;
+    HANDLE mapHandle = NULL;
+#else
+    int fd = -1;
+#endif
+};
+#endif
@@ -8,6 +8,9 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include <shader.h>
+#include "GLStateCache.h"
+#include "TexturePacker.h"
+#include "UniformCache.h"
 
 #include <string>
 #include <vector>
@@ -36,6 +39,8 @@ struct Texture {
     unsigned int id;
     string type;
     string path;
+    // set when the model packed its textures into one array (id is 0 then)
+    PackedTextureRect packed;
 };
 
 class Mesh {
@@ -45,6 +50,8 @@ public:
     vector<unsigned int> indices;
     vector<Texture>      textures;
     unsigned int VAO;
+    // positions only, tightly packed, for depth-only passes
+    unsigned int depthVAO;
 
     // constructor
     Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
@@ -55,38 +62,52 @@ public:
 
         // now that we have all the required data, set the vertex buffers and its attribute pointers.
         setupMesh();
+        setupTextureUniforms();
     }
 
-    // render the mesh
-    void Draw(Shader& shader)
+    // render the mesh with the current program, whose uniforms are `uniforms`. With a state
+    // cache, bindings shared with the previous mesh are not repeated and nothing is reset
+    // afterwards.
+    void Draw(const UniformCache& uniforms, GLStateCache* state = nullptr)
     {
+        constexpr Uniform<bool> packedDiffuse("packedDiffuse");
+        constexpr uint32_t diffuseSampler = uniformHash("texture_diffuse1");
+
         // bind appropriate textures
-        unsigned int diffuseNr = 1;
-        unsigned int specularNr = 1;
-        unsigned int normalNr = 1;
-        unsigned int heightNr = 1;
+        bool diffusePacked = false;
         for (unsigned int i = 0; i < textures.size(); i++)
         {
-            glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
-            // retrieve texture number (the N in diffuse_textureN)
-            string number;
-            string name = textures[i].type;
-            if (name == "texture_diffuse")
-                number = std::to_string(diffuseNr++);
-            else if (name == "texture_specular")
-                number = std::to_string(specularNr++); // transfer unsigned int to string
-            else if (name == "texture_normal")
-                number = std::to_string(normalNr++); // transfer unsigned int to string
-            else if (name == "texture_height")
-                number = std::to_string(heightNr++); // transfer unsigned int to string
+            // packed textures live in the model's texture array, only their rect changes per mesh
+            if (textures[i].packed.layer >= 0)
+            {
+                const PackedTextureRect& packed = textures[i].packed;
+                glUniform4fv(uniforms.location(textureRects[i]), 1, &packed.rect[0]);
+                glUniform2f(uniforms.location(textureLayers[i]), static_cast<float>(packed.layer), packed.maxLod);
+                diffusePacked = diffusePacked || textureSamplers[i] == diffuseSampler;
+                continue;
+            }
 
             // now set the sampler to the correct texture unit
-            glUniform1i(glGetUniformLocation(shader.ID, (name + number).c_str()), i);
+            glUniform1i(uniforms.location(textureSamplers[i]), i);
             // and finally bind the texture
+            if (state)
+            {
+                state->bindTexture(i, GL_TEXTURE_2D, textures[i].id);
+                continue;
+            }
+            glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
             glBindTexture(GL_TEXTURE_2D, textures[i].id);
         }
+        // set every draw so a mesh without a packed diffuse does not inherit the last one's
+        uniforms.set(packedDiffuse, diffusePacked);
 
         // draw mesh
+        if (state)
+        {
+            state->bindVertexArray(VAO);
+            glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0);
+            return;
+        }
         glBindVertexArray(VAO);
         glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0);
         glBindVertexArray(0);
@@ -95,9 +116,51 @@ public:
         glActiveTexture(GL_TEXTURE0);
     }
 
+    // render the mesh's depth only, from the position stream; no textures or uniforms
+    void DrawDepth(GLStateCache* state = nullptr)
+    {
+        if (state)
+            state->bindVertexArray(depthVAO);
+        else
+            glBindVertexArray(depthVAO);
+        glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0);
+        if (!state)
+            glBindVertexArray(0);
+    }
+
 private:
     // render data 
-    unsigned int VBO, EBO;
+    unsigned int VBO, EBO, positionVBO;
+
+    // hashed sampler name of each texture, <type>N, and its packed <type>NRect / <type>NLayer
+    vector<uint32_t> textureSamplers;
+    vector<uint32_t> textureRects;
+    vector<uint32_t> textureLayers;
+
+    // numbers the textures per type (the N in diffuse_textureN) once, so Draw builds no strings
+    void setupTextureUniforms()
+    {
+        unsigned int diffuseNr = 1;
+        unsigned int specularNr = 1;
+        unsigned int normalNr = 1;
+        unsigned int heightNr = 1;
+        for (const Texture& texture : textures)
+        {
+            string number;
+            const string& name = texture.type;
+            if (name == "texture_diffuse")
+                number = std::to_string(diffuseNr++);
+            else if (name == "texture_specular")
+                number = std::to_string(specularNr++); // transfer unsigned int to string
+            else if (name == "texture_normal")
+                number = std::to_string(normalNr++); // transfer unsigned int to string
+            else if (name == "texture_height")
+                number = std::to_string(heightNr++); // transfer unsigned int to string
+            textureSamplers.push_back(uniformHash((name + number).c_str()));
+            textureRects.push_back(uniformHash((name + number + "Rect").c_str()));
+            textureLayers.push_back(uniformHash((name + number + "Layer").c_str()));
+        }
+    }
 
     // initializes all the buffer objects/arrays
     void setupMesh()
@@ -142,6 +205,21 @@ private:
         glEnableVertexAttribArray(6);
         glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, m_Weights));
         glBindVertexArray(0);
+
+        // The depth pre-pass reads 12 bytes a vertex instead of the whole Vertex, so its
+        // vertex fetch touches a fraction of the memory. It shares the index buffer.
+        vector<glm::vec3> positions(vertices.size());
+        for (size_t i = 0; i < vertices.size(); ++i)
+            positions[i] = vertices[i].Position;
+        glGenVertexArrays(1, &depthVAO);
+        glGenBuffers(1, &positionVBO);
+        glBindVertexArray(depthVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, positionVBO);
+        glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(glm::vec3), positions.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
+        glBindVertexArray(0);
     }
 };
 #endif
\ No newline at end of file
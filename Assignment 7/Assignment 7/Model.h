@@ -34,21 +34,72 @@ public:
     vector<Mesh>    meshes;
     string directory;
     bool gammaCorrection;
+    bool packTextures;
+    TextureAtlas atlas;     // all material textures when packTextures is set
 
-    // constructor, expects a filepath to a 3D model.
-    Model(string const& path, bool gamma = false) : gammaCorrection(gamma)
+    // constructor, expects a filepath to a 3D model. With packTextures the material textures
+    // go into one texture array (see TexturePacker.h) instead of one texture each.
+    Model(string const& path, bool gamma = false, bool packTextures = false) : gammaCorrection(gamma), packTextures(packTextures)
     {
         loadModel(path);
+        if (packTextures)
+            packMaterialTextures();
     }
 
-    // draws the model, and thus all its meshes
-    void Draw(Shader& shader)
+    // draws the model, and thus all its meshes, with the current program; see Mesh::Draw
+    void Draw(const UniformCache& uniforms, GLStateCache* state = nullptr)
     {
+        // one binding for the whole model when its textures are packed; the program's
+        // texture_atlas sampler is set to TEXTURE_ATLAS_UNIT when it is linked
+        if (atlas.id != 0)
+        {
+            if (state)
+                state->bindTexture(TEXTURE_ATLAS_UNIT, GL_TEXTURE_2D_ARRAY, atlas.id);
+            else
+            {
+                glActiveTexture(GL_TEXTURE0 + TEXTURE_ATLAS_UNIT);
+                glBindTexture(GL_TEXTURE_2D_ARRAY, atlas.id);
+                glActiveTexture(GL_TEXTURE0);
+            }
+        }
         for (unsigned int i = 0; i < meshes.size(); i++)
-            meshes[i].Draw(shader);
+            meshes[i].Draw(uniforms, state);
+    }
+
+    // depth only, for a pre-pass; the bound program only needs the positions
+    void DrawDepth(GLStateCache* state = nullptr)
+    {
+        for (unsigned int i = 0; i < meshes.size(); i++)
+            meshes[i].DrawDepth(state);
     }
 
 private:
+    // replaces the per-texture GL objects with one texture array and points every mesh at its rects
+    void packMaterialTextures()
+    {
+        vector<string> paths;
+        for (const Texture& texture : textures_loaded)
+            paths.push_back(texture.path);
+        if (paths.empty())
+            return;
+
+        vector<PackedTextureRect> placements;
+        atlas = buildTextureAtlas(paths, directory, placements);
+        for (unsigned int i = 0; i < textures_loaded.size(); i++)
+            textures_loaded[i].packed = placements[i];
+        for (Mesh& mesh : meshes)
+        {
+            for (Texture& texture : mesh.textures)
+            {
+                for (const Texture& loaded : textures_loaded)
+                {
+                    if (loaded.path == texture.path)
+                        texture.packed = loaded.packed;
+                }
+            }
+        }
+    }
+
     // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
     void loadModel(string const& path)
     {
@@ -194,7 +245,8 @@ private:
             if (!skip)
             {   // if texture hasn't been loaded already, load it
                 Texture texture;
-                texture.id = TextureFromFile(str.C_Str(), this->directory);
+                // packed textures are decoded together once the whole model is loaded
+                texture.id = packTextures ? 0 : TextureFromFile(str.C_Str(), this->directory);
                 texture.type = typeName;
                 texture.path = str.C_Str();
                 textures.push_back(texture);
@@ -0,0 +1,544 @@
+#pragma once
+#ifndef OCTAHEDRAL_H
+#define OCTAHEDRAL_H
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "HDRFormats.h"
+#include "IBLBaker.h"
+#include "ProgramCache.h"
+#include "UniformCache.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Octahedral 2D alternative to the IBL cubemaps. The sphere is folded onto an octahedron
+// (+Y hemisphere in the center diamond, -Y in the four corners) and unrolled into one
+// square, so every mip is a single 2D image: one framebuffer attachment per mip instead of
+// six, and no texels spent on the cube corners' oversampling.
+//
+// Every mip level carries its own OCTAHEDRAL_BORDER texel frame filled with the texels
+// across the fold (an edge maps back onto itself mirrored), so bilinear filtering is
+// seamless on every level. Levels are baked one by one instead of glGenerateMipmap, and
+// lookups compute the uv per level and blend two textureLod taps for trilinear.
+//
+// The same encode/decode is in the shaders: OCTAHEDRAL_GLSL below, which assignment7.cpp
+// registers as ProgramCache include "octahedral.glsl" for its fragment shaders, the bake
+// and lookup timing programs here included.
+
+const int OCTAHEDRAL_BORDER = 1;
+
+// float RGB octahedral map, level-major, every level size >> mip texels wide border included
+struct FloatOctahedralMap {
+    int size = 0;
+    int mipLevels = 0;
+    std::vector<float> data;
+
+    int mipSize(int mip) const { return std::max(size >> mip, 2 * OCTAHEDRAL_BORDER + 1); }
+    size_t levelFloats(int mip) const { return static_cast<size_t>(mipSize(mip)) * mipSize(mip) * 3; }
+    size_t levelOffset(int mip) const
+    {
+        size_t offset = 0;
+        for (int m = 0; m < mip; ++m)
+            offset += levelFloats(m);
+        return offset;
+    }
+    const float* level(int mip) const { return &data[levelOffset(mip)]; }
+    float* level(int mip) { return &data[levelOffset(mip)]; }
+};
+
+inline float octahedralSign(float v)
+{
+    return v >= 0.0f ? 1.0f : -1.0f;
+}
+
+// unit direction -> [0, 1]^2
+// ------------------------------------------------------------------------
+inline glm::vec2 octahedralEncode(const glm::vec3& dir)
+{
+    glm::vec3 d = dir / (std::fabs(dir.x) + std::fabs(dir.y) + std::fabs(dir.z));
+    glm::vec2 p(d.x, d.z);
+    if (d.y < 0.0f)
+        p = glm::vec2((1.0f - std::fabs(d.z)) * octahedralSign(d.x), (1.0f - std::fabs(d.x)) * octahedralSign(d.z));
+    return p * 0.5f + 0.5f;
+}
+
+// [0, 1]^2 -> unit direction
+// ------------------------------------------------------------------------
+inline glm::vec3 octahedralDecode(const glm::vec2& uv)
+{
+    glm::vec2 p = uv * 2.0f - 1.0f;
+    glm::vec3 d(p.x, 1.0f - std::fabs(p.x) - std::fabs(p.y), p.y);
+    if (d.y < 0.0f)
+    {
+        float x = d.x;
+        d.x = (1.0f - std::fabs(d.z)) * octahedralSign(x);
+        d.z = (1.0f - std::fabs(x)) * octahedralSign(d.z);
+    }
+    return glm::normalize(d);
+}
+
+// uv of dir inside one level, skipping that level's border
+inline glm::vec2 octahedralLevelUV(const glm::vec3& dir, int size)
+{
+    float n = static_cast<float>(size - 2 * OCTAHEDRAL_BORDER);
+    return (octahedralEncode(dir) * n + static_cast<float>(OCTAHEDRAL_BORDER)) / static_cast<float>(size);
+}
+
+// trilinear lookup, same math as sampleOctahedral in OCTAHEDRAL_GLSL
+// ------------------------------------------------------------------------
+inline glm::vec3 sampleOctahedralLod(const FloatOctahedralMap& map, const glm::vec3& dir, float lod)
+{
+    lod = std::min(std::max(lod, 0.0f), static_cast<float>(map.mipLevels - 1));
+    int mip0 = static_cast<int>(lod);
+    int mip1 = std::min(mip0 + 1, map.mipLevels - 1);
+    glm::vec2 uv0 = octahedralLevelUV(dir, map.mipSize(mip0));
+    glm::vec3 c0 = sampleBilinear(map.level(mip0), map.mipSize(mip0), map.mipSize(mip0), uv0.x, uv0.y);
+    if (mip1 == mip0)
+        return c0;
+    glm::vec2 uv1 = octahedralLevelUV(dir, map.mipSize(mip1));
+    glm::vec3 c1 = sampleBilinear(map.level(mip1), map.mipSize(mip1), map.mipSize(mip1), uv1.x, uv1.y);
+    return glm::mix(c0, c1, lod - mip0);
+}
+
+// Octahedral size holding about as many texels as a cubemap face size: 6 faces of n^2
+// against one (2n)^2 square is 2/3 of the memory at close to the cube's worst-case density.
+inline int octahedralSizeForCubemap(int cubemapSize)
+{
+    return 2 * cubemapSize;
+}
+
+// ------------------------------------------------------------------------
+// GLSL
+
+// Encode/decode and the per-level lookup, for splicing after a shader's #version line or
+// pulling in with ProgramCache::addInclude.
+// maxLevel is the deepest baked level (mipLevels - 1).
+const char* const OCTAHEDRAL_GLSL = R"(
+const float OCTAHEDRAL_BORDER = 1.0;
+
+vec2 octahedralEncode(vec3 dir)
+{
+    vec3 d = dir / (abs(dir.x) + abs(dir.y) + abs(dir.z));
+    vec2 p = d.xz;
+    if (d.y < 0.0)
+        p = (1.0 - abs(d.zx)) * vec2(d.x >= 0.0 ? 1.0 : -1.0, d.z >= 0.0 ? 1.0 : -1.0);
+    return p * 0.5 + 0.5;
+}
+
+vec3 octahedralDecode(vec2 uv)
+{
+    vec2 p = uv * 2.0 - 1.0;
+    vec3 d = vec3(p.x, 1.0 - abs(p.x) - abs(p.y), p.y);
+    if (d.y < 0.0)
+        d.xz = (1.0 - abs(d.zx)) * vec2(d.x >= 0.0 ? 1.0 : -1.0, d.z >= 0.0 ? 1.0 : -1.0);
+    return normalize(d);
+}
+
+vec3 sampleOctahedral(sampler2D map, vec3 dir, float lod, float maxLevel)
+{
+    lod = clamp(lod, 0.0, maxLevel);
+    float level0 = floor(lod);
+    float level1 = min(level0 + 1.0, maxLevel);
+    vec2 encoded = octahedralEncode(dir);
+    float size0 = float(textureSize(map, int(level0)).x);
+    float size1 = float(textureSize(map, int(level1)).x);
+    vec3 c0 = textureLod(map, (encoded * (size0 - 2.0 * OCTAHEDRAL_BORDER) + OCTAHEDRAL_BORDER) / size0, level0).rgb;
+    vec3 c1 = textureLod(map, (encoded * (size1 - 2.0 * OCTAHEDRAL_BORDER) + OCTAHEDRAL_BORDER) / size1, level1).rgb;
+    return mix(c0, c1, lod - level0);
+}
+)";
+
+// one triangle over the whole target, no vertex buffer
+const char* const OCTAHEDRAL_FULLSCREEN_VS = R"(#version 330 core
+void main()
+{
+    vec2 p = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    gl_Position = vec4(p * 2.0 - 1.0, 0.0, 1.0);
+}
+)";
+
+// Bake: one draw per level. Border texels are folded back into the interior (across an
+// edge the map continues mirrored along that edge) and every texel is fetched from the
+// source cubemap at the same level.
+const char* const OCTAHEDRAL_BAKE_FS = R"(#version 330 core
+#include "octahedral.glsl"
+
+out vec4 FragColor;
+
+uniform samplerCube source;
+uniform float sourceLod;
+uniform int levelSize;
+
+void main()
+{
+    int border = int(OCTAHEDRAL_BORDER);
+    int n = levelSize - 2 * border;
+    ivec2 t = ivec2(gl_FragCoord.xy) - border;
+    if (t.x < 0 || t.x >= n)
+    {
+        t.x = t.x < 0 ? -t.x - 1 : 2 * n - 1 - t.x;
+        t.y = n - 1 - t.y;
+    }
+    if (t.y < 0 || t.y >= n)
+    {
+        t.y = t.y < 0 ? -t.y - 1 : 2 * n - 1 - t.y;
+        t.x = n - 1 - t.x;
+    }
+    vec3 dir = octahedralDecode((vec2(t) + 0.5) / float(n));
+    FragColor = vec4(textureLod(source, dir, sourceLod).rgb, 1.0);
+}
+)";
+
+// for ShaderLibrary::add, with the "octahedral.glsl" include registered
+inline std::vector<ProgramStage> octahedralBakeStages()
+{
+    return { { GL_VERTEX_SHADER, OCTAHEDRAL_FULLSCREEN_VS }, { GL_FRAGMENT_SHADER, OCTAHEDRAL_BAKE_FS } };
+}
+
+inline void configureOctahedralBakeProgram(GLuint program)
+{
+    glUseProgram(program);
+    glUniform1i(glGetUniformLocation(program, "source"), 0);
+}
+
+// ------------------------------------------------------------------------
+// GL bake and upload
+
+inline unsigned int createOctahedralTexture(int size, int mipLevels, HDRStorage storage, const FloatOctahedralMap* source = nullptr)
+{
+    HDRGLFormat format = hdrGLFormat(storage);
+    unsigned int texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (int mip = 0; mip < mipLevels; ++mip)
+    {
+        int levelSize = std::max(size >> mip, 2 * OCTAHEDRAL_BORDER + 1);
+        std::vector<unsigned char> packed;
+        if (source)
+            packed = packHDR(source->level(mip), static_cast<size_t>(levelSize) * levelSize, storage);
+        glTexImage2D(GL_TEXTURE_2D, mip, format.internalFormat, levelSize, levelSize, 0, format.format, format.type,
+                     source ? packed.data() : nullptr);
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, mipLevels - 1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    return texture;
+}
+
+// bytes of the texture createOctahedralTexture allocates
+inline size_t octahedralTextureBytes(int size, int mipLevels, HDRStorage storage)
+{
+    size_t bytes = 0;
+    for (int mip = 0; mip < mipLevels; ++mip)
+    {
+        size_t levelSize = std::max(size >> mip, 2 * OCTAHEDRAL_BORDER + 1);
+        bytes += levelSize * levelSize * hdrGLFormat(storage).bytesPerTexel;
+    }
+    return bytes;
+}
+
+class OctahedralBaker
+{
+public:
+    ~OctahedralBaker() { destroy(); }
+
+    // deletes the framebuffer and vertex array; call while the context is still current
+    void destroy()
+    {
+        if (fbo)
+        {
+            glDeleteFramebuffers(1, &fbo);
+            glDeleteVertexArrays(1, &vao);
+        }
+        fbo = vao = 0;
+        uniformsProgram = 0;
+    }
+
+    // Resamples a GL cubemap into a new octahedral texture, one draw per level, with the
+    // program of octahedralBakeStages().
+    // ------------------------------------------------------------------------
+    unsigned int bake(GLuint program, unsigned int cubemap, int cubemapSize, int cubemapMips, HDRStorage storage, int* mipLevelsOut = nullptr)
+    {
+        if (!fbo)
+        {
+            glGenVertexArrays(1, &vao);
+            glGenFramebuffers(1, &fbo);
+        }
+        if (program != uniformsProgram)
+        {
+            uniforms.reflect(program);
+            uniformsProgram = program;
+        }
+        constexpr Uniform<float> sourceLodUniform("sourceLod");
+        constexpr Uniform<int> levelSizeUniform("levelSize");
+
+        const int size = octahedralSizeForCubemap(cubemapSize);
+        int mipLevels = 0;
+        while (mipLevels < cubemapMips && (size >> mipLevels) >= 2 + 2 * OCTAHEDRAL_BORDER)
+            ++mipLevels;
+        unsigned int texture = createOctahedralTexture(size, mipLevels, storage);
+
+        GLint previousViewport[4];
+        glGetIntegerv(GL_VIEWPORT, previousViewport);
+        auto start = std::chrono::steady_clock::now();
+        glUseProgram(program);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, cubemap);
+        glBindVertexArray(vao);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glDisable(GL_DEPTH_TEST);
+        for (int mip = 0; mip < mipLevels; ++mip)
+        {
+            int levelSize = std::max(size >> mip, 2 * OCTAHEDRAL_BORDER + 1);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, mip);
+            glViewport(0, 0, levelSize, levelSize);
+            uniforms.set(sourceLodUniform, static_cast<float>(mip));
+            uniforms.set(levelSizeUniform, levelSize);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+        }
+        glEnable(GL_DEPTH_TEST);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glBindVertexArray(0);
+        glFinish();
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        glViewport(previousViewport[0], previousViewport[1], previousViewport[2], previousViewport[3]);
+
+        // the source cubemap is not freed: the crossfade and the cubemap path still sample it
+        std::cout << "Octahedral bake: " << size << "x" << size << ", " << mipLevels << " levels, " << mipLevels
+                  << " draws (cubemap: " << 6 * mipLevels << " attachments), " << ms << " ms, "
+                  << octahedralTextureBytes(size, mipLevels, storage) / (1024.0 * 1024.0) << " MB on top of the "
+                  << hdrCubemapBytes(storage, cubemapSize, cubemapMips) / (1024.0 * 1024.0) << " MB cubemap" << std::endl;
+        if (mipLevelsOut)
+            *mipLevelsOut = mipLevels;
+        return texture;
+    }
+
+private:
+    unsigned int vao = 0;
+    unsigned int fbo = 0;
+    UniformCache uniforms;
+    GLuint uniformsProgram = 0;
+};
+
+// ------------------------------------------------------------------------
+// Comparison against the cubemap path
+
+// Reads every level of a GL cubemap back as float RGB, for the report below; the texel
+// order is the one uploadPackedCubemap writes.
+// ------------------------------------------------------------------------
+inline FloatCubemap readCubemapTexture(unsigned int cubemap, int size, int mipLevels)
+{
+    FloatCubemap cube;
+    cube.size = size;
+    cube.mipLevels = mipLevels;
+    cube.data.resize(cube.faceOffset(mipLevels, 0));
+    glBindTexture(GL_TEXTURE_CUBE_MAP, cubemap);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    for (int mip = 0; mip < mipLevels; ++mip)
+    {
+        for (int face = 0; face < 6; ++face)
+            glGetTexImage(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, mip, GL_RGB, GL_FLOAT, cube.face(mip, face));
+    }
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    return cube;
+}
+
+// same for a texture from createOctahedralTexture or OctahedralBaker
+// ------------------------------------------------------------------------
+inline FloatOctahedralMap readOctahedralTexture(unsigned int texture, int size, int mipLevels)
+{
+    FloatOctahedralMap map;
+    map.size = size;
+    map.mipLevels = mipLevels;
+    map.data.resize(map.levelOffset(mipLevels));
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    for (int mip = 0; mip < mipLevels; ++mip)
+        glGetTexImage(GL_TEXTURE_2D, mip, GL_RGB, GL_FLOAT, map.level(mip));
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    return map;
+}
+
+// Memory of both layouts, how evenly each spreads its texels over the sphere (solid angle
+// of the largest over the smallest texel, lower is better) and the error of looking up
+// the octahedral map instead of the cubemap over a Fibonacci sphere of directions.
+// ------------------------------------------------------------------------
+inline void printOctahedralReport(const char* label, const FloatCubemap& cube, const FloatOctahedralMap& map, HDRStorage storage)
+{
+    const int bytesPerTexel = hdrGLFormat(storage).bytesPerTexel;
+    size_t octahedralBytes = map.data.size() / 3 * bytesPerTexel;
+    size_t cubemapBytes = hdrCubemapBytes(storage, cube.size, map.mipLevels);
+
+    // texel solid angle from the mapping's Jacobian, taken off-center so no differential
+    // straddles one of the octahedron's folds
+    auto cubeTexelArea = [&](float s, float t) { return std::pow(1.0f + s * s + t * t, -1.5f); };
+    float cubeSpread = cubeTexelArea(0.0f, 0.0f) / cubeTexelArea(1.0f, 1.0f);
+    float octMin = 1e30f, octMax = 0.0f;
+    const float eps = 1e-4f;
+    for (int y = 0; y < 64; ++y)
+    {
+        for (int x = 0; x < 64; ++x)
+        {
+            glm::vec2 uv((x + 0.37f) / 64.0f, (y + 0.71f) / 64.0f);
+            glm::vec3 d = octahedralDecode(uv);
+            glm::vec3 du = octahedralDecode(uv + glm::vec2(eps, 0.0f)) - d;
+            glm::vec3 dv = octahedralDecode(uv + glm::vec2(0.0f, eps)) - d;
+            float area = glm::length(glm::cross(du, dv));
+            octMin = std::min(octMin, area);
+            octMax = std::max(octMax, area);
+        }
+    }
+
+    const int samples = 65536;
+    double sumRel = 0.0, maxRel = 0.0;
+    int counted = 0;
+    for (int mip = 0; mip < map.mipLevels; ++mip)
+    {
+        for (int i = 0; i < samples; ++i)
+        {
+            float y = 1.0f - 2.0f * (i + 0.5f) / samples;
+            float r = std::sqrt(std::max(0.0f, 1.0f - y * y));
+            float phi = 2.39996323f * i;
+            glm::vec3 dir(r * std::cos(phi), y, r * std::sin(phi));
+            glm::vec3 a = sampleCubemapLod(cube, dir, static_cast<float>(mip));
+            glm::vec3 b = sampleOctahedralLod(map, dir, static_cast<float>(mip));
+            float peak = std::max(a.x, std::max(a.y, a.z));
+            if (peak <= 1e-6f)
+                continue;
+            glm::vec3 e = glm::abs(a - b);
+            double rel = std::max(e.x, std::max(e.y, e.z)) / peak;
+            sumRel += rel;
+            maxRel = std::max(maxRel, rel);
+            ++counted;
+        }
+    }
+
+    std::cout << label << " octahedral " << map.size << "^2 vs cubemap 6x" << cube.size << "^2 (" << map.mipLevels << " levels, "
+              << hdrStorageName(storage) << "): " << octahedralBytes / (1024.0 * 1024.0) << " MB vs "
+              << cubemapBytes / (1024.0 * 1024.0) << " MB, texel area spread " << octMax / octMin << " vs " << cubeSpread
+              << ", mean rel diff " << (counted ? sumRel / counted : 0.0) << ", max " << maxRel << std::endl;
+}
+
+// Lookup cost: every fragment of a fullscreen pass takes `lookups` trilinear samples, from
+// the cubemap (one textureLod) or from the octahedral map (sampleOctahedral, two). The
+// directions are the same on both paths and move smoothly across the screen, like
+// reflection vectors do.
+const char* const OCTAHEDRAL_LOOKUP_FS = R"(#version 330 core
+#include "octahedral.glsl"
+
+out vec4 FragColor;
+
+uniform samplerCube cubemap;
+uniform sampler2D octahedral;
+uniform bool useOctahedral;
+uniform float lod;
+uniform float maxLevel;
+uniform int lookups;
+uniform float targetSize;
+
+void main()
+{
+    vec2 uv = gl_FragCoord.xy / targetSize;
+    vec3 sum = vec3(0.0);
+    for (int i = 0; i < lookups; ++i)
+    {
+        vec3 dir = octahedralDecode(fract(uv + float(i) * vec2(0.7548777, 0.5698403)));
+        sum += useOctahedral ? sampleOctahedral(octahedral, dir, lod, maxLevel) : textureLod(cubemap, dir, lod).rgb;
+    }
+    FragColor = vec4(sum / float(lookups), 1.0);
+}
+)";
+
+inline std::vector<ProgramStage> octahedralLookupStages()
+{
+    return { { GL_VERTEX_SHADER, OCTAHEDRAL_FULLSCREEN_VS }, { GL_FRAGMENT_SHADER, OCTAHEDRAL_LOOKUP_FS } };
+}
+
+inline void configureOctahedralLookupProgram(GLuint program)
+{
+    glUseProgram(program);
+    glUniform1i(glGetUniformLocation(program, "cubemap"), 0);
+    glUniform1i(glGetUniformLocation(program, "octahedral"), 1);
+}
+
+// GPU time of both lookup paths over a target as large as the octahedral map's level 0,
+// measured with GL_TIME_ELAPSED; the best of several runs each. Leaves units 0 and 1, the
+// framebuffer and the vertex array unbound and restores the viewport.
+// ------------------------------------------------------------------------
+inline void printOctahedralLookupTimes(GLuint program, const char* label, unsigned int cubemap, unsigned int octahedral,
+                                       int octahedralSize, int octahedralLevels, float lod)
+{
+    const int lookups = 16, runs = 5;
+    const int size = std::min(octahedralSize, 1024);
+    GLuint target, fbo, vao, query;
+    glGenTextures(1, &target);
+    glBindTexture(GL_TEXTURE_2D, target);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, size, size, 0, GL_RGBA, GL_FLOAT, nullptr);
+    glGenFramebuffers(1, &fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, target, 0);
+    glGenVertexArrays(1, &vao);
+    glBindVertexArray(vao);
+    glGenQueries(1, &query);
+
+    GLint previousViewport[4];
+    glGetIntegerv(GL_VIEWPORT, previousViewport);
+    glViewport(0, 0, size, size);
+    glDisable(GL_DEPTH_TEST);
+    glUseProgram(program);
+    UniformCache uniforms(program);
+    constexpr Uniform<bool> useOctahedralUniform("useOctahedral");
+    constexpr Uniform<float> lodUniform("lod"), maxLevelUniform("maxLevel"), targetSizeUniform("targetSize");
+    constexpr Uniform<int> lookupsUniform("lookups");
+    uniforms.set(lodUniform, lod);
+    uniforms.set(maxLevelUniform, static_cast<float>(octahedralLevels - 1));
+    uniforms.set(lookupsUniform, lookups);
+    uniforms.set(targetSizeUniform, static_cast<float>(size));
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, cubemap);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, octahedral);
+
+    double best[2] = { 1e30, 1e30 };
+    for (int run = 0; run < runs; ++run)
+    {
+        for (int path = 0; path < 2; ++path)
+        {
+            uniforms.set(useOctahedralUniform, path == 1);
+            glBeginQuery(GL_TIME_ELAPSED, query);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+            glEndQuery(GL_TIME_ELAPSED);
+            GLuint64 nanoseconds = 0;
+            glGetQueryObjectui64v(query, GL_QUERY_RESULT, &nanoseconds);
+            best[path] = std::min(best[path], nanoseconds / 1.0e6);
+        }
+    }
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+    glEnable(GL_DEPTH_TEST);
+    glViewport(previousViewport[0], previousViewport[1], previousViewport[2], previousViewport[3]);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glBindVertexArray(0);
+    glDeleteQueries(1, &query);
+    glDeleteVertexArrays(1, &vao);
+    glDeleteFramebuffers(1, &fbo);
+    glDeleteTextures(1, &target);
+
+    const double lookupsPerPass = static_cast<double>(size) * size * lookups;
+    std::cout << label << " lookups at lod " << lod << ", " << size << "x" << size << " x " << lookups << " per pass: cubemap "
+              << best[0] << " ms, octahedral " << best[1] << " ms (" << best[0] * 1.0e6 / lookupsPerPass << " vs "
+              << best[1] * 1.0e6 / lookupsPerPass << " ns per lookup, " << best[1] / best[0] << "x)" << std::endl;
+}
+#endif
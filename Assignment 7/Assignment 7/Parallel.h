@@ -0,0 +1,67 @@
+#pragma once
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+// Splits a range of rows (scanlines, texels, faces...) into contiguous bands and runs
+// one band per hardware thread. The calling thread always takes the first band, so a
+// single band never pays for a thread spawn.
+
+// number of worker threads available to the parallel helpers
+// ------------------------------------------------------------------------
+inline int parallelWorkerCount()
+{
+    unsigned int n = std::thread::hardware_concurrency();
+    return n == 0 ? 1 : static_cast<int>(n);
+}
+
+// how many bands `items` rows should be split into so each band has at least minItemsPerBand rows
+// ------------------------------------------------------------------------
+inline int parallelBandCount(int items, int minItemsPerBand = 1)
+{
+    if (items <= 0)
+        return 0;
+    int bands = items / std::max(minItemsPerBand, 1);
+    return std::max(1, std::min(bands, parallelWorkerCount()));
+}
+
+// first row of band `band` out of `bands` (band == bands gives the end of the range)
+// ------------------------------------------------------------------------
+inline int parallelBandBegin(int band, int bands, int items)
+{
+    return static_cast<int>(static_cast<long long>(items) * band / bands);
+}
+
+// runs fn(band) for every band in [0, bands), one thread per band
+// ------------------------------------------------------------------------
+template <typename Fn>
+void parallelForBands(int bands, Fn fn)
+{
+    if (bands <= 0)
+        return;
+
+    std::vector<std::thread> workers;
+    workers.reserve(bands - 1);
+    for (int band = 1; band < bands; ++band)
+        workers.emplace_back([&fn, band]() { fn(band); });
+
+    fn(0);
+
+    for (std::thread& worker : workers)
+        worker.join();
+}
+
+// runs fn(begin, end) over contiguous row bands covering [0, items)
+// ------------------------------------------------------------------------
+template <typename Fn>
+void parallelForRows(int items, int minItemsPerBand, Fn fn)
+{
+    int bands = parallelBandCount(items, minItemsPerBand);
+    parallelForBands(bands, [&](int band) {
+        fn(parallelBandBegin(band, bands, items), parallelBandBegin(band + 1, bands, items));
+    });
+}
+#endif
@@ -0,0 +1,94 @@
+#pragma once
+#ifndef PASS_QUERIES_H
+#define PASS_QUERIES_H
+
+#include <GL/glew.h>
+
+#include <vector>
+
+// A GPU query (GL_SAMPLES_PASSED, GL_TIME_ELAPSED, ...) around one pass per frame, averaged
+// separately for each mode the pass can run in. Queries go round a small ring and are read
+// back once the GPU has answered them, so measuring never stalls the frame; only a GPU
+// more than QUERIES frames behind makes begin() wait.
+class PassQueries
+{
+public:
+    PassQueries(GLenum target, int modes) : target(target), totals(modes), counts(modes) {}
+
+    ~PassQueries() { destroy(); }
+
+    void create()
+    {
+        destroy();
+        glGenQueries(QUERIES, queries);
+    }
+
+    // deletes the queries; call while the context is still current
+    void destroy()
+    {
+        if (queries[0])
+            glDeleteQueries(QUERIES, queries);
+        for (int i = 0; i < QUERIES; ++i)
+        {
+            queries[i] = 0;
+            modes[i] = -1;
+        }
+    }
+
+    // ------------------------------------------------------------------------
+    void begin(int mode)
+    {
+        collect();
+        if (modes[current] >= 0)
+            read(current, true);
+        modes[current] = mode;
+        glBeginQuery(target, queries[current]);
+    }
+
+    void end()
+    {
+        glEndQuery(target);
+        current = (current + 1) % QUERIES;
+    }
+
+    // mean query result per frame in `mode`; 0 before any result came back
+    double average(int mode) const { return counts[mode] ? static_cast<double>(totals[mode]) / counts[mode] : 0.0; }
+    long long frames(int mode) const { return counts[mode]; }
+
+private:
+    enum { QUERIES = 4 };
+
+    GLenum target;
+    GLuint queries[QUERIES] = {};
+    int modes[QUERIES] = { -1, -1, -1, -1 };
+    int current = 0;
+    std::vector<GLuint64> totals;
+    std::vector<long long> counts;
+
+    // folds in every answered query other than the one being written
+    void collect()
+    {
+        for (int i = 0; i < QUERIES; ++i)
+        {
+            if (i != current && modes[i] >= 0)
+                read(i, false);
+        }
+    }
+
+    void read(int index, bool wait)
+    {
+        if (!wait)
+        {
+            GLint available = GL_FALSE;
+            glGetQueryObjectiv(queries[index], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+                return;
+        }
+        GLuint64 result = 0;
+        glGetQueryObjectui64v(queries[index], GL_QUERY_RESULT, &result);
+        totals[modes[index]] += result;
+        ++counts[modes[index]];
+        modes[index] = -1;
+    }
+};
+#endif
@@ -0,0 +1,347 @@
+#pragma once
+#ifndef RADIANCE_HDR_H
+#define RADIANCE_HDR_H
+
+#include "HDRFormats.h"
+#include "MappedFile.h"
+#include "Parallel.h"
+
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Reader for Radiance RGBE (.hdr) images that replaces stbi_loadf for environment maps.
+// The file is memory-mapped, a sequential prepass walks the run-length codes to find
+// where every scanline starts, and then row bands are decoded on all cores. Each band
+// expands its RGBE scanlines straight into the requested storage:
+//   RGB32F / RGB16F / R11G11B10F  float expansion with an SSE2 ldexp (exponent bits
+//                                 built directly), then the HDRFormats.h packers
+//   RGB9E5                        integer re-bias of the RGBE exponent; RGBE already is a
+//                                 shared-exponent format, so no float round trip is needed
+// Rows are stored bottom-up to match glTexImage2D (and stbi_loadf with vertical flip on).
+
+struct RadianceHDRImage {
+    int width = 0;
+    int height = 0;
+    HDRStorage storage = HDRStorage::RGB32F;
+    std::vector<unsigned char> pixels;  // hdrGLFormat(storage).bytesPerTexel per texel
+
+    const float* floats() const { return reinterpret_cast<const float*>(pixels.data()); }
+};
+
+struct RadianceHeader {
+    int width = 0;
+    int height = 0;
+    bool bottomUp = false;   // "+Y" resolution string: first scanline is the bottom row
+    size_t dataOffset = 0;
+};
+
+inline bool readRadianceHeader(const unsigned char* bytes, size_t size, RadianceHeader& header)
+{
+    size_t offset = 0;
+    auto readLine = [&](std::string& line) -> bool {
+        line.clear();
+        while (offset < size && bytes[offset] != '\n')
+            line.push_back(static_cast<char>(bytes[offset++]));
+        if (offset >= size)
+            return false;
+        ++offset;
+        return true;
+    };
+
+    std::string line;
+    if (!readLine(line) || (line.compare(0, 10, "#?RADIANCE") != 0 && line.compare(0, 6, "#?RGBE") != 0))
+        return false;
+
+    bool rgbe = true;
+    while (readLine(line) && !line.empty())
+    {
+        if (line.compare(0, 7, "FORMAT=") == 0)
+            rgbe = line == "FORMAT=32-bit_rle_rgbe";
+    }
+    if (!rgbe || !readLine(line))
+        return false;
+
+    // only the two row orders used in practice: "-Y h +X w" and "+Y h +X w"
+    char ySign, xSign;
+    int height, width;
+    char yAxis[2], xAxis[2];
+    if (std::sscanf(line.c_str(), "%c%1s %d %c%1s %d", &ySign, yAxis, &height, &xSign, xAxis, &width) != 6)
+        return false;
+    if (yAxis[0] != 'Y' || xAxis[0] != 'X' || xSign != '+' || width <= 0 || height <= 0)
+        return false;
+
+    header.width = width;
+    header.height = height;
+    header.bottomUp = ySign == '+';
+    header.dataOffset = offset;
+    return true;
+}
+
+// true when the scanline at p uses the adaptive ("new") run-length encoding
+inline bool radianceNewRLE(const unsigned char* p, size_t available, int width)
+{
+    return width >= 8 && width < 32768 && available >= 4 && p[0] == 2 && p[1] == 2 && ((p[2] << 8) | p[3]) == width && !(p[2] & 0x80);
+}
+
+// Byte length of the scanline starting at p, or 0 if it runs past the end of the file.
+// Only run-length codes are touched; literal and run payloads are skipped over.
+inline size_t radianceScanlineLength(const unsigned char* p, size_t available, int width)
+{
+    if (radianceNewRLE(p, available, width))
+    {
+        size_t offset = 4;
+        for (int channel = 0; channel < 4; ++channel)
+        {
+            int x = 0;
+            while (x < width)
+            {
+                if (offset >= available)
+                    return 0;
+                int code = p[offset++];
+                int count = code > 128 ? code - 128 : code;
+                if (count == 0 || x + count > width)
+                    return 0;
+                offset += code > 128 ? 1 : count;
+                x += count;
+            }
+        }
+        return offset <= available ? offset : 0;
+    }
+
+    // flat pixels, possibly with old-style (1, 1, 1, n) repeat records
+    size_t offset = 0;
+    int x = 0;
+    int shift = 0;
+    while (x < width)
+    {
+        if (offset + 4 > available)
+            return 0;
+        const unsigned char* q = p + offset;
+        offset += 4;
+        if (q[0] == 1 && q[1] == 1 && q[2] == 1)
+        {
+            if (x == 0 || shift > 16)
+                return 0;
+            x += q[3] << shift;
+            shift += 8;
+        }
+        else
+        {
+            ++x;
+            shift = 0;
+        }
+    }
+    return x == width ? offset : 0;
+}
+
+// decodes one scanline into width RGBE quadruples
+inline bool decodeRadianceScanline(const unsigned char* p, size_t length, int width, unsigned char* rgbe)
+{
+    if (radianceNewRLE(p, length, width))
+    {
+        // channels are stored planar, one run-length stream per component
+        size_t offset = 4;
+        for (int channel = 0; channel < 4; ++channel)
+        {
+            int x = 0;
+            while (x < width)
+            {
+                int code = p[offset++];
+                if (code > 128)
+                {
+                    unsigned char value = p[offset++];
+                    for (int end = x + code - 128; x < end; ++x)
+                        rgbe[4 * x + channel] = value;
+                }
+                else
+                {
+                    for (int end = x + code; x < end; ++x)
+                        rgbe[4 * x + channel] = p[offset++];
+                }
+            }
+        }
+        return true;
+    }
+
+    size_t offset = 0;
+    int x = 0;
+    int shift = 0;
+    while (x < width && offset + 4 <= length)
+    {
+        const unsigned char* q = p + offset;
+        offset += 4;
+        if (q[0] == 1 && q[1] == 1 && q[2] == 1)
+        {
+            int count = q[3] << shift;
+            for (int i = 0; i < count && x < width; ++i, ++x)
+                std::memcpy(rgbe + 4 * x, rgbe + 4 * (x - 1), 4);
+            shift += 8;
+        }
+        else
+        {
+            std::memcpy(rgbe + 4 * x, q, 4);
+            ++x;
+            shift = 0;
+        }
+    }
+    return x == width;
+}
+
+// RGBE -> float RGB with the same convention as stb_image: m * 2^(e - 136). Exponents
+// below 10 give a scale under the smallest normal float and decode as black, like e == 0,
+// in both the SSE and the scalar path
+inline void expandRGBEToFloat(const unsigned char* rgbe, float* rgb, int count)
+{
+    int i = 0;
+#ifdef HDR_FORMATS_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i bias = _mm_set1_epi32(136 - 127);
+    // 4 texels per 16 byte load; each texel is expanded in its own register as
+    // (r, g, b, e) * 2^(e - 136) and stored 4-wide. The 4th lane lands on the next
+    // texel's red, which the next store overwrites, so the last texel is done in scalar.
+    for (; i + 5 <= count; i += 4)
+    {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rgbe + 4 * i));
+        __m128i lo = _mm_unpacklo_epi8(bytes, zero);
+        __m128i hi = _mm_unpackhi_epi8(bytes, zero);
+        __m128i texels[4] = { _mm_unpacklo_epi16(lo, zero), _mm_unpackhi_epi16(lo, zero),
+                              _mm_unpacklo_epi16(hi, zero), _mm_unpackhi_epi16(hi, zero) };
+        for (int k = 0; k < 4; ++k)
+        {
+            __m128i e = _mm_shuffle_epi32(texels[k], _MM_SHUFFLE(3, 3, 3, 3));
+            // 2^(e - 136) straight from the exponent bits; e <= 9 would wrap the
+            // exponent field, so only lanes with e - bias > 0 keep their scale
+            __m128i scaleBits = _mm_slli_epi32(_mm_sub_epi32(e, bias), 23);
+            scaleBits = _mm_and_si128(_mm_cmpgt_epi32(e, bias), scaleBits);
+            __m128 value = _mm_mul_ps(_mm_cvtepi32_ps(texels[k]), _mm_castsi128_ps(scaleBits));
+            _mm_storeu_ps(rgb + 3 * (i + k), value);
+        }
+    }
+#endif
+    for (; i < count; ++i)
+    {
+        const unsigned char* p = rgbe + 4 * i;
+        float scale = p[3] > 136 - 127 ? std::ldexp(1.0f, p[3] - 136) : 0.0f;
+        rgb[3 * i + 0] = p[0] * scale;
+        rgb[3 * i + 1] = p[1] * scale;
+        rgb[3 * i + 2] = p[2] * scale;
+    }
+}
+
+// RGBE -> RGB9E5: both are shared exponent formats, so this is an exponent re-bias with
+// the 8 bit mantissas moved to 9 bits. Values below the RGB9E5 range lose low mantissa
+// bits, values above it saturate.
+inline void expandRGBEToRGB9E5(const unsigned char* rgbe, uint32_t* out, int count)
+{
+    for (int i = 0; i < count; ++i)
+    {
+        const unsigned char* p = rgbe + 4 * i;
+        // m * 2^(e - 136) == (2m) * 2^(E - 24) with E = e - 113
+        int exponent = p[3] - 113;
+        uint32_t r = p[0] << 1, g = p[1] << 1, b = p[2] << 1;
+        if (p[3] == 0)
+        {
+            out[i] = 0;
+            continue;
+        }
+        if (exponent < 0)
+        {
+            int shift = -exponent > 31 ? 31 : -exponent;
+            r >>= shift;
+            g >>= shift;
+            b >>= shift;
+            exponent = 0;
+        }
+        else if (exponent > 31)
+        {
+            exponent = 31;
+            r = g = b = 0x1ff;
+        }
+        out[i] = r | (g << 9) | (b << 18) | (static_cast<uint32_t>(exponent) << 27);
+    }
+}
+
+// Loads a Radiance .hdr file into `storage`. Returns false (and leaves image empty) if the
+// file is missing, not RGBE, or truncated.
+inline bool loadRadianceHDR(const char* path, HDRStorage storage, RadianceHDRImage& image)
+{
+    MappedFile file(path);
+    RadianceHeader header;
+    if (!file.isOpen() || !readRadianceHeader(file.data(), file.size(), header))
+        return false;
+
+    const int width = header.width;
+    const int height = header.height;
+    const unsigned char* data = file.data() + header.dataOffset;
+    const size_t dataSize = file.size() - header.dataOffset;
+
+    // prepass: byte offset of every scanline
+    std::vector<size_t> rowOffsets(static_cast<size_t>(height) + 1);
+    rowOffsets[0] = 0;
+    for (int row = 0; row < height; ++row)
+    {
+        size_t length = radianceScanlineLength(data + rowOffsets[row], dataSize - rowOffsets[row], width);
+        if (length == 0)
+        {
+            std::cout << "ERROR::RADIANCE_HDR::TRUNCATED_SCANLINE " << row << " in " << path << std::endl;
+            return false;
+        }
+        rowOffsets[row + 1] = rowOffsets[row] + length;
+    }
+
+    const int bytesPerTexel = hdrGLFormat(storage).bytesPerTexel;
+    const size_t rowBytes = static_cast<size_t>(width) * bytesPerTexel;
+    image.width = width;
+    image.height = height;
+    image.storage = storage;
+    image.pixels.resize(rowBytes * height);
+
+    std::atomic<bool> ok(true);
+    parallelForRows(height, 16, [&](int begin, int end) {
+        std::vector<unsigned char> rgbe(static_cast<size_t>(width) * 4);
+        std::vector<float> floats(storage == HDRStorage::RGB32F || storage == HDRStorage::RGB9E5 ? 0 : static_cast<size_t>(width) * 3 + 1);
+        for (int row = begin; row < end; ++row)
+        {
+            if (!decodeRadianceScanline(data + rowOffsets[row], rowOffsets[row + 1] - rowOffsets[row], width, rgbe.data()))
+            {
+                ok = false;
+                return;
+            }
+
+            int y = header.bottomUp ? row : height - 1 - row;
+            unsigned char* out = image.pixels.data() + static_cast<size_t>(y) * rowBytes;
+            switch (storage)
+            {
+            case HDRStorage::RGB32F:
+                expandRGBEToFloat(rgbe.data(), reinterpret_cast<float*>(out), width);
+                break;
+            case HDRStorage::RGB9E5:
+                expandRGBEToRGB9E5(rgbe.data(), reinterpret_cast<uint32_t*>(out), width);
+                break;
+            case HDRStorage::RGB16F:
+                expandRGBEToFloat(rgbe.data(), floats.data(), width);
+                convertRGBToRGB16F(floats.data(), reinterpret_cast<uint16_t*>(out), width);
+                break;
+            case HDRStorage::R11G11B10F:
+                expandRGBEToFloat(rgbe.data(), floats.data(), width);
+                convertRGBToR11G11B10F(floats.data(), reinterpret_cast<uint32_t*>(out), width);
+                break;
+            }
+        }
+    });
+
+    if (!ok)
+    {
+        std::cout << "ERROR::RADIANCE_HDR::CORRUPT_SCANLINE in " << path << std::endl;
+        image.pixels.clear();
+        return false;
+    }
+    return true;
+}
+#endif
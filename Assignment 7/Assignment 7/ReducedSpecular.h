@@ -0,0 +1,128 @@
+#pragma once
+#ifndef REDUCED_SPECULAR_H
+#define REDUCED_SPECULAR_H
+
+#include <GL/glew.h>
+
+#include "GLStateCache.h"
+
+#include <iostream>
+
+// Specular IBL at a fraction of the screen resolution. The GGX integral is the costly part
+// of shader.fs and varies slowly across a surface, while the SH diffuse is a handful of
+// multiply-adds. So the models are drawn twice:
+//   1. into this target at 1/scale resolution with iblPass = IBL_PASS_SPECULAR, writing the
+//      specular radiance and, next to it, the normal and camera distance of the sample and
+//      its motion since the last frame (for TemporalAccumulation.h)
+//   2. at full resolution with iblPass = IBL_PASS_COMPOSITE, computing the diffuse term per
+//      pixel and fetching the specular through a joint bilateral upsample: the 2x2 reduced
+//      samples around the pixel are weighted bilinearly, and further by how close their
+//      depth and normal are to the pixel's own, so silhouettes do not smear specular across
+//      surfaces. A pixel whose four samples all miss keeps the nearest one in depth
+// IBL_PASS_FULL is the plain one-pass shading. A scale of 1 is valid too: temporal
+// accumulation runs on this target at any scale.
+
+const int IBL_PASS_FULL = 0;
+const int IBL_PASS_SPECULAR = 1;
+const int IBL_PASS_COMPOSITE = 2;
+
+const GLuint REDUCED_SPECULAR_UNIT = 6;
+const GLuint REDUCED_NORMAL_DEPTH_UNIT = 7;
+const GLuint REDUCED_MOTION_UNIT = 8;
+
+class ReducedSpecularTarget
+{
+public:
+    ~ReducedSpecularTarget() { destroy(); }
+
+    // (re)allocates for a width x height screen at 1/scale, rounding up; false if nothing
+    // changed. Reallocating leaves GL_TEXTURE_2D of the active unit unbound
+    // ------------------------------------------------------------------------
+    bool resize(int screenWidth, int screenHeight, int scale)
+    {
+        const int reducedWidth = (screenWidth + scale - 1) / scale;
+        const int reducedHeight = (screenHeight + scale - 1) / scale;
+        if (fbo && reducedWidth == width && reducedHeight == height)
+            return false;
+        destroy();
+        width = reducedWidth;
+        height = reducedHeight;
+
+        glGenFramebuffers(1, &fbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        specular = createTexture(GL_RGBA16F);
+        normalDepth = createTexture(GL_RGBA16F);
+        motion = createTexture(GL_RGBA16F);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, specular, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, normalDepth, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, motion, 0);
+        glGenRenderbuffers(1, &depth);
+        glBindRenderbuffer(GL_RENDERBUFFER, depth);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth);
+        const GLenum attachments[3] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 };
+        glDrawBuffers(3, attachments);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::REDUCED_SPECULAR::FRAMEBUFFER_INCOMPLETE: " << width << "x" << height << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        return true;
+    }
+
+    // deletes the target; call while the context is still current
+    void destroy()
+    {
+        if (fbo)
+        {
+            glDeleteFramebuffers(1, &fbo);
+            glDeleteTextures(1, &specular);
+            glDeleteTextures(1, &normalDepth);
+            glDeleteTextures(1, &motion);
+            glDeleteRenderbuffers(1, &depth);
+        }
+        fbo = specular = normalDepth = motion = depth = 0;
+        width = height = 0;
+    }
+
+    // makes the target current and clears it; a camera distance of 0 marks "no surface".
+    // Depth writes must be on for the clear. The REDUCED_* units are emptied first: last
+    // frame's composite and resolve left the attachments bound there, and rendering into a
+    // texture that is also bound for sampling is a feedback loop even if nothing reads it
+    // ------------------------------------------------------------------------
+    void bind(GLStateCache& state)
+    {
+        state.bindTexture(REDUCED_SPECULAR_UNIT, GL_TEXTURE_2D, 0);
+        state.bindTexture(REDUCED_NORMAL_DEPTH_UNIT, GL_TEXTURE_2D, 0);
+        state.bindTexture(REDUCED_MOTION_UNIT, GL_TEXTURE_2D, 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glViewport(0, 0, width, height);
+        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    }
+
+    GLuint specularTexture() const { return specular; }
+    GLuint normalDepthTexture() const { return normalDepth; }
+    // xy: screen position now minus last frame, in [0, 1] units; z: last frame's camera distance
+    GLuint motionTexture() const { return motion; }
+    int reducedWidth() const { return width; }
+    int reducedHeight() const { return height; }
+
+private:
+    GLuint fbo = 0, specular = 0, normalDepth = 0, motion = 0, depth = 0;
+    int width = 0, height = 0;
+
+    // texelFetch only, so no filtering or mips
+    GLuint createTexture(GLenum internalFormat)
+    {
+        GLuint texture;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, GL_RGBA, GL_FLOAT, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        return texture;
+    }
+};
+#endif
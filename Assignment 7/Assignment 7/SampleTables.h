@@ -0,0 +1,167 @@
+#pragma once
+#ifndef SAMPLE_TABLES_H
+#define SAMPLE_TABLES_H
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// Low-discrepancy points and the GGX half vectors built from them, precomputed once and
+// read by both the CPU IBL baker and the shaders, so neither runs the bit reversal and the
+// sqrt/cos/sin per sample any more.
+//
+// Three 2D sequences are available:
+//   - Hammersley: (i / count, radical inverse of i). Only a good set as a whole, a prefix
+//     of it clumps at small x
+//   - Sobol: the first two Sobol dimensions. Every power of two prefix is a (0, m, 2) net,
+//     so a shader can take the first n points of a longer table
+//   - OwenSobol: Sobol with hash-based nested uniform (Owen) scrambling, which keeps the
+//     net property and breaks up the lattice structure. The default
+//
+// SampleTable holds `count` points and, for each of `buckets` roughness values spaced
+// 1 / (buckets - 1) apart, the GGX half vector of every point around +Z. On the GPU it is
+// a GL_TEXTURE_1D_ARRAY: texel i of layer b is half vector i of bucket b, and the shader
+// rotates it into its own frame:
+//     vec4 h = texelFetch(ggxSamples, ivec2(i, bucket), 0);
+//     vec3 H = tangent * h.x + bitangent * h.y + N * h.z;
+
+enum class SampleSequence { Hammersley, Sobol, OwenSobol };
+
+// 0.05 roughness steps, so the prefilter mips (0, 0.25, ...) and the material values
+// used by assignment7 land on a bucket exactly
+const int SAMPLE_TABLE_BUCKETS = 21;
+const int SAMPLE_TABLE_UNIT = 14;   // texture unit the GGX table stays bound to
+
+inline uint32_t reverseBits32(uint32_t bits)
+{
+    bits = (bits << 16u) | (bits >> 16u);
+    bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+    bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+    bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+    bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+    return bits;
+}
+
+// [0, 1) from the top 24 bits; a plain bits * 2^-32 rounds 0xFFFFFFFF up to 1.0f
+inline float sampleBitsToFloat(uint32_t bits)
+{
+    return static_cast<float>(bits >> 8) * (1.0f / 16777216.0f);
+}
+
+// dimension 0 is the van der Corput sequence, dimension 1 uses the direction numbers
+// v_k = v_{k-1} ^ (v_{k-1} >> 1)
+inline uint32_t sobolBits(uint32_t index, int dimension)
+{
+    if (dimension == 0)
+        return reverseBits32(index);
+    uint32_t result = 0;
+    for (uint32_t v = 1u << 31; index; index >>= 1, v ^= v >> 1)
+    {
+        if (index & 1u)
+            result ^= v;
+    }
+    return result;
+}
+
+// Laine-Karras permutation applied to the reversed bits (Burley, "Practical Hash-based
+// Owen Scrambling"): flipping a bit only depends on the bits above it
+inline uint32_t owenScramble(uint32_t bits, uint32_t seed)
+{
+    uint32_t x = reverseBits32(bits);
+    x += seed;
+    x ^= x * 0x6c50b47cu;
+    x ^= x * 0xb82f1e52u;
+    x ^= x * 0xc7afe638u;
+    x ^= x * 0x8d22f6e6u;
+    return reverseBits32(x);
+}
+
+inline glm::vec2 sequencePoint(SampleSequence sequence, uint32_t i, uint32_t count)
+{
+    switch (sequence)
+    {
+    case SampleSequence::Hammersley:
+        return glm::vec2(static_cast<float>(i) / count, sampleBitsToFloat(reverseBits32(i)));
+    case SampleSequence::Sobol:
+        return glm::vec2(sampleBitsToFloat(sobolBits(i, 0)), sampleBitsToFloat(sobolBits(i, 1)));
+    case SampleSequence::OwenSobol:
+    default:
+        return glm::vec2(sampleBitsToFloat(owenScramble(sobolBits(i, 0), 0x68bc21ebu)),
+                         sampleBitsToFloat(owenScramble(sobolBits(i, 1), 0x02e5be93u)));
+    }
+}
+
+// GGX half vector around +Z for the point xi (alpha = roughness^2); x is the azimuth
+inline glm::vec3 ggxHalfVector(glm::vec2 xi, float roughness)
+{
+    const float pi = 3.14159265358979f;
+    float a = roughness * roughness;
+    float phi = 2.0f * pi * xi.x;
+    float cosTheta = std::sqrt((1.0f - xi.y) / (1.0f + (a * a - 1.0f) * xi.y));
+    float sinTheta = std::sqrt(std::max(1.0f - cosTheta * cosTheta, 0.0f));
+    return glm::vec3(std::cos(phi) * sinTheta, std::sin(phi) * sinTheta, cosTheta);
+}
+
+struct SampleTable {
+    SampleSequence sequence = SampleSequence::OwenSobol;
+    int count = 0;
+    int buckets = 0;
+    std::vector<glm::vec2> points;   // count
+    // bucket-major, count per bucket: xyz the half vector around +Z, w the pdf of the
+    // reflected direction when N = V (D / 4). The roughness 0 bucket is a delta, w = 0
+    std::vector<glm::vec4> ggx;
+
+    float bucketRoughness(int bucket) const { return buckets > 1 ? static_cast<float>(bucket) / (buckets - 1) : 0.0f; }
+    int bucket(float roughness) const
+    {
+        return std::min(std::max(static_cast<int>(roughness * (buckets - 1) + 0.5f), 0), buckets - 1);
+    }
+    const glm::vec4* ggxBucket(int bucket) const { return &ggx[static_cast<size_t>(bucket) * count]; }
+};
+
+inline SampleTable buildSampleTable(int count, SampleSequence sequence = SampleSequence::OwenSobol, int buckets = SAMPLE_TABLE_BUCKETS)
+{
+    const float pi = 3.14159265358979f;
+    SampleTable table;
+    table.sequence = sequence;
+    table.count = count;
+    table.buckets = buckets;
+    table.points.resize(count);
+    for (int i = 0; i < count; ++i)
+        table.points[i] = sequencePoint(sequence, static_cast<uint32_t>(i), static_cast<uint32_t>(count));
+
+    table.ggx.resize(static_cast<size_t>(buckets) * count);
+    for (int b = 0; b < buckets; ++b)
+    {
+        const float roughness = table.bucketRoughness(b);
+        const float a2 = roughness * roughness * roughness * roughness;
+        for (int i = 0; i < count; ++i)
+        {
+            glm::vec3 h = ggxHalfVector(table.points[i], roughness);
+            float denom = h.z * h.z * (a2 - 1.0f) + 1.0f;
+            float pdf = roughness > 0.0f ? a2 / (4.0f * pi * denom * denom) : 0.0f;
+            table.ggx[static_cast<size_t>(b) * count + i] = glm::vec4(h, pdf);
+        }
+    }
+    return table;
+}
+
+// GL_TEXTURE_1D_ARRAY, RGBA32F, one layer per roughness bucket; read with texelFetch
+// ------------------------------------------------------------------------
+inline unsigned int uploadSampleTable(const SampleTable& table)
+{
+    unsigned int texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_1D_ARRAY, texture);
+    glTexImage2D(GL_TEXTURE_1D_ARRAY, 0, GL_RGBA32F, table.count, table.buckets, 0, GL_RGBA, GL_FLOAT, table.ggx.data());
+    glTexParameteri(GL_TEXTURE_1D_ARRAY, GL_TEXTURE_MAX_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_1D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_1D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_1D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    return texture;
+}
+#endif
@@ -5,18 +5,46 @@
 #include <GL/glew.h>
 #include <glm/glm.hpp>
 
+#include "ProgramCache.h"
+#include "UniformCache.h"
+
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <vector>
+
+// the sources of a vertex and fragment shader file, for programs built straight through
+// ProgramCache or ShaderPermutations
+// ------------------------------------------------------------------------
+inline std::vector<ProgramStage> readShaderStages(const char* vertexPath, const char* fragmentPath)
+{
+    std::vector<ProgramStage> stages = { { GL_VERTEX_SHADER, std::string() }, { GL_FRAGMENT_SHADER, std::string() } };
+    const char* paths[2] = { vertexPath, fragmentPath };
+    for (int i = 0; i < 2; ++i)
+    {
+        std::ifstream file(paths[i]);
+        if (!file)
+        {
+            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ: " << paths[i] << std::endl;
+            continue;
+        }
+        std::stringstream stream;
+        stream << file.rdbuf();
+        stages[i].source = stream.str();
+    }
+    return stages;
+}
 
 class Shader
 {
 public:
     unsigned int ID;
-    // constructor generates the shader on the fly
+    // active uniform locations, reflected once after linking
+    UniformCache uniforms;
+    // constructor generates the shader on the fly, or loads its binary from cache
     // ------------------------------------------------------------------------
-    Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr)
+    Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr, ProgramCache* cache = nullptr)
     {
         // 1. retrieve the vertex/fragment source code from filePath
         std::string vertexCode;
@@ -58,6 +86,15 @@ public:
         {
             std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ: " << e.what() << std::endl;
         }
+        if (cache)
+        {
+            std::vector<ProgramStage> stages = { { GL_VERTEX_SHADER, vertexCode }, { GL_FRAGMENT_SHADER, fragmentCode } };
+            if (geometryPath != nullptr)
+                stages.push_back({ GL_GEOMETRY_SHADER, geometryCode });
+            ID = cache->build(vertexPath, stages);
+            uniforms.reflect(ID);
+            return;
+        }
         const char* vShaderCode = vertexCode.c_str();
         const char* fShaderCode = fragmentCode.c_str();
         // 2. compile shaders
@@ -90,6 +127,7 @@ public:
             glAttachShader(ID, geometry);
         glLinkProgram(ID);
         checkCompileErrors(ID, "PROGRAM");
+        uniforms.reflect(ID);
         // delete the shaders as they're linked into our program now and no longer necessery
         glDeleteShader(vertex);
         glDeleteShader(fragment);
@@ -103,63 +141,13 @@ public:
     {
         glUseProgram(ID);
     }
-    // utility uniform functions
-    // ------------------------------------------------------------------------
-    void setBool(const std::string& name, bool value) const
-    {
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
-    }
-    // ------------------------------------------------------------------------
-    void setInt(const std::string& name, int value) const
-    {
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
-    }
-    // ------------------------------------------------------------------------
-    void setFloat(const std::string& name, float value) const
-    {
-        glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
-    }
-    // ------------------------------------------------------------------------
-    void setVec2(const std::string& name, const glm::vec2& value) const
-    {
-        glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
-    }
-    void setVec2(const std::string& name, float x, float y) const
-    {
-        glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y);
-    }
-    // ------------------------------------------------------------------------
-    void setVec3(const std::string& name, const glm::vec3& value) const
-    {
-        glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
-    }
-    void setVec3(const std::string& name, float x, float y, float z) const
-    {
-        glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z);
-    }
-    // ------------------------------------------------------------------------
-    void setVec4(const std::string& name, const glm::vec4& value) const
-    {
-        glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
-    }
-    void setVec4(const std::string& name, float x, float y, float z, float w)
-    {
-        glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w);
-    }
-    // ------------------------------------------------------------------------
-    void setMat2(const std::string& name, const glm::mat2& mat) const
-    {
-        glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
-    }
-    // ------------------------------------------------------------------------
-    void setMat3(const std::string& name, const glm::mat3& mat) const
-    {
-        glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
-    }
+    // typed handle, e.g. shader.set(viewUniform, view) with
+    // constexpr Uniform<glm::mat4> viewUniform("view")
     // ------------------------------------------------------------------------
-    void setMat4(const std::string& name, const glm::mat4& mat) const
+    template <typename T, typename V>
+    void set(Uniform<T> uniform, const V& value) const
     {
-        glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        uniforms.set(uniform, value);
     }
 
 private:
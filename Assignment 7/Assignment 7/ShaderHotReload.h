@@ -0,0 +1,181 @@
+#pragma once
+#ifndef SHADER_HOT_RELOAD_H
+#define SHADER_HOT_RELOAD_H
+
+#include <GL/glew.h>
+
+#include "FileWatcher.h"
+#include "ProgramCache.h"
+#include "ShaderPermutations.h"
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Rebuilds the base program of a ShaderPermutations from its files while the application
+// runs:
+//   1. a FileWatcher thread notices a saved .vs/.fs and reads both files right there, off
+//      the GL thread
+//   2. update(), once per frame before anything is drawn, submits the new sources through
+//      ProgramCache::begin and returns; with KHR_parallel_shader_compile the driver
+//      compiles them in its own threads while frames keep drawing with the old program
+//   3. once the link is done the new program replaces the permutations' base (which drops
+//      the permutations) between two frames, so no frame ever mixes the two.
+//      A program that fails to compile or link is reported and dropped; the old one stays
+// Each swap prints the latency from the save to the first frame drawn with the new program.
+class ShaderHotReload
+{
+public:
+    typedef FileWatcher::Clock Clock;
+
+    explicit ShaderHotReload(ProgramCache& cache) : cache(cache) {}
+
+    ~ShaderHotReload() { stop(); }
+
+    // reloads the base program of `permutations` whenever one of its files changes; its
+    // own callback configures the new program. Call before start()
+    // ------------------------------------------------------------------------
+    void watch(ShaderPermutations& permutations, const char* vertexPath, const char* fragmentPath)
+    {
+        std::unique_ptr<Watched> watched(new Watched());
+        watched->permutations = &permutations;
+        watched->vertexPath = vertexPath;
+        watched->fragmentPath = fragmentPath;
+        shaders.push_back(std::move(watched));
+    }
+
+    bool start()
+    {
+        std::vector<std::string> paths;
+        for (const auto& watched : shaders)
+        {
+            paths.push_back(watched->vertexPath);
+            paths.push_back(watched->fragmentPath);
+        }
+        return watcher.start(paths, [this](const std::string& path, Clock::time_point changed) { fileChanged(path, changed); });
+    }
+
+    // once per frame on the GL thread, before the first draw. True when a program was
+    // swapped, which leaves the new program current
+    // ------------------------------------------------------------------------
+    bool update()
+    {
+        bool swapped = false;
+        for (auto& entry : shaders)
+        {
+            Watched& watched = *entry;
+            if (!watched.compiling)
+            {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (!watched.changed)
+                        continue;
+                    watched.changed = false;
+                    watched.stages = { { GL_VERTEX_SHADER, watched.vertexSource }, { GL_FRAGMENT_SHADER, watched.fragmentSource } };
+                    watched.building = watched.changedAt;
+                }
+                watched.pending = cache.begin(watched.vertexPath.c_str(), watched.stages);
+                watched.compiling = true;
+            }
+            if (!cache.ready(watched.pending))
+                continue;
+
+            GLuint program = cache.finish(watched.pending);
+            watched.compiling = false;
+            if (watched.pending.failed)
+            {
+                std::cout << "ERROR::SHADER_HOT_RELOAD::BUILD_FAILED: " << watched.vertexPath << " + " << watched.fragmentPath
+                          << ", keeping the previous program" << std::endl;
+                glDeleteProgram(program);
+                ++failed;
+                continue;
+            }
+            watched.permutations->reload(std::move(watched.stages), program);
+            swapped = true;
+            ++reloads;
+            std::cout << "Shader reload: " << watched.vertexPath << " + " << watched.fragmentPath << " swapped in "
+                      << std::chrono::duration<double, std::milli>(Clock::now() - watched.building).count()
+                      << " ms after the save" << (watched.pending.fromBinary ? " (binary cache)" : "") << std::endl;
+        }
+        return swapped;
+    }
+
+    // stops watching and drops any build still in flight; call while the context is current
+    // ------------------------------------------------------------------------
+    void stop()
+    {
+        watcher.stop();
+        for (auto& watched : shaders)
+        {
+            if (watched->compiling)
+                glDeleteProgram(cache.finish(watched->pending));
+            watched->compiling = false;
+        }
+    }
+
+    void printReport() const
+    {
+        std::cout << "Shader hot reload: " << reloads << " programs swapped, " << failed << " failed builds kept the old program" << std::endl;
+    }
+
+private:
+    struct Watched {
+        ShaderPermutations* permutations = nullptr;
+        std::string vertexPath, fragmentPath;
+        // written by the watcher thread under the mutex
+        bool changed = false;
+        std::string vertexSource, fragmentSource;
+        Clock::time_point changedAt;
+        // GL thread only
+        bool compiling = false;
+        std::vector<ProgramStage> stages;
+        PendingProgram pending;
+        Clock::time_point building;
+    };
+
+    ProgramCache& cache;
+    FileWatcher watcher;
+    std::mutex mutex;
+    std::vector<std::unique_ptr<Watched>> shaders;
+    int reloads = 0, failed = 0;
+
+    // watcher thread: reads the sources of every shader that uses path
+    void fileChanged(const std::string& path, Clock::time_point changed)
+    {
+        for (auto& watched : shaders)
+        {
+            if (path != watched->vertexPath && path != watched->fragmentPath)
+                continue;
+            std::string vertexSource, fragmentSource;
+            if (!readFile(watched->vertexPath, vertexSource) || !readFile(watched->fragmentPath, fragmentSource))
+                continue;
+            std::lock_guard<std::mutex> lock(mutex);
+            // a save that lands while the previous one is still queued keeps the older timestamp
+            if (!watched->changed)
+                watched->changedAt = changed;
+            watched->vertexSource = std::move(vertexSource);
+            watched->fragmentSource = std::move(fragmentSource);
+            watched->changed = true;
+        }
+    }
+
+    static bool readFile(const std::string& path, std::string& text)
+    {
+        std::ifstream file(path);
+        if (!file)
+        {
+            std::cout << "ERROR::SHADER_HOT_RELOAD::FILE_NOT_SUCCESFULLY_READ: " << path << std::endl;
+            return false;
+        }
+        std::stringstream stream;
+        stream << file.rdbuf();
+        text = stream.str();
+        return true;
+    }
+};
+#endif
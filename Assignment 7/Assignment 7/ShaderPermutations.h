@@ -0,0 +1,241 @@
+#pragma once
+#ifndef SHADER_PERMUTATIONS_H
+#define SHADER_PERMUTATIONS_H
+
+#include <GL/glew.h>
+
+#include "ProgramCache.h"
+#include "UniformCache.h"
+
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Specialised variants of one program, keyed by the #define block injected after #version
+// (ProgramCache::begin). A shader opts in by turning a uniform into a constant when its
+// define is present:
+//
+//   #ifdef SAMPLES_COUNT
+//   const int SamplesCount = SAMPLES_COUNT;
+//   #else
+//   uniform int SamplesCount;
+//   #endif
+//
+// so a permutation's sample loop has a fixed trip count and material terms the compiler can
+// fold, while the base program (no defines) keeps the uniforms and works for everything.
+//
+// Permutations are registered up front and compiled lazily: the first select() of one
+// queues it and returns the base program until update() has seen it linked. Compiles run
+// through KHR_parallel_shader_compile when the driver has it. Without it update() starts
+// at most one per frame, and that frame pays for the compile and link on the GL thread; a
+// binary cache hit costs only the glProgramBinary. At most `budget` permutations stay
+// alive; beyond that the one used least recently is deleted and simply rebuilt (usually
+// from the binary cache) if it is selected again.
+
+struct ProgramVariant {
+    GLuint program = 0;
+    UniformCache uniforms;
+};
+
+// one "#define name value" line of a permutation key
+template <typename T>
+std::string permutationDefine(const char* name, const T& value)
+{
+    std::ostringstream line;
+    line << "#define " << name << " " << value << "\n";
+    return line.str();
+}
+
+// floats need a decimal point to stay floats in GLSL
+inline std::string permutationDefine(const char* name, float value)
+{
+    std::ostringstream line;
+    line.setf(std::ios::fixed);
+    line.precision(6);
+    line << "#define " << name << " " << value << "\n";
+    return line.str();
+}
+
+class ShaderPermutations
+{
+public:
+    // called with every program right after it links, for sampler units and block bindings
+    typedef std::function<void(GLuint)> LinkedCallback;
+
+    // builds the base program right away
+    // ------------------------------------------------------------------------
+    ShaderPermutations(const char* label, std::vector<ProgramStage> stages, ProgramCache& cache, LinkedCallback onLinked, int budget = 6)
+        : label(label), stages(std::move(stages)), cache(cache), onLinked(std::move(onLinked)), budget(budget)
+    {
+        basic.program = cache.build(label, this->stages);
+        linked(basic);
+    }
+
+    ~ShaderPermutations() { release(); }
+
+    // deletes every program; call while the context is still current
+    // ------------------------------------------------------------------------
+    void release()
+    {
+        for (Permutation& permutation : permutations)
+        {
+            if (permutation.state == State::Compiling)
+                permutation.variant.program = cache.finish(permutation.pending);
+            if (permutation.variant.program)
+                glDeleteProgram(permutation.variant.program);
+            permutation.variant.program = 0;
+            permutation.state = State::Idle;
+        }
+        if (basic.program)
+            glDeleteProgram(basic.program);
+        basic.program = 0;
+    }
+
+    const ProgramVariant& base() const { return basic; }
+
+    // new sources, with their base program already linked (ShaderHotReload); the
+    // permutations are dropped and rebuilt from the new sources as they are selected
+    // ------------------------------------------------------------------------
+    void reload(std::vector<ProgramStage> newStages, GLuint program)
+    {
+        release();
+        stages = std::move(newStages);
+        basic.program = program;
+        linked(basic);
+    }
+
+    // id of the permutation with these defines, registering it on first use; compiles nothing
+    // ------------------------------------------------------------------------
+    int permutation(const std::string& defines)
+    {
+        for (size_t i = 0; i < permutations.size(); ++i)
+        {
+            if (permutations[i].defines == defines)
+                return static_cast<int>(i);
+        }
+        Permutation permutation;
+        permutation.defines = defines;
+        permutations.push_back(std::move(permutation));
+        return static_cast<int>(permutations.size() - 1);
+    }
+
+    // the program to draw permutation `id` with this frame: the permutation once linked,
+    // the base program until then (or for good if it failed to build)
+    // ------------------------------------------------------------------------
+    const ProgramVariant& select(int id)
+    {
+        Permutation& permutation = permutations[id];
+        permutation.lastUsed = frame;
+        if (permutation.state == State::Linked)
+            return permutation.variant;
+        if (permutation.state == State::Idle)
+            permutation.state = State::Queued;
+        return basic;
+    }
+
+    // once per frame: collects finished compiles, starts queued ones, enforces the budget.
+    // True when a program was linked or deleted, which may have changed the current program.
+    // ------------------------------------------------------------------------
+    bool update()
+    {
+        ++frame;
+        bool changed = false;
+        for (Permutation& permutation : permutations)
+        {
+            if (permutation.state != State::Compiling || !cache.ready(permutation.pending))
+                continue;
+            permutation.variant.program = cache.finish(permutation.pending);
+            if (permutation.pending.failed)
+            {
+                std::cout << "ERROR::SHADER_PERMUTATIONS::BUILD_FAILED: " << label << " with\n" << permutation.defines
+                          << "falling back to the base program" << std::endl;
+                glDeleteProgram(permutation.variant.program);
+                permutation.variant.program = 0;
+                permutation.state = State::Failed;
+                changed = true;
+                continue;
+            }
+            linked(permutation.variant);
+            permutation.state = State::Linked;
+            ++built;
+            changed = true;
+        }
+
+        int starts = cache.isParallel() ? static_cast<int>(permutations.size()) : 1;
+        for (Permutation& permutation : permutations)
+        {
+            if (starts == 0)
+                break;
+            if (permutation.state != State::Queued)
+                continue;
+            permutation.pending = cache.begin(label.c_str(), stages, permutation.defines);
+            permutation.state = State::Compiling;
+            --starts;
+        }
+
+        // live counts compiles in flight too, so a burst of new keys cannot overshoot
+        while (live() > budget)
+        {
+            Permutation* oldest = nullptr;
+            for (Permutation& permutation : permutations)
+            {
+                if (permutation.state == State::Linked && permutation.lastUsed < frame - 1 &&
+                    (!oldest || permutation.lastUsed < oldest->lastUsed))
+                    oldest = &permutation;
+            }
+            if (!oldest)
+                break;
+            glDeleteProgram(oldest->variant.program);
+            oldest->variant.program = 0;
+            oldest->state = State::Idle;
+            ++evicted;
+            changed = true;
+        }
+        return changed;
+    }
+
+    int live() const
+    {
+        int count = 0;
+        for (const Permutation& permutation : permutations)
+            count += permutation.state == State::Linked || permutation.state == State::Compiling;
+        return count;
+    }
+
+    void printReport() const
+    {
+        std::cout << "Shader permutations (" << label << "): " << permutations.size() << " registered, " << live() << " live of "
+                  << budget << ", " << built << " built, " << evicted << " evicted" << std::endl;
+    }
+
+private:
+    enum class State { Idle, Queued, Compiling, Linked, Failed };
+
+    struct Permutation {
+        std::string defines;
+        State state = State::Idle;
+        PendingProgram pending;
+        ProgramVariant variant;
+        long long lastUsed = -1;
+    };
+
+    std::string label;
+    std::vector<ProgramStage> stages;
+    ProgramCache& cache;
+    LinkedCallback onLinked;
+    int budget;
+    ProgramVariant basic;
+    std::vector<Permutation> permutations;
+    long long frame = 0;
+    int built = 0, evicted = 0;
+
+    void linked(ProgramVariant& variant)
+    {
+        if (onLinked)
+            onLinked(variant.program);
+        variant.uniforms.reflect(variant.program);
+    }
+};
+#endif
@@ -0,0 +1,268 @@
+#pragma once
+#ifndef TEMPORAL_ACCUMULATION_H
+#define TEMPORAL_ACCUMULATION_H
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "GLStateCache.h"
+#include "ProgramCache.h"
+#include "ReducedSpecular.h"
+#include "UniformCache.h"
+
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+// Temporal accumulation of the Monte Carlo specular IBL. The sample loop in shader.fs uses
+// the same table points every frame, so on its own it only converges by taking more of
+// them. With rotateSamples on, each frame shifts the points by a new Cranley-Patterson
+// offset (sampleRotation(), an R2 sequence, plus a fixed per-pixel offset), so successive
+// frames draw different, well spread sample sets, and this pass averages them:
+//   1. the specular pass (ReducedSpecular.h) writes the frame's noisy specular, its normal
+//      and camera distance, and its motion from the orbit camera and model matrices
+//   2. resolve() reprojects every texel into last frame's history, keeps only the history
+//      texels whose camera distance matches where the surface was (disocclusion), clamps
+//      the history to the box of the 3x3 neighbourhood of this frame, and blends:
+//          accumulated = mix(history, current, 1 / frames)
+//      frames counts up to TEMPORAL_MAX_FRAMES per texel, so a still image is the plain
+//      mean of the last frames' sample sets; 4 samples a frame reach 64 after 16 frames
+//   3. the composite pass reads accumulatedTexture() in place of the raw specular
+// History is two ping-pong pairs of RGBA16F specular + frame count and R32F camera distance.
+
+const int TEMPORAL_MAX_FRAMES = 16;
+const GLuint TEMPORAL_HISTORY_UNIT = 9;
+const GLuint TEMPORAL_HISTORY_DISTANCE_UNIT = 10;
+
+inline std::vector<ProgramStage> temporalResolveStages()
+{
+    const char* vertexSource = R"HERE(
+#version 330 core
+// one triangle over the whole target, no vertex buffer
+void main()
+{
+    vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    gl_Position = vec4(corner * 2.0 - 1.0, 0.0, 1.0);
+}
+)HERE";
+    const char* fragmentSource = R"HERE(
+#version 330 core
+layout(location = 0) out vec4 Accumulated;   // rgb specular, a frames accumulated
+layout(location = 1) out float Distance;     // camera distance, 0 where nothing was drawn
+
+uniform sampler2D currentSpecular;
+uniform sampler2D currentNormalDepth;
+uniform sampler2D motion;
+uniform sampler2D historySpecular;
+uniform sampler2D historyDistance;
+uniform bool historyValid;
+uniform float maxFrames;
+uniform float distanceTolerance;   // relative
+
+void main()
+{
+    ivec2 size = textureSize(currentSpecular, 0);
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    vec3 current = texelFetch(currentSpecular, pixel, 0).rgb;
+    float cameraDistance = texelFetch(currentNormalDepth, pixel, 0).w;
+    Distance = cameraDistance;
+    if (cameraDistance <= 0.0)
+    {
+        Accumulated = vec4(0.0);
+        return;
+    }
+
+    // history outside the box this frame's covered neighbours span is stale
+    vec3 low = current;
+    vec3 high = current;
+    for (int y = -1; y <= 1; ++y)
+    {
+        for (int x = -1; x <= 1; ++x)
+        {
+            ivec2 texel = clamp(pixel + ivec2(x, y), ivec2(0), size - 1);
+            if (texelFetch(currentNormalDepth, texel, 0).w <= 0.0)
+                continue;
+            vec3 neighbour = texelFetch(currentSpecular, texel, 0).rgb;
+            low = min(low, neighbour);
+            high = max(high, neighbour);
+        }
+    }
+
+    // bilinear over the four history texels around last frame's position, each only if it
+    // saw this surface: its distance then matches the one the motion pass computed
+    vec4 pixelMotion = texelFetch(motion, pixel, 0);
+    vec2 position = gl_FragCoord.xy - pixelMotion.xy * vec2(size) - 0.5;
+    ivec2 base = ivec2(floor(position));
+    vec2 f = position - floor(position);
+    vec4 history = vec4(0.0);
+    float total = 0.0;
+    for (int i = 0; i < 4 && historyValid; ++i)
+    {
+        ivec2 offset = ivec2(i & 1, i >> 1);
+        ivec2 texel = base + offset;
+        if (any(lessThan(texel, ivec2(0))) || any(greaterThanEqual(texel, size)))
+            continue;
+        float previousDistance = texelFetch(historyDistance, texel, 0).r;
+        if (abs(previousDistance - pixelMotion.z) > distanceTolerance * pixelMotion.z)
+            continue;
+        float weight = (offset.x == 1 ? f.x : 1.0 - f.x) * (offset.y == 1 ? f.y : 1.0 - f.y);
+        history += texelFetch(historySpecular, texel, 0) * weight;
+        total += weight;
+    }
+
+    float frames = 1.0;
+    vec3 accumulated = current;
+    if (total > 1e-3)
+    {
+        history /= total;
+        frames = min(history.a + 1.0, maxFrames);
+        accumulated = mix(clamp(history.rgb, low, high), current, 1.0 / frames);
+    }
+    Accumulated = vec4(accumulated, frames);
+}
+)HERE";
+    return { { GL_VERTEX_SHADER, vertexSource }, { GL_FRAGMENT_SHADER, fragmentSource } };
+}
+
+// sampler units of the resolve program; for ShaderLibrary::add
+inline void configureTemporalResolveProgram(GLuint program)
+{
+    glUseProgram(program);
+    glUniform1i(glGetUniformLocation(program, "currentSpecular"), REDUCED_SPECULAR_UNIT);
+    glUniform1i(glGetUniformLocation(program, "currentNormalDepth"), REDUCED_NORMAL_DEPTH_UNIT);
+    glUniform1i(glGetUniformLocation(program, "motion"), REDUCED_MOTION_UNIT);
+    glUniform1i(glGetUniformLocation(program, "historySpecular"), TEMPORAL_HISTORY_UNIT);
+    glUniform1i(glGetUniformLocation(program, "historyDistance"), TEMPORAL_HISTORY_DISTANCE_UNIT);
+}
+
+class TemporalAccumulation
+{
+public:
+    ~TemporalAccumulation() { destroy(); }
+
+    // (re)allocates the history for a width x height specular target; false if nothing
+    // changed. Reallocating drops the history and leaves GL_TEXTURE_2D of the active unit
+    // unbound
+    // ------------------------------------------------------------------------
+    bool resize(int targetWidth, int targetHeight)
+    {
+        if (fbo[0] && targetWidth == width && targetHeight == height)
+            return false;
+        destroy();
+        width = targetWidth;
+        height = targetHeight;
+
+        glGenVertexArrays(1, &emptyVAO);
+        glGenFramebuffers(2, fbo);
+        for (int i = 0; i < 2; ++i)
+        {
+            glBindFramebuffer(GL_FRAMEBUFFER, fbo[i]);
+            specular[i] = createTexture(GL_RGBA16F, GL_RGBA);
+            distance[i] = createTexture(GL_R32F, GL_RED);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, specular[i], 0);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, distance[i], 0);
+            const GLenum attachments[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+            glDrawBuffers(2, attachments);
+            if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+                std::cout << "ERROR::TEMPORAL_ACCUMULATION::FRAMEBUFFER_INCOMPLETE: " << width << "x" << height << std::endl;
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        return true;
+    }
+
+    // deletes the history; call while the context is still current
+    void destroy()
+    {
+        if (fbo[0])
+        {
+            glDeleteFramebuffers(2, fbo);
+            glDeleteTextures(2, specular);
+            glDeleteTextures(2, distance);
+            glDeleteVertexArrays(1, &emptyVAO);
+        }
+        for (int i = 0; i < 2; ++i)
+            fbo[i] = specular[i] = distance[i] = 0;
+        emptyVAO = 0;
+        width = height = 0;
+        valid = false;
+    }
+
+    // the next resolve starts over from the current frame alone
+    void reset() { valid = false; }
+
+    // Cranley-Patterson offset for this frame's samples: the R2 sequence, which spreads any
+    // run of consecutive frames evenly over [0, 1)^2
+    // ------------------------------------------------------------------------
+    glm::vec2 sampleRotation() const
+    {
+        const double g = 1.32471795724474602596;   // plastic number
+        const double n = static_cast<double>(frame);
+        double x = 0.5 + n / g, y = 0.5 + n / (g * g);
+        return glm::vec2(static_cast<float>(x - std::floor(x)), static_cast<float>(y - std::floor(y)));
+    }
+
+    // blends the target's specular into the history and makes it accumulatedTexture().
+    // Binds the history framebuffer and its viewport, and the target's textures on the
+    // REDUCED_* units; leaves depth testing off and polygons filled
+    // ------------------------------------------------------------------------
+    void resolve(GLuint program, const ReducedSpecularTarget& target, GLStateCache& state)
+    {
+        const int read = current, write = 1 - current;
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo[write]);
+        glViewport(0, 0, width, height);
+        state.disable(GL_DEPTH_TEST);
+        state.polygonMode(GL_FILL);
+        state.useProgram(program);
+        if (program != uniformsProgram)
+        {
+            uniforms.reflect(program);
+            uniformsProgram = program;
+        }
+        constexpr Uniform<bool> historyValidUniform("historyValid");
+        constexpr Uniform<float> maxFramesUniform("maxFrames"), distanceToleranceUniform("distanceTolerance");
+        uniforms.set(historyValidUniform, valid);
+        uniforms.set(maxFramesUniform, static_cast<float>(TEMPORAL_MAX_FRAMES));
+        // neighbouring texels of one surface differ by far less; a disocclusion by far more
+        uniforms.set(distanceToleranceUniform, 0.05f);
+
+        state.bindTexture(REDUCED_SPECULAR_UNIT, GL_TEXTURE_2D, target.specularTexture());
+        state.bindTexture(REDUCED_NORMAL_DEPTH_UNIT, GL_TEXTURE_2D, target.normalDepthTexture());
+        state.bindTexture(REDUCED_MOTION_UNIT, GL_TEXTURE_2D, target.motionTexture());
+        state.bindTexture(TEMPORAL_HISTORY_UNIT, GL_TEXTURE_2D, specular[read]);
+        state.bindTexture(TEMPORAL_HISTORY_DISTANCE_UNIT, GL_TEXTURE_2D, distance[read]);
+        state.bindVertexArray(emptyVAO);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+
+        current = write;
+        valid = true;
+        ++frame;
+    }
+
+    GLuint accumulatedTexture() const { return specular[current]; }
+
+private:
+    GLuint fbo[2] = {}, specular[2] = {}, distance[2] = {};
+    GLuint emptyVAO = 0;
+    int width = 0, height = 0;
+    int current = 0;
+    bool valid = false;
+    long long frame = 0;
+    UniformCache uniforms;
+    GLuint uniformsProgram = 0;
+
+    // texelFetch only, so no filtering or mips
+    GLuint createTexture(GLenum internalFormat, GLenum format)
+    {
+        GLuint texture;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, GL_FLOAT, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        return texture;
+    }
+};
+#endif
@@ -6,6 +6,12 @@
 
 #include "glwrap.H"
 
+#include "TextureIO.h"
+
+#include <cstddef>
+#include <limits>
+#include <new>
+
 
 // IMPORTANT NOTE:  Must call contextInit() from within a GL context
 // before you can use the texture!!
@@ -126,15 +132,22 @@ class Texture
   int load(str_ptr filename); 
   int save(str_ptr filename);
 
+  // The loaders below mmap the file and decode row bands on all cores
+  // straight into _texels (see TextureIO.h).  They return 1 on success.
   int loadRGB(const char *fname);
   int loadPNM(const char *fname);
 
   int loadTarga(const char *fname);
+  // always writes run-length encoded (type 10/11) Targa
   int saveTarga(const char *fname);
 
 
  protected:
 
+  // (re)allocates _texels for an image of the given size and type; 0 if the size comes
+  // from a bad header (not positive, or more texels than memory can address)
+  int allocTexels(int width, int height, int texType);
+
   str_ptr _name;
   str_ptr _filename;
 
@@ -153,4 +166,100 @@ class Texture
   double _aspect;
 };
 
+
+inline int
+Texture::allocTexels(int width, int height, int texType)
+{
+  if (width <= 0 || height <= 0 || texType <= 0)
+    return 0;
+  const size_t limit = std::numeric_limits<size_t>::max() / sizeof(GLfloat);
+  const size_t pixels = static_cast<size_t>(width) * static_cast<size_t>(height);
+  if (pixels / static_cast<size_t>(width) != static_cast<size_t>(height) || pixels > limit / static_cast<size_t>(texType))
+    return 0;
+  const size_t count = pixels * static_cast<size_t>(texType);
+  if (!_texels || count != static_cast<size_t>(_width) * _height * _texType) {
+    delete [] _texels;
+    _texels = new (std::nothrow) GLfloat[count];
+    if (!_texels) {
+      _width = _height = 0;
+      return 0;
+    }
+  }
+  _width = width;
+  _height = height;
+  _texType = texType;
+  _aspect = aspect();
+  return 1;
+}
+
+inline int
+Texture::loadTarga(const char *fname)
+{
+  MappedFile file(fname);
+  TargaHeader header;
+  if (!file.isOpen() || !readTargaHeader(file.data(), file.size(), header)) {
+    cerr << "Texture::loadTarga: can't read " << fname << endl;
+    return 0;
+  }
+  if (!allocTexels(header.info.width, header.info.height, header.info.channels)) {
+    cerr << "Texture::loadTarga: bad image size " << header.info.width << "x" << header.info.height << " in " << fname << endl;
+    return 0;
+  }
+  if (!decodeTarga(file.data(), file.size(), header, _texels)) {
+    cerr << "Texture::loadTarga: corrupt image data in " << fname << endl;
+    return 0;
+  }
+  return 1;
+}
+
+inline int
+Texture::saveTarga(const char *fname)
+{
+  if (!saveTargaRLE(fname, _texels, _width, _height, _texType)) {
+    cerr << "Texture::saveTarga: can't write " << fname << endl;
+    return 0;
+  }
+  return 1;
+}
+
+inline int
+Texture::loadPNM(const char *fname)
+{
+  MappedFile file(fname);
+  PNMHeader header;
+  if (!file.isOpen() || !readPNMHeader(file.data(), file.size(), header)) {
+    cerr << "Texture::loadPNM: can't read " << fname << endl;
+    return 0;
+  }
+  if (!allocTexels(header.info.width, header.info.height, header.info.channels)) {
+    cerr << "Texture::loadPNM: bad image size " << header.info.width << "x" << header.info.height << " in " << fname << endl;
+    return 0;
+  }
+  if (!decodePNM(file.data(), file.size(), header, _texels)) {
+    cerr << "Texture::loadPNM: truncated image data in " << fname << endl;
+    return 0;
+  }
+  return 1;
+}
+
+inline int
+Texture::loadRGB(const char *fname)
+{
+  MappedFile file(fname);
+  SGIHeader header;
+  if (!file.isOpen() || !readSGIHeader(file.data(), file.size(), header)) {
+    cerr << "Texture::loadRGB: can't read " << fname << endl;
+    return 0;
+  }
+  if (!allocTexels(header.info.width, header.info.height, header.info.channels)) {
+    cerr << "Texture::loadRGB: bad image size " << header.info.width << "x" << header.info.height << " in " << fname << endl;
+    return 0;
+  }
+  if (!decodeSGI(file.data(), file.size(), header, _texels)) {
+    cerr << "Texture::loadRGB: corrupt image data in " << fname << endl;
+    return 0;
+  }
+  return 1;
+}
+
 #endif
\ No newline at end of file
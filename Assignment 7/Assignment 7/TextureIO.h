@@ -0,0 +1,640 @@
+#pragma once
+#ifndef TEXTURE_IO_H
+#define TEXTURE_IO_H
+
+#include "MappedFile.h"
+#include "Parallel.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+// Decoders for Targa (.tga), binary/ASCII PNM (.pgm/.ppm) and SGI (.rgb/.sgi) images.
+// Every decoder works on a memory-mapped file in two steps: read*Header() validates the
+// file and reports the size and channel count, then decode*() writes normalized floats
+// straight into caller-owned storage of width * height * channels texels. Rows are
+// written bottom-up (the first row is the bottom of the image) to match glTexImage2D,
+// and the pixel rows are split into bands decoded on all hardware threads.
+
+struct ImageInfo {
+    int width = 0;
+    int height = 0;
+    int channels = 0;
+};
+
+// minimum rows per worker band, keeps tiny images on the calling thread
+const int IMAGE_ROWS_PER_BAND = 32;
+
+// ----------------------------------------------------------------------------
+// Targa
+// ----------------------------------------------------------------------------
+
+struct TargaHeader {
+    ImageInfo info;
+    int imageType = 0;       // 1/2/3 uncompressed, 9/10/11 run-length encoded
+    int pixelDepth = 0;      // bits per stored pixel (or per color map index)
+    int bytesPerPixel = 0;   // bytes per stored pixel
+    int mapDepth = 0;        // bits per color map entry
+    int mapFirst = 0;
+    int mapLength = 0;
+    size_t mapOffset = 0;    // offset of the color map
+    size_t dataOffset = 0;   // offset of the pixel data
+    bool topToBottom = false;
+    bool rightToLeft = false;
+    bool rle = false;
+};
+
+inline uint16_t readLE16(const unsigned char* p)
+{
+    return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+inline uint16_t readBE16(const unsigned char* p)
+{
+    return static_cast<uint16_t>((p[0] << 8) | p[1]);
+}
+
+inline uint32_t readBE32(const unsigned char* p)
+{
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+}
+
+// number of float channels a Targa pixel of the given depth expands to
+inline int targaChannels(int depth, int alphaBits, bool grayscale)
+{
+    if (grayscale)
+        return 1;
+    if (depth == 15 || depth == 16)
+        return alphaBits > 0 ? 4 : 3;
+    return depth == 32 ? 4 : 3;
+}
+
+// expands one stored true-color/grayscale pixel into `channels` floats
+inline void expandTargaPixel(const unsigned char* src, int bytesPerPixel, int channels, float* dst)
+{
+    const float inv255 = 1.0f / 255.0f;
+    switch (bytesPerPixel)
+    {
+    case 1:
+        dst[0] = src[0] * inv255;
+        break;
+    case 2:
+    {
+        uint16_t v = readLE16(src);
+        dst[0] = ((v >> 10) & 0x1f) * (1.0f / 31.0f);
+        dst[1] = ((v >> 5) & 0x1f) * (1.0f / 31.0f);
+        dst[2] = (v & 0x1f) * (1.0f / 31.0f);
+        if (channels == 4)
+            dst[3] = (v & 0x8000) ? 1.0f : 0.0f;
+        break;
+    }
+    case 3:
+        dst[0] = src[2] * inv255;
+        dst[1] = src[1] * inv255;
+        dst[2] = src[0] * inv255;
+        break;
+    default:
+        dst[0] = src[2] * inv255;
+        dst[1] = src[1] * inv255;
+        dst[2] = src[0] * inv255;
+        dst[3] = src[3] * inv255;
+        break;
+    }
+}
+
+inline bool readTargaHeader(const unsigned char* bytes, size_t size, TargaHeader& header)
+{
+    if (size < 18)
+        return false;
+
+    int idLength = bytes[0];
+    int colorMapType = bytes[1];
+    header.imageType = bytes[2];
+    header.mapFirst = readLE16(bytes + 3);
+    header.mapLength = readLE16(bytes + 5);
+    header.mapDepth = bytes[7];
+    header.info.width = readLE16(bytes + 12);
+    header.info.height = readLE16(bytes + 14);
+    header.pixelDepth = bytes[16];
+    int descriptor = bytes[17];
+    int alphaBits = descriptor & 0x0f;
+    header.rightToLeft = (descriptor & 0x10) != 0;
+    header.topToBottom = (descriptor & 0x20) != 0;
+    header.rle = header.imageType >= 9;
+
+    int baseType = header.rle ? header.imageType - 8 : header.imageType;
+    if (baseType < 1 || baseType > 3 || header.info.width == 0 || header.info.height == 0)
+        return false;
+
+    header.mapOffset = 18 + idLength;
+    size_t mapEntryBytes = (header.mapDepth + 7) / 8;
+    header.dataOffset = header.mapOffset + (colorMapType == 1 ? header.mapLength * mapEntryBytes : 0);
+    header.bytesPerPixel = (header.pixelDepth + 7) / 8;
+
+    if (baseType == 1)
+    {
+        // color mapped: indices are 8 or 16 bit, the map holds the real pixel format
+        if (colorMapType != 1 || (header.bytesPerPixel != 1 && header.bytesPerPixel != 2))
+            return false;
+        if (header.mapDepth != 15 && header.mapDepth != 16 && header.mapDepth != 24 && header.mapDepth != 32)
+            return false;
+        header.info.channels = targaChannels(header.mapDepth, alphaBits, false);
+    }
+    else
+    {
+        bool grayscale = baseType == 3;
+        if (grayscale ? header.pixelDepth != 8
+                      : (header.pixelDepth != 15 && header.pixelDepth != 16 && header.pixelDepth != 24 && header.pixelDepth != 32))
+            return false;
+        header.info.channels = targaChannels(header.pixelDepth, alphaBits, grayscale);
+    }
+    return header.dataOffset <= size;
+}
+
+// Decodes the pixel data of a Targa file into dst (width * height * channels floats).
+// Run-length packets may straddle scanlines, so a cheap sequential pass over the packet
+// headers records where each band starts before the bands are expanded in parallel.
+inline bool decodeTarga(const unsigned char* bytes, size_t size, const TargaHeader& header, float* dst)
+{
+    const int width = header.info.width;
+    const int height = header.info.height;
+    const int channels = header.info.channels;
+    const int bpp = header.bytesPerPixel;
+    const bool mapped = header.imageType == 1 || header.imageType == 9;
+
+    // expand the color map once, indices then become a table lookup
+    std::vector<float> palette;
+    if (mapped)
+    {
+        int mapBytes = (header.mapDepth + 7) / 8;
+        palette.resize(static_cast<size_t>(header.mapLength) * channels);
+        for (int i = 0; i < header.mapLength; ++i)
+            expandTargaPixel(bytes + header.mapOffset + static_cast<size_t>(i) * mapBytes, mapBytes, channels, &palette[static_cast<size_t>(i) * channels]);
+    }
+
+    auto writePixel = [&](const unsigned char* src, float* out) -> bool {
+        if (!mapped)
+        {
+            expandTargaPixel(src, bpp, channels, out);
+            return true;
+        }
+        int index = (bpp == 1 ? src[0] : readLE16(src)) - header.mapFirst;
+        if (index < 0 || index >= header.mapLength)
+            return false;
+        std::memcpy(out, &palette[static_cast<size_t>(index) * channels], channels * sizeof(float));
+        return true;
+    };
+
+    // output pointer for file scanline `row`, column 0, honoring the origin bits
+    auto rowStart = [&](int row) -> float* {
+        int y = header.topToBottom ? height - 1 - row : row;
+        return dst + static_cast<size_t>(y) * width * channels;
+    };
+    const int xStep = header.rightToLeft ? -channels : channels;
+    const int xFirst = header.rightToLeft ? (width - 1) * channels : 0;
+
+    const unsigned char* data = bytes + header.dataOffset;
+    const size_t dataSize = size - header.dataOffset;
+    const int bands = parallelBandCount(height, IMAGE_ROWS_PER_BAND);
+
+    if (!header.rle)
+    {
+        if (dataSize < static_cast<size_t>(width) * height * bpp)
+            return false;
+
+        std::atomic<bool> ok(true);
+        parallelForBands(bands, [&](int band) {
+            int end = parallelBandBegin(band + 1, bands, height);
+            for (int row = parallelBandBegin(band, bands, height); row < end; ++row)
+            {
+                const unsigned char* src = data + static_cast<size_t>(row) * width * bpp;
+                float* out = rowStart(row) + xFirst;
+                for (int x = 0; x < width; ++x, src += bpp, out += xStep)
+                    if (!writePixel(src, out))
+                        ok = false;
+            }
+        });
+        return ok;
+    }
+
+    // prepass: find the packet (and the pixel inside it) where every band begins
+    struct PacketCursor {
+        size_t offset;
+        int skip;
+    };
+    std::vector<PacketCursor> cursors(bands);
+    {
+        size_t offset = 0;
+        long long pixel = 0;
+        int band = 0;
+        const long long total = static_cast<long long>(width) * height;
+        while (band < bands)
+        {
+            long long bandPixel = static_cast<long long>(parallelBandBegin(band, bands, height)) * width;
+            if (offset >= dataSize)
+                return false;
+            int count = (data[offset] & 0x7f) + 1;
+            size_t packetBytes = 1 + ((data[offset] & 0x80) ? bpp : static_cast<size_t>(count) * bpp);
+            while (band < bands && bandPixel < pixel + count)
+            {
+                cursors[band] = { offset, static_cast<int>(bandPixel - pixel) };
+                ++band;
+                if (band < bands)
+                    bandPixel = static_cast<long long>(parallelBandBegin(band, bands, height)) * width;
+            }
+            pixel += count;
+            offset += packetBytes;
+            if (pixel >= total && band < bands)
+                return false;
+        }
+    }
+
+    std::atomic<bool> ok(true);
+    parallelForBands(bands, [&](int band) {
+        int row = parallelBandBegin(band, bands, height);
+        const int endRow = parallelBandBegin(band + 1, bands, height);
+        size_t offset = cursors[band].offset;
+        int skip = cursors[band].skip;
+        int x = 0;
+        float* out = rowStart(row) + xFirst;
+
+        while (row < endRow)
+        {
+            if (offset >= dataSize)
+            {
+                ok = false;
+                return;
+            }
+            unsigned char packet = data[offset++];
+            int count = (packet & 0x7f) + 1;
+            bool run = (packet & 0x80) != 0;
+            size_t payload = run ? bpp : static_cast<size_t>(count) * bpp;
+            if (offset + payload > dataSize)
+            {
+                ok = false;
+                return;
+            }
+
+            // a run only needs its pixel expanded once
+            float runPixel[4];
+            if (run && !writePixel(data + offset, runPixel))
+                ok = false;
+
+            for (int i = skip; i < count && row < endRow; ++i)
+            {
+                if (run)
+                    std::memcpy(out, runPixel, channels * sizeof(float));
+                else if (!writePixel(data + offset + static_cast<size_t>(i) * bpp, out))
+                    ok = false;
+
+                out += xStep;
+                if (++x == width)
+                {
+                    x = 0;
+                    if (++row < endRow)
+                        out = rowStart(row) + xFirst;
+                }
+            }
+            skip = 0;
+            offset += payload;
+        }
+    });
+    return ok;
+}
+
+// Run-length encodes rows [begin, end) of bottom-up texels as 8-bit gray, BGR or BGRA
+// packets. Packets never cross a scanline, so bands can be encoded independently and
+// simply concatenated.
+inline void encodeTargaRows(const float* texels, int width, int channels, int fileChannels,
+                            int begin, int end, std::vector<unsigned char>& out)
+{
+    auto toByte = [](float v) -> unsigned char {
+        v = v < 0.0f ? 0.0f : (v > 1.0f ? 1.0f : v);
+        return static_cast<unsigned char>(v * 255.0f + 0.5f);
+    };
+
+    std::vector<unsigned char> row(static_cast<size_t>(width) * fileChannels);
+    out.reserve(out.size() + static_cast<size_t>(end - begin) * row.size());
+
+    for (int y = begin; y < end; ++y)
+    {
+        // convert one scanline to the stored byte layout
+        const float* src = texels + static_cast<size_t>(y) * width * channels;
+        for (int x = 0; x < width; ++x, src += channels)
+        {
+            unsigned char* p = &row[static_cast<size_t>(x) * fileChannels];
+            if (fileChannels == 1)
+            {
+                p[0] = toByte(src[0]);
+                continue;
+            }
+            float r = src[0];
+            float g = channels >= 3 ? src[1] : src[0];
+            float b = channels >= 3 ? src[2] : src[0];
+            p[0] = toByte(b);
+            p[1] = toByte(g);
+            p[2] = toByte(r);
+            if (fileChannels == 4)
+                p[3] = toByte(channels == 4 ? src[3] : (channels == 2 ? src[1] : 1.0f));
+        }
+
+        auto same = [&](int a, int b) {
+            return std::memcmp(&row[static_cast<size_t>(a) * fileChannels], &row[static_cast<size_t>(b) * fileChannels], fileChannels) == 0;
+        };
+
+        int x = 0;
+        while (x < width)
+        {
+            // run packet: two or more equal pixels
+            int run = 1;
+            while (x + run < width && run < 128 && same(x, x + run))
+                ++run;
+            if (run > 1)
+            {
+                out.push_back(static_cast<unsigned char>(0x80 | (run - 1)));
+                out.insert(out.end(), row.begin() + static_cast<size_t>(x) * fileChannels, row.begin() + static_cast<size_t>(x + 1) * fileChannels);
+                x += run;
+                continue;
+            }
+
+            // raw packet: stop where the next run starts
+            int raw = 1;
+            while (x + raw < width && raw < 128 && !(x + raw + 1 < width && same(x + raw, x + raw + 1)))
+                ++raw;
+            out.push_back(static_cast<unsigned char>(raw - 1));
+            out.insert(out.end(), row.begin() + static_cast<size_t>(x) * fileChannels, row.begin() + static_cast<size_t>(x + raw) * fileChannels);
+            x += raw;
+        }
+    }
+}
+
+// writes bottom-up float texels as a run-length encoded Targa file
+inline bool saveTargaRLE(const char* path, const float* texels, int width, int height, int channels)
+{
+    if (width <= 0 || height <= 0 || width > 0xffff || height > 0xffff || channels < 1 || channels > 4)
+        return false;
+
+    // 1 channel stays grayscale, luminance-alpha is widened to BGRA
+    int fileChannels = channels == 1 ? 1 : (channels == 3 ? 3 : 4);
+
+    int bands = parallelBandCount(height, IMAGE_ROWS_PER_BAND);
+    std::vector<std::vector<unsigned char>> encoded(bands);
+    parallelForBands(bands, [&](int band) {
+        encodeTargaRows(texels, width, channels, fileChannels,
+                        parallelBandBegin(band, bands, height), parallelBandBegin(band + 1, bands, height), encoded[band]);
+    });
+
+    unsigned char header[18] = {};
+    header[2] = fileChannels == 1 ? 11 : 10;
+    header[12] = static_cast<unsigned char>(width & 0xff);
+    header[13] = static_cast<unsigned char>(width >> 8);
+    header[14] = static_cast<unsigned char>(height & 0xff);
+    header[15] = static_cast<unsigned char>(height >> 8);
+    header[16] = static_cast<unsigned char>(fileChannels * 8);
+    header[17] = static_cast<unsigned char>(fileChannels == 4 ? 8 : 0); // bottom-left origin
+
+    FILE* file = std::fopen(path, "wb");
+    if (!file)
+    {
+        std::cout << "ERROR::TEXTURE_IO::COULD_NOT_WRITE: " << path << std::endl;
+        return false;
+    }
+    bool ok = std::fwrite(header, 1, sizeof(header), file) == sizeof(header);
+    for (const std::vector<unsigned char>& chunk : encoded)
+        ok = ok && std::fwrite(chunk.data(), 1, chunk.size(), file) == chunk.size();
+    return std::fclose(file) == 0 && ok;
+}
+
+// ----------------------------------------------------------------------------
+// PNM (P2/P3 ASCII, P5/P6 binary)
+// ----------------------------------------------------------------------------
+
+struct PNMHeader {
+    ImageInfo info;
+    int maxValue = 0;
+    bool binary = false;
+    size_t dataOffset = 0;
+};
+
+// reads the next unsigned integer, skipping whitespace and # comments
+inline bool readPNMInt(const unsigned char* bytes, size_t size, size_t& offset, int& value)
+{
+    while (offset < size)
+    {
+        unsigned char c = bytes[offset];
+        if (c == '#')
+        {
+            while (offset < size && bytes[offset] != '\n')
+                ++offset;
+        }
+        else if (c == ' ' || c == '\t' || c == '\r' || c == '\n')
+            ++offset;
+        else
+            break;
+    }
+    if (offset >= size || bytes[offset] < '0' || bytes[offset] > '9')
+        return false;
+    long long v = 0;
+    while (offset < size && bytes[offset] >= '0' && bytes[offset] <= '9')
+    {
+        v = v * 10 + (bytes[offset++] - '0');
+        if (v > 0x7fffffff)
+            return false;
+    }
+    value = static_cast<int>(v);
+    return true;
+}
+
+inline bool readPNMHeader(const unsigned char* bytes, size_t size, PNMHeader& header)
+{
+    if (size < 3 || bytes[0] != 'P')
+        return false;
+    char kind = static_cast<char>(bytes[1]);
+    if (kind != '2' && kind != '3' && kind != '5' && kind != '6')
+        return false;
+
+    header.binary = kind == '5' || kind == '6';
+    header.info.channels = (kind == '3' || kind == '6') ? 3 : 1;
+
+    size_t offset = 2;
+    if (!readPNMInt(bytes, size, offset, header.info.width) ||
+        !readPNMInt(bytes, size, offset, header.info.height) ||
+        !readPNMInt(bytes, size, offset, header.maxValue))
+        return false;
+    if (header.info.width <= 0 || header.info.height <= 0 || header.maxValue <= 0 || header.maxValue > 65535)
+        return false;
+
+    // a single whitespace byte separates the header from binary samples
+    header.dataOffset = offset + 1;
+    return header.dataOffset <= size;
+}
+
+// PNM is stored top-down; rows are flipped on the way into dst
+inline bool decodePNM(const unsigned char* bytes, size_t size, const PNMHeader& header, float* dst)
+{
+    const int width = header.info.width;
+    const int height = header.info.height;
+    const size_t rowSamples = static_cast<size_t>(width) * header.info.channels;
+    const float scale = 1.0f / header.maxValue;
+
+    if (!header.binary)
+    {
+        // ASCII samples have no fixed stride, so they are parsed sequentially
+        size_t offset = header.dataOffset - 1;
+        for (int row = 0; row < height; ++row)
+        {
+            float* out = dst + static_cast<size_t>(height - 1 - row) * rowSamples;
+            for (size_t i = 0; i < rowSamples; ++i)
+            {
+                int v;
+                if (!readPNMInt(bytes, size, offset, v))
+                    return false;
+                out[i] = v * scale;
+            }
+        }
+        return true;
+    }
+
+    const size_t sampleBytes = header.maxValue < 256 ? 1 : 2;
+    const size_t rowBytes = rowSamples * sampleBytes;
+    if (size - header.dataOffset < rowBytes * height)
+        return false;
+
+    const unsigned char* data = bytes + header.dataOffset;
+    parallelForRows(height, IMAGE_ROWS_PER_BAND, [&](int begin, int end) {
+        for (int row = begin; row < end; ++row)
+        {
+            const unsigned char* src = data + static_cast<size_t>(row) * rowBytes;
+            float* out = dst + static_cast<size_t>(height - 1 - row) * rowSamples;
+            if (sampleBytes == 1)
+            {
+                for (size_t i = 0; i < rowSamples; ++i)
+                    out[i] = src[i] * scale;
+            }
+            else
+            {
+                for (size_t i = 0; i < rowSamples; ++i)
+                    out[i] = readBE16(src + 2 * i) * scale;
+            }
+        }
+    });
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+// SGI (.rgb / .sgi / .bw)
+// ----------------------------------------------------------------------------
+
+struct SGIHeader {
+    ImageInfo info;
+    bool rle = false;
+    int bytesPerChannel = 1;
+};
+
+inline bool readSGIHeader(const unsigned char* bytes, size_t size, SGIHeader& header)
+{
+    if (size < 512 || readBE16(bytes) != 474)
+        return false;
+    header.rle = bytes[2] == 1;
+    header.bytesPerChannel = bytes[3];
+    int dimension = readBE16(bytes + 4);
+    header.info.width = readBE16(bytes + 6);
+    header.info.height = dimension >= 2 ? readBE16(bytes + 8) : 1;
+    header.info.channels = dimension >= 3 ? readBE16(bytes + 10) : 1;
+    uint32_t colormap = readBE32(bytes + 104);
+
+    return (header.bytesPerChannel == 1 || header.bytesPerChannel == 2) && colormap == 0 &&
+           header.info.width > 0 && header.info.height > 0 &&
+           header.info.channels >= 1 && header.info.channels <= 4;
+}
+
+// SGI scanlines are stored bottom-up per channel plane, and RLE files carry a table of
+// scanline offsets, so every row decodes independently.
+inline bool decodeSGI(const unsigned char* bytes, size_t size, const SGIHeader& header, float* dst)
+{
+    const int width = header.info.width;
+    const int height = header.info.height;
+    const int channels = header.info.channels;
+    const int bpc = header.bytesPerChannel;
+    const float scale = bpc == 1 ? 1.0f / 255.0f : 1.0f / 65535.0f;
+    const size_t planeBytes = static_cast<size_t>(width) * height * bpc;
+    const size_t tableEntries = static_cast<size_t>(height) * channels;
+
+    if (!header.rle && size < 512 + planeBytes * channels)
+        return false;
+    if (header.rle && size < 512 + tableEntries * 8)
+        return false;
+
+    std::atomic<bool> ok(true);
+    parallelForRows(height, IMAGE_ROWS_PER_BAND, [&](int begin, int end) {
+        for (int y = begin; y < end; ++y)
+        {
+            float* out = dst + static_cast<size_t>(y) * width * channels;
+            for (int c = 0; c < channels; ++c)
+            {
+                if (!header.rle)
+                {
+                    const unsigned char* src = bytes + 512 + planeBytes * c + static_cast<size_t>(y) * width * bpc;
+                    for (int x = 0; x < width; ++x)
+                        out[static_cast<size_t>(x) * channels + c] = (bpc == 1 ? src[x] : readBE16(src + 2 * x)) * scale;
+                    continue;
+                }
+
+                size_t entry = static_cast<size_t>(y) + static_cast<size_t>(c) * height;
+                size_t offset = readBE32(bytes + 512 + entry * 4);
+                size_t length = readBE32(bytes + 512 + tableEntries * 4 + entry * 4);
+                if (offset > size || length > size - offset)
+                {
+                    ok = false;
+                    return;
+                }
+
+                const unsigned char* src = bytes + offset;
+                const unsigned char* srcEnd = src + length;
+                int x = 0;
+                while (src + bpc <= srcEnd)
+                {
+                    int code = bpc == 1 ? src[0] : readBE16(src);
+                    src += bpc;
+                    int count = code & 0x7f;
+                    if (count == 0)
+                        break;
+                    if (x + count > width)
+                    {
+                        ok = false;
+                        return;
+                    }
+                    if (code & 0x80)
+                    {
+                        // literal samples
+                        if (src + static_cast<size_t>(count) * bpc > srcEnd)
+                        {
+                            ok = false;
+                            return;
+                        }
+                        for (int i = 0; i < count; ++i, src += bpc)
+                            out[static_cast<size_t>(x++) * channels + c] = (bpc == 1 ? src[0] : readBE16(src)) * scale;
+                    }
+                    else
+                    {
+                        // repeated sample
+                        if (src + bpc > srcEnd)
+                        {
+                            ok = false;
+                            return;
+                        }
+                        float v = (bpc == 1 ? src[0] : readBE16(src)) * scale;
+                        src += bpc;
+                        for (int i = 0; i < count; ++i)
+                            out[static_cast<size_t>(x++) * channels + c] = v;
+                    }
+                }
+            }
+        }
+    });
+    return ok;
+}
+#endif
@@ -0,0 +1,237 @@
+#pragma once
+#ifndef TEXTURE_PACKER_H
+#define TEXTURE_PACKER_H
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+#include <stb_image.h>
+
+#include "Parallel.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Packs every material texture of a Model into one GL_TEXTURE_2D_ARRAY so the whole
+// model draws with a single texture binding. All textures are expanded to RGBA8, which
+// puts them in one bin. Layers are square and sized to the largest texture:
+//   - a texture exactly the layer size gets a layer of its own and its full mip chain
+//   - smaller textures are shelf-packed into shared layers, each surrounded by a gutter
+//     of wrapped texels. Tiles are aligned to the gutter width so mip levels up to
+//     log2(gutter) never mix two tiles, and the shader clamps its LOD to that level.
+// Vertex UVs are left as they are (models tile them past [0, 1]); instead every
+// texture records its layer and rect, and the shader remaps fract(uv) into the rect
+// with PACKED_TEXTURE_GLSL below.
+
+const int TEXTURE_ATLAS_GUTTER = 8;       // texels, power of two
+const int TEXTURE_ATLAS_UNIT = 15;        // texture unit the packed array is bound to
+
+// where one source texture ended up in the array
+struct PackedTextureRect {
+    int layer = -1;                                  // -1: not packed
+    glm::vec4 rect = glm::vec4(0.0f, 0.0f, 1.0f, 1.0f);   // uv offset (xy) and scale (zw) inside the layer
+    float maxLod = 0.0f;                             // deepest mip that stays inside the tile's gutter
+};
+
+struct TextureAtlas {
+    unsigned int id = 0;
+    int layerSize = 0;
+    int layers = 0;
+    size_t usedTexels = 0;   // texels covered by source images (without gutters)
+};
+
+// Sampling helper for shaders using packed textures, registered with the ProgramCache as
+// "packed_texture.glsl": include it and call
+// samplePackedTexture(uv, texture_diffuse1Rect, texture_diffuse1Layer).
+// The LOD is computed from the unwrapped uv so the fract() seam does not pop to the
+// smallest mip.
+const char* const PACKED_TEXTURE_GLSL = R"(
+uniform sampler2DArray texture_atlas;
+vec4 samplePackedTexture(vec2 uv, vec4 rect, vec2 layerLod)
+{
+    vec2 size = vec2(textureSize(texture_atlas, 0).xy) * rect.zw;
+    vec2 dx = dFdx(uv) * size;
+    vec2 dy = dFdy(uv) * size;
+    float lod = min(0.5 * log2(max(max(dot(dx, dx), dot(dy, dy)), 1e-8)), layerLod.y);
+    return textureLod(texture_atlas, vec3(rect.xy + fract(uv) * rect.zw, layerLod.x), lod);
+}
+)";
+
+struct AtlasImage {
+    std::string path;
+    unsigned char* pixels = nullptr;   // RGBA8 from stb_image
+    int width = 0;
+    int height = 0;
+    PackedTextureRect placement;
+    int x = 0, y = 0;                  // tile origin (gutter included) in texels
+};
+
+inline int atlasRoundUp(int value, int multiple)
+{
+    return (value + multiple - 1) / multiple * multiple;
+}
+
+// Shelf packing, tallest first. Returns the number of layers used.
+// ------------------------------------------------------------------------
+inline int packAtlasLayers(std::vector<AtlasImage*>& images, int layerSize, int gutter)
+{
+    std::sort(images.begin(), images.end(), [](const AtlasImage* a, const AtlasImage* b) {
+        return a->height != b->height ? a->height > b->height : a->width > b->width;
+    });
+
+    int layers = 0;
+    // shelves of the current shared layer
+    int shelfX = 0, shelfY = 0, shelfHeight = 0;
+    int sharedLayer = -1;
+    for (AtlasImage* image : images)
+    {
+        if (image->width == layerSize && image->height == layerSize)
+        {
+            image->placement.layer = layers++;
+            image->x = image->y = 0;
+            continue;
+        }
+
+        int tileWidth = atlasRoundUp(image->width + 2 * gutter, gutter);
+        int tileHeight = atlasRoundUp(image->height + 2 * gutter, gutter);
+        if (sharedLayer < 0 || shelfX + tileWidth > layerSize)
+        {
+            // next shelf, or a fresh layer when the shelf would not fit
+            shelfY += shelfHeight;
+            shelfX = 0;
+            shelfHeight = 0;
+            if (sharedLayer < 0 || shelfY + tileHeight > layerSize)
+            {
+                sharedLayer = layers++;
+                shelfY = 0;
+            }
+        }
+        image->placement.layer = sharedLayer;
+        image->x = shelfX;
+        image->y = shelfY;
+        shelfX += tileWidth;
+        shelfHeight = std::max(shelfHeight, tileHeight);
+    }
+    return layers;
+}
+
+// Copies an image and its wrapped gutter into a layer (RGBA8, layerSize wide).
+// ------------------------------------------------------------------------
+inline void blitAtlasTile(const AtlasImage& image, unsigned char* layer, int layerSize, int gutter)
+{
+    const int w = image.width;
+    const int h = image.height;
+    const bool fullLayer = w == layerSize && h == layerSize;
+    const int pad = fullLayer ? 0 : gutter;
+    for (int ty = -pad; ty < h + pad; ++ty)
+    {
+        int sy = ((ty % h) + h) % h;
+        unsigned char* dst = layer + (static_cast<size_t>(image.y + pad + ty) * layerSize + image.x + pad) * 4;
+        const unsigned char* src = image.pixels + static_cast<size_t>(sy) * w * 4;
+        for (int tx = -pad; tx < w + pad; ++tx)
+        {
+            int sx = ((tx % w) + w) % w;
+            std::memcpy(dst + tx * 4, src + sx * 4, 4);
+        }
+    }
+}
+
+// Decodes the textures at directory/paths[i] in parallel and packs them into one array
+// texture. placements[i] receives where paths[i] went; textures that failed to load
+// keep layer -1. Returns an atlas with id 0 if nothing could be packed.
+// ------------------------------------------------------------------------
+inline TextureAtlas buildTextureAtlas(const std::vector<std::string>& paths, const std::string& directory,
+                                      std::vector<PackedTextureRect>& placements, int gutter = TEXTURE_ATLAS_GUTTER)
+{
+    TextureAtlas atlas;
+    std::vector<AtlasImage> images(paths.size());
+    const int count = static_cast<int>(images.size());
+    parallelForRows(count, 1, [&](int begin, int end) {
+        for (int i = begin; i < end; ++i)
+        {
+            int channels;
+            images[i].path = paths[i];
+            images[i].pixels = stbi_load((directory + '/' + paths[i]).c_str(), &images[i].width, &images[i].height, &channels, 4);
+        }
+    });
+
+    std::vector<AtlasImage*> packable;
+    int maxDimension = 0;
+    for (AtlasImage& image : images)
+    {
+        if (!image.pixels)
+        {
+            std::cout << "Texture failed to load at path: " << image.path << std::endl;
+            continue;
+        }
+        packable.push_back(&image);
+        maxDimension = std::max(maxDimension, std::max(image.width, image.height));
+    }
+
+    placements.assign(paths.size(), PackedTextureRect());
+    if (!packable.empty())
+    {
+        // smallest power of two that holds the largest texture, padded unless it fills a layer exactly
+        atlas.layerSize = 1;
+        while (atlas.layerSize < maxDimension)
+            atlas.layerSize <<= 1;
+        for (const AtlasImage* image : packable)
+        {
+            bool fullLayer = image->width == atlas.layerSize && image->height == atlas.layerSize;
+            while (!fullLayer && std::max(image->width, image->height) + 2 * gutter > atlas.layerSize)
+                atlas.layerSize <<= 1;
+        }
+        atlas.layers = packAtlasLayers(packable, atlas.layerSize, gutter);
+
+        const size_t layerBytes = static_cast<size_t>(atlas.layerSize) * atlas.layerSize * 4;
+        std::vector<unsigned char> texels(layerBytes * atlas.layers, 0);
+        parallelForRows(static_cast<int>(packable.size()), 1, [&](int begin, int end) {
+            for (int i = begin; i < end; ++i)
+                blitAtlasTile(*packable[i], &texels[layerBytes * packable[i]->placement.layer], atlas.layerSize, gutter);
+        });
+
+        int fullLevels = 1;
+        while ((atlas.layerSize >> fullLevels) > 0)
+            ++fullLevels;
+        int gutterLevels = 0;
+        while ((1 << (gutterLevels + 1)) <= gutter)
+            ++gutterLevels;
+        for (AtlasImage* image : packable)
+        {
+            bool fullLayer = image->width == atlas.layerSize && image->height == atlas.layerSize;
+            int pad = fullLayer ? 0 : gutter;
+            float scale = 1.0f / atlas.layerSize;
+            image->placement.rect = glm::vec4((image->x + pad) * scale, (image->y + pad) * scale, image->width * scale, image->height * scale);
+            image->placement.maxLod = static_cast<float>(fullLayer ? fullLevels - 1 : gutterLevels);
+            atlas.usedTexels += static_cast<size_t>(image->width) * image->height;
+        }
+        for (int i = 0; i < count; ++i)
+            placements[i] = images[i].placement;
+
+        glGenTextures(1, &atlas.id);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, atlas.id);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, atlas.layerSize, atlas.layerSize, atlas.layers, 0, GL_RGBA, GL_UNSIGNED_BYTE, texels.data());
+        glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+        size_t totalTexels = static_cast<size_t>(atlas.layerSize) * atlas.layerSize * atlas.layers;
+        std::cout << "Packed " << packable.size() << " textures into " << atlas.layers << " layers of "
+                  << atlas.layerSize << "x" << atlas.layerSize << " (" << totalTexels * 4 * 4 / 3 / 1024.0 / 1024.0
+                  << " MB with mips, " << 100 * atlas.usedTexels / totalTexels << "% used)" << std::endl;
+    }
+
+    for (AtlasImage& image : images)
+    {
+        if (image.pixels)
+            stbi_image_free(image.pixels);
+    }
+    return atlas;
+}
+#endif
@@ -0,0 +1,153 @@
+#pragma once
+#ifndef UNIFORM_CACHE_H
+#define UNIFORM_CACHE_H
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Uniform locations of a linked program, reflected once through GL_ACTIVE_UNIFORMS into a
+// flat open-addressing table keyed by the FNV-1a hash of the name. Render loops address
+// uniforms through typed handles whose hash is computed by the compiler:
+//
+//   constexpr Uniform<glm::mat4> viewUniform("view");
+//   ...
+//   uniforms.set(viewUniform, view);   // table probe + glUniformMatrix4fv
+//
+// so the per-frame path does no string building, hashing or glGetUniformLocation. Array
+// uniforms are registered as "name", "name[0]", "name[1]", ... Uniforms inside blocks have
+// no location and are skipped. set() writes to the currently bound program, like glUniform*.
+
+// FNV-1a; 0 marks an empty slot in the table, so it is remapped
+constexpr uint32_t uniformHash(const char* name)
+{
+    uint32_t hash = 2166136261u;
+    while (*name)
+    {
+        hash ^= static_cast<unsigned char>(*name++);
+        hash *= 16777619u;
+    }
+    return hash ? hash : 1u;
+}
+
+template <typename T>
+struct Uniform {
+    uint32_t hash;
+    constexpr explicit Uniform(const char* name) : hash(uniformHash(name)) {}
+};
+
+class UniformCache
+{
+public:
+    UniformCache() = default;
+    explicit UniformCache(GLuint program) { reflect(program); }
+
+    // rebuilds the table; call again after relinking the program
+    // ------------------------------------------------------------------------
+    void reflect(GLuint program)
+    {
+        GLint count = 0, maxLength = 0;
+        glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+
+        struct Active {
+            std::string name;
+            GLint size;
+            bool array;
+        };
+        std::vector<Active> active;
+        std::vector<char> name(std::max(maxLength, 1));
+        size_t entries = 0;
+        for (GLint i = 0; i < count; ++i)
+        {
+            GLint size = 0;
+            GLenum type = 0;
+            glGetActiveUniform(program, static_cast<GLuint>(i), static_cast<GLsizei>(name.size()), nullptr, &size, &type, name.data());
+            std::string base = name.data();
+            size_t bracket = base.find('[');
+            if (bracket != std::string::npos)
+                base.erase(bracket);
+            active.push_back({ base, size, bracket != std::string::npos });
+            entries += 1 + (bracket != std::string::npos ? size : 0);
+        }
+
+        size_t capacity = 16;
+        while (capacity < 2 * entries)
+            capacity *= 2;
+        slots.assign(capacity, Slot());
+        mask = static_cast<uint32_t>(capacity - 1);
+
+        for (const Active& uniform : active)
+        {
+            GLint location = glGetUniformLocation(program, uniform.name.c_str());
+            if (location < 0)
+                continue;
+            insert(uniform.name, location);
+            for (GLint element = 0; uniform.array && element < uniform.size; ++element)
+            {
+                std::string elementName = uniform.name + "[" + std::to_string(element) + "]";
+                insert(elementName, element == 0 ? location : glGetUniformLocation(program, elementName.c_str()));
+            }
+        }
+    }
+
+    // -1 for names the program does not use, like glGetUniformLocation
+    GLint location(uint32_t hash) const
+    {
+        if (slots.empty())
+            return -1;
+        for (uint32_t i = hash & mask;; i = (i + 1) & mask)
+        {
+            if (slots[i].hash == hash)
+                return slots[i].location;
+            if (slots[i].hash == 0)
+                return -1;
+        }
+    }
+    template <typename T>
+    GLint location(Uniform<T> uniform) const { return location(uniform.hash); }
+
+    void set(Uniform<bool> u, bool value) const { glUniform1i(location(u), static_cast<int>(value)); }
+    void set(Uniform<int> u, int value) const { glUniform1i(location(u), value); }
+    void set(Uniform<float> u, float value) const { glUniform1f(location(u), value); }
+    void set(Uniform<glm::vec2> u, const glm::vec2& value) const { glUniform2fv(location(u), 1, &value[0]); }
+    void set(Uniform<glm::vec3> u, const glm::vec3& value) const { glUniform3fv(location(u), 1, &value[0]); }
+    void set(Uniform<glm::vec4> u, const glm::vec4& value) const { glUniform4fv(location(u), 1, &value[0]); }
+    void set(Uniform<glm::mat2> u, const glm::mat2& value) const { glUniformMatrix2fv(location(u), 1, GL_FALSE, &value[0][0]); }
+    void set(Uniform<glm::mat3> u, const glm::mat3& value) const { glUniformMatrix3fv(location(u), 1, GL_FALSE, &value[0][0]); }
+    void set(Uniform<glm::mat4> u, const glm::mat4& value) const { glUniformMatrix4fv(location(u), 1, GL_FALSE, &value[0][0]); }
+
+private:
+    struct Slot {
+        uint32_t hash = 0;
+        GLint location = -1;
+    };
+    std::vector<Slot> slots;
+    uint32_t mask = 0;
+
+    void insert(const std::string& name, GLint location)
+    {
+        const uint32_t hash = uniformHash(name.c_str());
+        for (uint32_t i = hash & mask;; i = (i + 1) & mask)
+        {
+            if (slots[i].hash == 0)
+            {
+                slots[i].hash = hash;
+                slots[i].location = location;
+                return;
+            }
+            if (slots[i].hash == hash)
+            {
+                if (slots[i].location != location)
+                    std::cout << "ERROR::UNIFORM_CACHE::HASH_COLLISION: " << name << std::endl;
+                return;
+            }
+        }
+    }
+};
+#endif
@@ -1,7 +1,9 @@
 // Assignment 7 
 // Completed by Wanyea Barbel
 
+#include <chrono>
 #include <iostream>
+#include <string>
 #include <vector>
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
@@ -16,191 +18,47 @@
 #include "Shader.h"
 #include "Camera.h"
 #include "Model.h"
+#include "HDRFormats.h"
+#include "RadianceHDR.h"
+#include "IBLBaker.h"
+#include "EnvironmentManager.h"
+#include "Octahedral.h"
+#include "LayeredCapture.h"
+#include "PassQueries.h"
+#include "ReducedSpecular.h"
+#include "ComputeIBLBaker.h"
+#include "DepthPrepass.h"
+#include "FrameUniforms.h"
+#include "GLStateCache.h"
+#include "ShaderHotReload.h"
+#include "ShaderLibrary.h"
+#include "ShaderPermutations.h"
+#include "TemporalAccumulation.h"
 
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 
-void renderCube();
+void renderCube(int instances = 1);
 void renderSphere();
 
-const char* srcVS = R"HERE(
-#version 330 core
-layout (location = 0) in vec3 position;
-layout (location = 1) in vec3 aNormal;
-layout (location = 2) in vec2 uv;
-
-out vec3 Normal;
-out vec3 Position;
-
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
-
-void main()
-{
-    Normal = mat3(transpose(inverse(model))) * aNormal;
-    Position = vec3(model * vec4(position, 1.0));
-    gl_Position = projection * view * model * vec4(position, 1.0);
-}
-)HERE";
-
-const char* srcFS = R"HERE(
-#version 330 core
-out vec4 FragColor;
-
-in vec3 Normal;
-in vec3 Position;
-
-uniform vec3 cameraPos;
-uniform int SamplesCount;
-uniform samplerCube prefilterMap;
-uniform samplerCube irradianceMap;
-
-uniform float roughness;
-uniform float metallic;
-uniform vec3 materialColor;
-
-const float pi = 3.14159265359;
-const float MAX_REFLECTION_LOD = 4.0;
-
-
-float radicalInverse(uint bits) 
-{
-     bits = (bits << 16u) | (bits >> 16u);
-     bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
-     bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
-     bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
-     bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
-     return float(bits) * 2.3283064365386963e-10; // / 0x100000000
-}
-
-vec2 Hammersley(uint i, uint N)
-{
-	return vec2(float(i)/float(N), radicalInverse(i));
-}
-
-vec3 importanceSample(vec2 X, vec3 N, float roughness)
-{
-	float a = roughness*roughness;
-	
-	float phi = 2.0 * pi * X.x;
-	float cosTheta = sqrt((1.0 - X.y) / (1.0 + (a*a - 1.0) * X.y));
-	float sinTheta = sqrt(1.0 - cosTheta*cosTheta);
-	
-	vec3 H;
-	H.x = cos(phi) * sinTheta;
-	H.y = sin(phi) * sinTheta;
-	H.z = cosTheta;
-	
-	vec3 up = abs(N.z) < 0.999 ? vec3(0.0, 0.0, 1.0) : vec3(1.0, 0.0, 0.0);
-	vec3 tangent = normalize(cross(up, N));
-	vec3 bitangent = cross(N, tangent);
-	
-	vec3 sampleVec = tangent * H.x + bitangent * H.y + N * H.z;
-	return normalize(sampleVec);
-}
-
-float chi(float v)
-{
-    return v > 0 ? 1 : 0;
-}
-
-float distribution(vec3 n, vec3 h, float alpha)
-{
-    float NoH = dot(n,h);
-    float alpha2 = alpha * alpha;
-    float NoH2 = NoH * NoH;
-    float den = NoH2 * alpha2 + (1 - NoH2);
-    return (chi(NoH) * alpha2) / ( pi * den * den );
-}
-
-float partialGeometry(vec3 v, vec3 n, vec3 h, float alpha)
-{
-    float VoH2 = clamp(dot(v,h), 0.0, 1.0);
-    float chi = chi( VoH2 / clamp(dot(v,n), 0.0, 1.0) );
-    VoH2 = VoH2 * VoH2;
-    float tan2 = ( 1 - VoH2 ) / VoH2;
-    return (chi * 2) / ( 1 + sqrt( 1 + alpha * alpha * tan2 ) );
-}
-
-vec3 Fresnel_Schlick(float cosT, vec3 F0)
-{
-  return F0 + (1-F0) * pow(1 - cosT, 5);
-}
-
-vec3 specular(samplerCube SpecularEnvmap, vec3 normal, vec3 viewVector, float roughness, vec3 F0, out vec3 kS )
-{
-    vec3 reflectionVector = reflect(-viewVector, normal);
-    vec3 radiance = vec3(0, 0, 0);
-    float NoV = clamp(dot(normal, viewVector), 0.0, 1.0);
-    
-    
-    for(int i = 0; i < SamplesCount; ++i)
-    {
-        // Generate a sample vector in some local space
-
-        vec2 X = Hammersley(uint(i), uint(SamplesCount));
-        vec3 sampleVector = importanceSample(X, normal, roughness);
-
-        // Calculate the half vector
-
-        vec3 halfVector = normalize(sampleVector + viewVector);
-        float cosT = clamp(dot(sampleVector, normal), 0.0, 1.0);
-        float sinT = sqrt( 1 - cosT * cosT);
-
-        // Calculate fresnel
-        vec3 fresnel = Fresnel_Schlick(clamp(dot(halfVector, viewVector), 0.0, 1.0), F0 );
-
-        // Geometry term
-        float geometry = partialGeometry(viewVector, normal, halfVector, roughness) * partialGeometry(sampleVector, normal, halfVector, roughness);
-
-        // Calculate the Cook-Torrance denominator
-        float denominator = clamp( 4 * (NoV * clamp(dot(halfVector, normal), 0.0, 1.0) + 0.05), 0.0, 1.0)
-;
-        kS += fresnel;
-
-        // Accumulate the radiance
-        radiance += textureLod(prefilterMap, sampleVector, roughness * MAX_REFLECTION_LOD).rgb * geometry * fresnel / denominator;
-    }
-
-    // Scale back for the samples count
-    kS = clamp(kS / SamplesCount, 0.0, 1.0 );
-    return radiance / SamplesCount;        
-}
-
-void main()
-{  
-    
-    vec3 F0 = materialColor;
-    vec3 I = normalize(Position - cameraPos);
-    vec3 R = reflect(I, normalize(Normal));
-
-    F0 = mix(F0, materialColor, metallic);
-
-    vec3 ks = vec3(0, 0, 0);
-    vec3 partialGeometry = specular(prefilterMap, Normal, I, roughness, F0, ks);
-    vec3 kd = (1 - ks) * (1 - metallic);
-
-    vec3 irradiance = texture(irradianceMap, Normal).rgb;
-    vec3 diffuse = irradiance * materialColor;
-    
-    FragColor = vec4(partialGeometry, 1.0);
-}
-)HERE";
-
 const char* skyboxSourceVS = R"HERE(
 #version 330 core
 layout (location = 0) in vec3 position;
 
 out vec3 TexCoords;
 
-uniform mat4 projection;
-uniform mat4 view;
+layout(std140) uniform FrameUniforms
+{
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    vec4 cameraPosition;
+};
 
 void main()
 {
     TexCoords = position;
-    vec4 pos = projection * view * vec4(position, 1.0);
+    vec4 pos = projection * mat4(mat3(view)) * vec4(position, 1.0);
     gl_Position = pos.xyww;
 }  
 )HERE";
@@ -212,26 +70,24 @@ out vec4 FragColor;
 in vec3 TexCoords;
 
 uniform samplerCube skybox;
+uniform samplerCube skyboxNext;
+uniform float environmentBlend;
+uniform sampler2D skyboxOctahedral;
+uniform bool octahedralIBL;
+
+// octahedral maps, see Octahedral.h
+#include "octahedral.glsl"
 
 void main()
 {    
+    if (octahedralIBL)
+    {
+        FragColor = vec4(sampleOctahedral(skyboxOctahedral, normalize(TexCoords), 0.0, 0.0), 1.0);
+        return;
+    }
     FragColor = texture(skybox, TexCoords);
-}
-)HERE";
-
-const char* convertWorldVS = R"HERE(
-#version 330 core
-layout (location = 0) in vec3 position;
-
-out vec3 worldPosition;
-
-uniform mat4 projection;
-uniform mat4 view;
-
-void main()
-{
-    worldPosition = position;  
-    gl_Position =  projection * view * vec4(worldPosition, 1.0);
+    if (environmentBlend > 0.0)
+        FragColor = mix(FragColor, texture(skyboxNext, TexCoords), environmentBlend);
 }
 )HERE";
 
@@ -261,78 +117,6 @@ void main()
 }
 )HERE";
 
-const char* irradianceSourceVS = R"HERE(
-#version 330 core
-layout (location = 0) in vec3 position;
-
-out vec3 worldPosition;
-
-uniform mat4 projection;
-uniform mat4 view;
-
-void main()
-{
-    worldPosition = position;  
-    gl_Position =  projection * view * vec4(worldPosition, 1.0);
-}
-)HERE";
-
-const char* prefilterSourceVS = R"HERE(
-#version 330 core
-layout (location = 0) in vec3 position;
-
-out vec3 worldPosition;
-
-uniform mat4 projection;
-uniform mat4 view;
-
-void main()
-{
-    worldPosition = position;  
-    gl_Position =  projection * view * vec4(worldPosition, 1.0);
-}
-)HERE";
-
-const char* irradianceSourceFS = R"HERE(
-#version 330 core
-out vec4 FragColor;
-in vec3 worldPosition;
-
-uniform samplerCube environmentMap;
-
-const float pi = 3.1415926535;
-
-void main()
-{		
-    vec3 N = normalize(worldPosition);
-
-    vec3 irradiance = vec3(0.0);   
-    
-    vec3 up = vec3(0.0, 1.0, 0.0);
-    vec3 right = normalize(cross(up, N));
-    up = normalize(cross(N, right));
-       
-    float sampleDelta = 0.025;
-    float samples = 0.0f;
-    for(float phi = 0.0; phi < 2.0 * pi; phi += sampleDelta)
-    {
-        for(float theta = 0.0; theta < 0.5 * pi; theta += sampleDelta)
-        {
-            vec3 tangentSample = vec3(sin(theta) * cos(phi),  sin(theta) * sin(phi), cos(theta));
-
-            vec3 sampleVec = tangentSample.x * right + tangentSample.y * up + tangentSample.z * N; 
-
-            irradiance += texture(environmentMap, sampleVec).rgb * cos(theta) * sin(theta);
-            samples++;
-        }
-    }
-
-    irradiance = pi * irradiance * (1.0 / float(samples));
-    
-    FragColor = vec4(irradiance, 1.0);
-}
-)HERE";
-
 const char* prefilterSourceFS = R"HERE(
 #version 330 core
 out vec4 FragColor;
@@ -340,57 +124,18 @@ in vec3 worldPosition;
 
 uniform samplerCube environmentMap;
 uniform float roughness;
+uniform sampler1DArray ggxSamples;
+uniform int sampleCount;            // prefilterSampleCount for this mip
+uniform float sourceResolution;     // environment cubemap face size
+uniform float outputResolution;     // face size of the mip being written
 
 const float pi = 3.1415926535;
 
-float distribution(vec3 N, vec3 H, float roughness)
+// GGX half vectors around +Z, one layer per roughness bucket (SampleTables.h)
+int ggxBucket(float roughness)
 {
-    float a = roughness*roughness;
-    float aSquared = a*a;
-    float NdotH = max(dot(N, H), 0.0);
-    float NdotH_Squared = NdotH*NdotH;
-
-    float nom = aSquared;
-    float denom = (NdotH_Squared * (aSquared - 1.0) + 1.0);
-    denom = pi * denom * denom;
-
-    return nom / denom;
-}
-
-float radicalInverse(uint bits) 
-{
-     bits = (bits << 16u) | (bits >> 16u);
-     bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
-     bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
-     bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
-     bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
-     return float(bits) * 2.3283064365386963e-10; // / 0x100000000
-}
-
-vec2 Hammersley(uint i, uint N)
-{
-	return vec2(float(i)/float(N), radicalInverse(i));
-}
-
-vec3 importanceSample(vec2 X, vec3 N, float roughness)
-{
-	float a = roughness*roughness;
-	
-	float phi = 2.0 * pi * X.x;
-	float cosTheta = sqrt((1.0 - X.y) / (1.0 + (a*a - 1.0) * X.y));
-	float sinTheta = sqrt(1.0 - cosTheta*cosTheta);
-	
-	vec3 H;
-	H.x = cos(phi) * sinTheta;
-	H.y = sin(phi) * sinTheta;
-	H.z = cosTheta;
-	
-	vec3 up = abs(N.z) < 0.999 ? vec3(0.0, 0.0, 1.0) : vec3(1.0, 0.0, 0.0);
-	vec3 tangent = normalize(cross(up, N));
-	vec3 bitangent = cross(N, tangent);
-	
-	vec3 sampleVec = tangent * H.x + bitangent * H.y + N * H.z;
-	return normalize(sampleVec);
+    int buckets = textureSize(ggxSamples, 0).y;
+    return clamp(int(roughness * float(buckets - 1) + 0.5), 0, buckets - 1);
 }
 
 void main()
@@ -399,30 +144,33 @@ void main()
     vec3 R = N;
     vec3 V = R;
 
-    const uint SAMPLE_COUNT = 1024u;
     vec3 prefilteredColor = vec3(0.0);
     float weight = 0.0;
-    
-    for(uint i = 0u; i < SAMPLE_COUNT; ++i)
+
+    vec3 up = abs(N.z) < 0.999 ? vec3(0.0, 0.0, 1.0) : vec3(1.0, 0.0, 0.0);
+    vec3 tangent = normalize(cross(up, N));
+    vec3 bitangent = cross(N, tangent);
+    int bucket = ggxBucket(roughness);
+
+    // source mip per sample from its pdf, but never finer than the output texel
+    float saTexel = 4.0 * pi / (6.0 * sourceResolution * sourceResolution);
+    float outputLevel = log2(sourceResolution / outputResolution);
+
+    for(int i = 0; i < sampleCount; ++i)
     {
-        vec2 X = Hammersley(i, SAMPLE_COUNT);
-        vec3 H = importanceSample(X, N, roughness);
-        vec3 L  = normalize(2.0 * dot(V, H) * H - V);
+        // N = V, so NdotH = HdotV = h.z and the table's w is already D * NdotH / (4 * HdotV)
+        vec4 h = texelFetch(ggxSamples, ivec2(i, bucket), 0);
+        vec3 H = tangent * h.x + bitangent * h.y + N * h.z;
+        vec3 L  = 2.0 * h.z * H - V;
 
-        float NdotL = max(dot(N, L), 0.0);
+        float NdotL = 2.0 * h.z * h.z - 1.0;
         if(NdotL > 0.0)
         {
-            float D   = distribution(N, H, roughness);
-            float NdotH = max(dot(N, H), 0.0);
-            float HdotV = max(dot(H, V), 0.0);
-            float pdf = D * NdotH / (4.0 * HdotV) + 0.0001; 
+            float pdf = h.w + 0.0001;
+            float saSample = 1.0 / (float(sampleCount) * pdf + 0.0001);
 
-            float resolution = 512.0; // resolution of source cubemap (per face)
-            float saTexel  = 4.0 * pi / (6.0 * resolution * resolution);
-            float saSample = 1.0 / (float(SAMPLE_COUNT) * pdf + 0.0001);
+            float mipLevel = roughness == 0.0 ? outputLevel : max(0.5 * log2(saSample / saTexel), outputLevel);
 
-            float mipLevel = roughness == 0.0 ? 0.0 : 0.5 * log2(saSample / saTexel); 
-            
             prefilteredColor += textureLod(environmentMap, L, mipLevel).rgb * NdotL;
             weight      += NdotL;
         }
@@ -436,6 +184,19 @@ void main()
 
 const float pi = 3.1415926535f;
 int whichKeyPressed = 0;
+bool useSplitSum = true;   // B toggles the split-sum specular against the Monte Carlo loop
+bool environmentSwapRequested = false;   // N crossfades to the next HDR environment
+bool useOctahedralIBL = false;   // O samples octahedral 2D maps instead of the cubemaps
+const int QUALITY_LEVELS = 4;
+const int qualitySampleCounts[QUALITY_LEVELS] = { 16, 32, 64, 128 };
+int qualityLevel = 2;   // Q steps through the Monte Carlo sample counts of the models
+bool useDepthPrepass = true;   // Z toggles the depth-only pass in front of the model shading
+const int SPECULAR_SCALES = 3;
+const int specularScales[SPECULAR_SCALES] = { 1, 2, 4 };
+int specularScaleIndex = 0;   // H steps the specular IBL through full, half and quarter resolution
+bool useBilateralUpsample = true;   // U toggles the joint bilateral upsample against plain bilinear
+bool useTemporalAccumulation = false;   // T rotates the Monte Carlo samples per frame and accumulates them
+const int TEMPORAL_SAMPLES_COUNT = 4;   // model samples per frame with accumulation on
 float elevation = pi / 2.0f;
 float phi = pi / 2.0f;
 float deltaTime = 0.0f;
@@ -470,6 +231,48 @@ static void key_callback(GLFWwindow* window, int key, int keycode, int action, i
         whichKeyPressed = 2;
     }
 
+    if (key == GLFW_KEY_B && action == GLFW_PRESS) {
+        useSplitSum = !useSplitSum;
+        std::cout << "Specular IBL: " << (useSplitSum ? "split-sum BRDF LUT" : "Monte Carlo") << std::endl;
+    }
+
+    if (key == GLFW_KEY_N && action == GLFW_PRESS) {
+        environmentSwapRequested = true;
+    }
+
+    if (key == GLFW_KEY_O && action == GLFW_PRESS) {
+        useOctahedralIBL = !useOctahedralIBL;
+        std::cout << "IBL maps: " << (useOctahedralIBL ? "octahedral" : "cubemap") << std::endl;
+    }
+
+    if (key == GLFW_KEY_Z && action == GLFW_PRESS) {
+        useDepthPrepass = !useDepthPrepass;
+        std::cout << "Depth pre-pass: " << (useDepthPrepass ? "on" : "off") << std::endl;
+    }
+
+    if (key == GLFW_KEY_H && action == GLFW_PRESS) {
+        specularScaleIndex = (specularScaleIndex + 1) % SPECULAR_SCALES;
+        std::cout << "Specular IBL resolution: 1/" << specularScales[specularScaleIndex] << std::endl;
+    }
+
+    if (key == GLFW_KEY_U && action == GLFW_PRESS) {
+        useBilateralUpsample = !useBilateralUpsample;
+        std::cout << "Specular upsample: " << (useBilateralUpsample ? "joint bilateral" : "bilinear") << std::endl;
+    }
+
+    if (key == GLFW_KEY_T && action == GLFW_PRESS) {
+        useTemporalAccumulation = !useTemporalAccumulation;
+        std::cout << "Temporal accumulation: " << (useTemporalAccumulation ? "on" : "off");
+        if (useTemporalAccumulation && useSplitSum)
+            std::cout << " (B selects the Monte Carlo loop it accumulates)";
+        std::cout << std::endl;
+    }
+
+    if (key == GLFW_KEY_Q && action == GLFW_PRESS) {
+        qualityLevel = (qualityLevel + 1) % QUALITY_LEVELS;
+        std::cout << "Monte Carlo samples: " << qualitySampleCounts[qualityLevel] << std::endl;
+    }
+
     if (key == GLFW_KEY_S && action == GLFW_PRESS && elevation < degreesToRadians(179)) {
         ep = true;
     }
@@ -520,8 +323,20 @@ static void key_callback(GLFWwindow* window, int key, int keycode, int action, i
 
 }
 
-int main(void)
+int main(int argc, char** argv)
 {
+    // --gpu-bake skips the .ibl cache and bakes the IBL maps on the GPU every launch, with
+    // compute shaders where GL 4.3 is there; --capture-bake forces the layered capture passes.
+    // --octahedral-report compares the octahedral maps against the cubemaps at startup
+    bool gpuBakeFlag = false, captureBakeFlag = false, octahedralReportFlag = false;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string flag = argv[i];
+        gpuBakeFlag |= flag == "--gpu-bake";
+        captureBakeFlag |= flag == "--capture-bake";
+        octahedralReportFlag |= flag == "--octahedral-report";
+    }
+
     glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT);
 
@@ -551,441 +366,284 @@ int main(void)
 
     glfwSetKeyCallback(window, key_callback);
 
-    Shader shader("shader.vs", "shader.vs");
-
-    unsigned int shaderObjVS = glCreateShader(GL_VERTEX_SHADER);
-    int vertexLength = (int)strlen(srcVS);
-    glShaderSource(shaderObjVS, 1, &srcVS, &vertexLength);
-    glCompileShader(shaderObjVS);
-
-    // Check for errors.
-    int vertexSuccess;
-    glGetShaderiv(shaderObjVS, GL_COMPILE_STATUS, &vertexSuccess);
-    if (vertexSuccess == GL_FALSE) {
-        char message[1024];
-        glGetShaderInfoLog(shaderObjVS, sizeof(message), NULL, message);
-        std::cout << "Failed to compile: Vertex Shader" << std::endl;
-        std::cout << message << std::endl;
-        glDeleteShader(shaderObjVS);
-    }
-
-    unsigned int shaderObjFS = glCreateShader(GL_FRAGMENT_SHADER);
-    int fragmentLength = (int)strlen(srcFS);
-    glShaderSource(shaderObjFS, 1, &srcFS, &fragmentLength);
-    glCompileShader(shaderObjFS);
-
-    // Check for errors.
-    int fragmentSuccess;
-    glGetShaderiv(shaderObjFS, GL_COMPILE_STATUS, &fragmentSuccess);
-    if (fragmentSuccess == GL_FALSE) {
-        char message[1024];
-        glGetShaderInfoLog(shaderObjFS, sizeof(message), NULL, message);
-        std::cout << "Failed to compile: Fragment Shader" << std::endl;
-        std::cout << message << std::endl;
-        glDeleteShader(shaderObjFS);
-    }
-
-    unsigned int ShaderProgram = glCreateProgram();
-    glAttachShader(ShaderProgram, shaderObjVS);
-    glAttachShader(ShaderProgram, shaderObjFS);
-    glLinkProgram(ShaderProgram);
-
-    // Check for errors.
-    int shaderSuccess;
-    glGetProgramiv(ShaderProgram, GL_LINK_STATUS, &shaderSuccess);
-    if (shaderSuccess == GL_FALSE) {
-        char message[1024];
-        glGetProgramInfoLog(ShaderProgram,
-            sizeof(message), NULL, message);
-        std::cout << "Failed to link shaders:"
-            << std::endl;
-        std::cout << message << std::endl;
-    }
-
-    glValidateProgram(ShaderProgram);
-
-    unsigned int skyboxSourceObjVS = glCreateShader(GL_VERTEX_SHADER);
-    int skyVertexLength = (int)strlen(skyboxSourceVS);
-    glShaderSource(skyboxSourceObjVS, 1, &skyboxSourceVS, &skyVertexLength);
-    glCompileShader(skyboxSourceObjVS);
-
-    // Check for errors.
-    int skyVertexSuccess;
-    glGetShaderiv(skyboxSourceObjVS, GL_COMPILE_STATUS, &skyVertexSuccess);
-    if (skyVertexSuccess == GL_FALSE) {
-        char message[1024];
-        glGetShaderInfoLog(skyboxSourceObjVS, sizeof(message), NULL, message);
-        std::cout << "Failed to compile: Vertex Shader" << std::endl;
-        std::cout << message << std::endl;
-        glDeleteShader(skyboxSourceObjVS);
-    }
-
-    unsigned int skyboxSourceObjFS = glCreateShader(GL_FRAGMENT_SHADER);
-    int skyFragmentLength = (int)strlen(skyboxSourceFS);
-    glShaderSource(skyboxSourceObjFS, 1, &skyboxSourceFS, &skyFragmentLength);
-    glCompileShader(skyboxSourceObjFS);
-
-    // Check for errors.
-    int skyFragmentSuccess;
-    glGetShaderiv(skyboxSourceObjFS, GL_COMPILE_STATUS, &skyFragmentSuccess);
-    if (skyFragmentSuccess == GL_FALSE) {
-        char message[1024];
-        glGetShaderInfoLog(skyboxSourceObjFS, sizeof(message), NULL, message);
-        std::cout << "Failed to compile: Fragment Shader" << std::endl;
-        std::cout << message << std::endl;
-        glDeleteShader(skyboxSourceObjFS);
-    }
-
-    unsigned int skyShaderProgram = glCreateProgram();
-    glAttachShader(skyShaderProgram, skyboxSourceObjVS);
-    glAttachShader(skyShaderProgram, skyboxSourceObjFS);
-    glLinkProgram(skyShaderProgram);
-
-    // Check for errors.
-    int skyShaderSuccess;
-    glGetProgramiv(skyShaderProgram, GL_LINK_STATUS, &skyShaderSuccess);
-    if (skyShaderSuccess == GL_FALSE) {
-        char message[1024];
-        glGetProgramInfoLog(skyShaderProgram,
-            sizeof(message), NULL, message);
-        std::cout << "Failed to link shaders:"
-            << std::endl;
-        std::cout << message << std::endl;
-    }
-
-    glValidateProgram(skyShaderProgram);
-
-    unsigned int convertWorldObjVS = glCreateShader(GL_VERTEX_SHADER);
-    int skyConvertVertexLength = (int)strlen(convertWorldVS);
-    glShaderSource(convertWorldObjVS, 1, &convertWorldVS, &skyConvertVertexLength);
-    glCompileShader(convertWorldObjVS);
-
-    // Check for errors.
-    int skyConvertVertexSuccess;
-    glGetShaderiv(convertWorldObjVS, GL_COMPILE_STATUS, &skyConvertVertexSuccess);
-    if (skyConvertVertexSuccess == GL_FALSE) {
-        char message[1024];
-        glGetShaderInfoLog(convertWorldObjVS, sizeof(message), NULL, message);
-        std::cout << "Failed to compile: Vertex Shader" << std::endl;
-        std::cout << message << std::endl;
-        glDeleteShader(convertWorldObjVS);
-    }
-
-    unsigned int convertWorldObjFS = glCreateShader(GL_FRAGMENT_SHADER);
-    int skyConvertFragmentLength = (int)strlen(convertWorldFS);
-    glShaderSource(convertWorldObjFS, 1, &convertWorldFS, &skyConvertFragmentLength);
-    glCompileShader(convertWorldObjFS);
-
-    // Check for errors.
-    int skyConvertFragmentSuccess;
-    glGetShaderiv(convertWorldObjFS, GL_COMPILE_STATUS, &skyConvertFragmentSuccess);
-    if (skyConvertFragmentSuccess == GL_FALSE) {
-        char message[1024];
-        glGetShaderInfoLog(convertWorldObjFS, sizeof(message), NULL, message);
-        std::cout << "Failed to compile: Fragment Shader" << std::endl;
-        std::cout << message << std::endl;
-        glDeleteShader(convertWorldObjFS);
-    }
-
-    unsigned int convertShaderProgram = glCreateProgram();
-    glAttachShader(convertShaderProgram, convertWorldObjVS);
-    glAttachShader(convertShaderProgram, convertWorldObjFS);
-    glLinkProgram(convertShaderProgram);
-    int skyConvertShaderSuccess;
-    glGetProgramiv(convertShaderProgram, GL_LINK_STATUS, &skyConvertShaderSuccess);
-    if (skyConvertShaderSuccess == GL_FALSE) {
-        char message[1024];
-        glGetProgramInfoLog(convertShaderProgram,
-            sizeof(message), NULL, message);
-        std::cout << "Failed to link shaders:"
-            << std::endl;
-        std::cout << message << std::endl;
-    }
-
-    glValidateProgram(convertShaderProgram);
-
-    unsigned int irradianceSourceObjVS = glCreateShader(GL_VERTEX_SHADER);
-    int skyIrradianceVertexLength = (int)strlen(irradianceSourceVS);
-    glShaderSource(irradianceSourceObjVS, 1, &irradianceSourceVS, &skyIrradianceVertexLength);
-    glCompileShader(irradianceSourceObjVS);
-
-    // Check for errors.
-    int skyIrradianceVertexSuccess;
-    glGetShaderiv(irradianceSourceObjVS, GL_COMPILE_STATUS, &skyIrradianceVertexSuccess);
-    if (skyIrradianceVertexSuccess == GL_FALSE) {
-        char message[1024];
-        glGetShaderInfoLog(irradianceSourceObjVS, sizeof(message), NULL, message);
-        std::cout << "Failed to compile: Vertex Shader" << std::endl;
-        std::cout << message << std::endl;
-        glDeleteShader(irradianceSourceObjVS);
-    }
-
-    unsigned int irradianceSourceObjFS = glCreateShader(GL_FRAGMENT_SHADER);
-    int skyIrradianceFragmentLength = (int)strlen(irradianceSourceFS);
-    glShaderSource(irradianceSourceObjFS, 1, &irradianceSourceFS, &skyIrradianceFragmentLength);
-    glCompileShader(irradianceSourceObjFS);
-
-    // Check for errors.
-    int skyIrradianceFragmentSuccess;
-    glGetShaderiv(irradianceSourceObjFS, GL_COMPILE_STATUS, &skyIrradianceFragmentSuccess);
-    if (skyIrradianceFragmentSuccess == GL_FALSE) {
-        char message[1024];
-        glGetShaderInfoLog(irradianceSourceObjFS, sizeof(message), NULL, message);
-        std::cout << "Failed to compile: Fragment Shader" << std::endl;
-        std::cout << message << std::endl;
-        glDeleteShader(irradianceSourceObjFS);
-    }
-
-    unsigned int irradianceShaderProgram = glCreateProgram();
-    glAttachShader(irradianceShaderProgram, irradianceSourceObjVS);
-    glAttachShader(irradianceShaderProgram, irradianceSourceObjFS);
-    glLinkProgram(irradianceShaderProgram);
-
-    // Check for errors.
-    int skyIrradianceShaderSuccess;
-    glGetProgramiv(irradianceShaderProgram, GL_LINK_STATUS, &skyIrradianceShaderSuccess);
-    if (skyIrradianceShaderSuccess == GL_FALSE) {
-        char message[1024];
-        glGetProgramInfoLog(irradianceShaderProgram,
-            sizeof(message), NULL, message);
-        std::cout << "Failed to link shaders:"
-            << std::endl;
-        std::cout << message << std::endl;
-    }
-
-    glValidateProgram(irradianceShaderProgram);
-
-    unsigned int prefilterSourceObjVS = glCreateShader(GL_VERTEX_SHADER);
-    int skyPrefilterVertexLength = (int)strlen(prefilterSourceVS);
-    glShaderSource(prefilterSourceObjVS, 1, &prefilterSourceVS, &skyPrefilterVertexLength);
-    glCompileShader(prefilterSourceObjVS);
-
-    // Check for errors.
-    int skyPrefilterVertexSuccess;
-    glGetShaderiv(prefilterSourceObjVS, GL_COMPILE_STATUS, &skyPrefilterVertexSuccess);
-    if (skyPrefilterVertexSuccess == GL_FALSE) {
-        char message[1024];
-        glGetShaderInfoLog(prefilterSourceObjVS, sizeof(message), NULL, message);
-        std::cout << "Failed to compile: Vertex Shader" << std::endl;
-        std::cout << message << std::endl;
-        glDeleteShader(prefilterSourceObjVS);
-    }
-
-    unsigned int prefilterSourceObjFS = glCreateShader(GL_FRAGMENT_SHADER);
-    int skyPrefilterFragmentLength = (int)strlen(prefilterSourceFS);
-    glShaderSource(prefilterSourceObjFS, 1, &prefilterSourceFS, &skyPrefilterFragmentLength);
-    glCompileShader(prefilterSourceObjFS);
-
-    // Check for errors.
-    int skyPrefilterFragmentSuccess;
-    glGetShaderiv(prefilterSourceObjFS, GL_COMPILE_STATUS, &skyPrefilterFragmentSuccess);
-    if (skyPrefilterFragmentSuccess == GL_FALSE) {
-        char message[1024];
-        glGetShaderInfoLog(prefilterSourceObjFS, sizeof(message), NULL, message);
-        std::cout << "Failed to compile: Fragment Shader" << std::endl;
-        std::cout << message << std::endl;
-        glDeleteShader(prefilterSourceObjFS);
-    }
-
-    unsigned int skyPrefilterShaderProgram = glCreateProgram();
-    glAttachShader(skyPrefilterShaderProgram, prefilterSourceObjVS);
-    glAttachShader(skyPrefilterShaderProgram, prefilterSourceObjFS);
-    glLinkProgram(skyPrefilterShaderProgram);
-
-    // Check for errors.
-    int skyPrefilterShaderSuccess;
-    glGetProgramiv(skyPrefilterShaderProgram, GL_LINK_STATUS, &skyPrefilterShaderSuccess);
-    if (skyPrefilterShaderSuccess == GL_FALSE) {
-        char message[1024];
-        glGetProgramInfoLog(skyPrefilterShaderProgram,
-            sizeof(message), NULL, message);
-        std::cout << "Failed to link shaders:"
-            << std::endl;
-        std::cout << message << std::endl;
-    }
+    // linked binaries from earlier launches, see ProgramCache.h
+    ProgramCache programCache("assignment7.programs");
+    programCache.addInclude("octahedral.glsl", OCTAHEDRAL_GLSL);
+    programCache.addInclude("packed_texture.glsl", PACKED_TEXTURE_GLSL);
+
+    // The skybox and IBL capture programs are submitted here and picked up by name where
+    // they are first used, so the driver compiles them while the IBL maps and models load
+    // (ShaderLibrary.h). Capture programs render all six cubemap faces per draw (LayeredCapture.h).
+    ShaderLibrary shaderLibrary(programCache);
+    shaderLibrary.add("skybox", { { GL_VERTEX_SHADER, skyboxSourceVS }, { GL_FRAGMENT_SHADER, skyboxSourceFS } }, "", [](GLuint program) {
+        glUseProgram(program);
+        glUniform1i(glGetUniformLocation(program, "skybox"), 0);
+        glUniform1i(glGetUniformLocation(program, "skyboxNext"), 3);
+        glUniform1i(glGetUniformLocation(program, "skyboxOctahedral"), 5);
+        bindFrameUniformBlocks(program);
+    });
+    shaderLibrary.add("convert", captureProgramStages(convertWorldFS), "", uploadCaptureViews);
+    shaderLibrary.add("depth", depthPrepassStages(), "", bindFrameUniformBlocks);
+    shaderLibrary.add("prefilter", captureProgramStages(prefilterSourceFS), "", uploadCaptureViews);
+    shaderLibrary.add("temporal", temporalResolveStages(), "", configureTemporalResolveProgram);
+    shaderLibrary.add("octahedral", octahedralBakeStages(), "", configureOctahedralBakeProgram);
+    if (octahedralReportFlag)
+        shaderLibrary.add("octahedral lookup", octahedralLookupStages(), "", configureOctahedralLookupProgram);
+
+    // The models are drawn with shader.vs/shader.fs, specialised per sample count and
+    // material (ShaderPermutations.h). Sampler units and uniform blocks are set again for
+    // every permutation and whenever the files are reloaded.
+    auto configureFileProgram = [](GLuint program) {
+        glUseProgram(program);
+        glUniform1i(glGetUniformLocation(program, "reducedSpecular"), REDUCED_SPECULAR_UNIT);
+        glUniform1i(glGetUniformLocation(program, "reducedNormalDepth"), REDUCED_NORMAL_DEPTH_UNIT);
+        glUniform1i(glGetUniformLocation(program, "texture_atlas"), TEXTURE_ATLAS_UNIT);
+        bindSH9IrradianceBlock(program);
+        bindFrameUniformBlocks(program);
+    };
+    ShaderPermutations modelPermutations("shader.vs", readShaderStages("shader.vs", "shader.fs"), programCache, configureFileProgram);
 
-    glValidateProgram(skyPrefilterShaderProgram);
+    // edits to shader.vs/shader.fs are rebuilt in the background and swapped in between frames
+    ShaderHotReload shaderReload(programCache);
+    shaderReload.watch(modelPermutations, "shader.vs", "shader.fs");
+    if (shaderReload.start())
+        std::cout << "Shader hot reload: watching shader.vs and shader.fs" << std::endl;
+    std::cout << "Cubemap capture: one instanced draw per level, gl_Layer from the "
+              << (captureUsesViewportLayer() ? "vertex" : "geometry") << " shader" << std::endl;
 
     glEnable(GL_DEPTH_TEST);
     glDepthFunc(GL_LEQUAL);
     glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
     glEnable(GL_FRAMEBUFFER_SRGB);
 
+    // color only: cubemap levels are attached layered, see LayeredCapture.h
     unsigned int capFBO;
-    unsigned int captureRBO;
     glGenFramebuffers(1, &capFBO);
-    glGenRenderbuffers(1, &captureRBO);
-
-    glBindFramebuffer(GL_FRAMEBUFFER, capFBO);
-    glBindRenderbuffer(GL_RENDERBUFFER, captureRBO);
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, 1024, 1024);
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, captureRBO);
 
+    // Storage format of each IBL target. RGB32F everywhere costs ~100 MB for the
+    // environment cubemap alone; the packed formats cut that 2-3x.
+    HDRStorage sourceStorage = HDRStorage::RGB9E5;
+    HDRStorage environmentStorage = HDRStorage::R11G11B10F;
+    HDRStorage prefilterStorage = HDRStorage::RGB16F;
+
+    HDRGLFormat environmentFormat = hdrRenderFormat(environmentStorage);
+    HDRGLFormat prefilterFormat = hdrRenderFormat(prefilterStorage);
+
+    // The IBL products come from the .ibl cache next to the HDR; a missing or stale cache is
+    // baked on the CPU (IBLBaker.h) and written back. --gpu-bake and --capture-bake run the
+    // shader bake below instead and print how long it took.
+    const bool bakeIBLOnGPU = gpuBakeFlag || captureBakeFlag;
+    const bool bakeIBLWithCompute = bakeIBLOnGPU && !captureBakeFlag && ComputeIBLBaker::supported();
+    // the models loaded below go through stb_image and expect bottom-up rows
     stbi_set_flip_vertically_on_load(true);
-    int HDRWidth, HDRHeight, HDRComps;
-    float* HDR_Data = stbi_loadf("glacier.hdr", &HDRWidth, &HDRHeight, &HDRComps, 0);
-    unsigned int hdrTexture;
-
-    if (HDR_Data != NULL)
-    {
-        glGenTextures(1, &hdrTexture);
-        glBindTexture(GL_TEXTURE_2D, hdrTexture);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB32F, HDRWidth, HDRHeight, 0, GL_RGB, GL_FLOAT, HDR_Data);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(HDR_Data);
-    }
-    else {
-        std::cout << "Failed to load HDR image." << std::endl;
-    }
-
-    printf("%d %d\n", HDRWidth, HDRHeight);
+    IBLBakeSettings iblSettings;
+    iblSettings.environmentStorage = hdrRenderStorage(environmentStorage);
+    iblSettings.prefilterStorage = hdrRenderStorage(prefilterStorage);
+    IBLProducts iblProducts;
+
+    // GGX half vectors per roughness bucket, shared by the bake shaders and the SamplesCount
+    // loops. Bound once; nothing else uses the unit.
+    SampleTable sampleTable = buildSampleTable(iblSettings.prefilterSamples);
+    unsigned int sampleTableTexture = uploadSampleTable(sampleTable);
+    glActiveTexture(GL_TEXTURE0 + SAMPLE_TABLE_UNIT);
+    glBindTexture(GL_TEXTURE_1D_ARRAY, sampleTableTexture);
+    glActiveTexture(GL_TEXTURE0);
 
     unsigned int environmentCubmap;
-    glGenTextures(1, &environmentCubmap);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, environmentCubmap);
-
-    for (unsigned int i = 0; i < 6; ++i)
+    SH9Color irradianceSH;
+    unsigned int prefilterMap;
+    unsigned int brdfLUTTexture = 0;
+    if (!bakeIBLOnGPU && loadOrBakeIBL("glacier.hdr", "glacier.ibl", iblSettings, iblProducts))
     {
-        glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB32F, 1024, 1024, 0, GL_RGB, GL_FLOAT, nullptr);
+        environmentCubmap = uploadPackedCubemap(iblProducts.environment);
+        irradianceSH = iblProducts.irradianceSH;
+        prefilterMap = uploadPackedCubemap(iblProducts.prefilter);
+        brdfLUTTexture = uploadBRDFLUT(iblProducts);
     }
-
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-
-    glm::mat4 captureProjection = glm::perspective(glm::radians(90.0f), 1.0f, 0.1f, 10.0f);
-
-    glm::mat4 captureViews[] =
+    else
     {
-        glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(1.0f,  0.0f,  0.0f), glm::vec3(0.0f, -1.0f,  0.0f)),
-        glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(-1.0f,  0.0f,  0.0f), glm::vec3(0.0f, -1.0f,  0.0f)),
-        glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f,  1.0f,  0.0f), glm::vec3(0.0f,  0.0f,  1.0f)),
-        glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, -1.0f,  0.0f), glm::vec3(0.0f,  0.0f, -1.0f)),
-        glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f,  0.0f,  1.0f), glm::vec3(0.0f, -1.0f,  0.0f)),
-        glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f,  0.0f, -1.0f), glm::vec3(0.0f, -1.0f,  0.0f))
-    };
-
-
-    glUseProgram(convertShaderProgram);
-    glUniform1i(glGetUniformLocation(convertShaderProgram, "recMap"), 0);
-    int convertProjectionLocation = glGetUniformLocation(convertShaderProgram, "projection");
-    glUniformMatrix4fv(convertProjectionLocation, 1, GL_FALSE, &captureProjection[0][0]);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, hdrTexture);
-
-    glViewport(0, 0, 1024, 1024);
-    glBindFramebuffer(GL_FRAMEBUFFER, capFBO);
-
-    for (unsigned int i = 0; i < 6; ++i)
-    {
-        int convertViewLocation = glGetUniformLocation(convertShaderProgram, "view");
-        glUniformMatrix4fv(convertViewLocation, 1, GL_FALSE, &captureViews[i][0][0]);
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, environmentCubmap, 0);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        renderCube();
+        // RGBE decodes straight into the RGB9E5 upload format; flip on to also decode a float
+        // copy and print how much the packed source loses against it
+        const bool reportSourceError = false;
+        RadianceHDRImage hdrImage;
+        int HDRWidth = 0, HDRHeight = 0;
+        unsigned int hdrTexture;
+
+        if (loadRadianceHDR("glacier.hdr", sourceStorage, hdrImage))
+        {
+            HDRWidth = hdrImage.width;
+            HDRHeight = hdrImage.height;
+            // float copy for the SH9 projection (and the optional error report); the compute
+            // bake projects the cubemap on the GPU instead
+            RadianceHDRImage referenceImage;
+            if ((!bakeIBLWithCompute || reportSourceError) && loadRadianceHDR("glacier.hdr", HDRStorage::RGB32F, referenceImage))
+                irradianceSH = projectSH9Equirect(referenceImage.floats(), HDRWidth, HDRHeight);
+            if (reportSourceError && !referenceImage.pixels.empty())
+            {
+                size_t texelCount = static_cast<size_t>(HDRWidth) * HDRHeight;
+                printHDRErrorReport("glacier.hdr", sourceStorage, measureHDRError(referenceImage.floats(), hdrImage.pixels.data(), texelCount, sourceStorage));
+            }
 
-    }
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            HDRGLFormat sourceFormat = hdrGLFormat(sourceStorage);
+            glGenTextures(1, &hdrTexture);
+            glBindTexture(GL_TEXTURE_2D, hdrTexture);
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+            glTexImage2D(GL_TEXTURE_2D, 0, sourceFormat.internalFormat, HDRWidth, HDRHeight, 0, sourceFormat.format, sourceFormat.type, hdrImage.pixels.data());
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        }
+        else {
+            std::cout << "Failed to load HDR image." << std::endl;
+        }
 
-    glBindTexture(GL_TEXTURE_CUBE_MAP, environmentCubmap);
-    glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
+        printf("%d %d\n", HDRWidth, HDRHeight);
 
-    unsigned int irradianceMap;
-    glGenTextures(1, &irradianceMap);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, irradianceMap);
+        glFinish();
+        auto gpuBakeStart = std::chrono::steady_clock::now();
+        if (bakeIBLWithCompute)
+        {
+            ComputeIBLBaker computeBaker(environmentStorage, prefilterStorage);
+            environmentCubmap = computeBaker.bakeEnvironment(hdrTexture, 1024);
+            irradianceSH = computeBaker.projectIrradiance(environmentCubmap, 1024);
+            prefilterMap = computeBaker.bakePrefilter(environmentCubmap, 1024, 128, 5, iblSettings.prefilterSamples, iblSettings.prefilterSampleDensity);
+            computeBaker.printTimings();
+        }
+        else
+        {
+            glGenTextures(1, &environmentCubmap);
+            glBindTexture(GL_TEXTURE_CUBE_MAP, environmentCubmap);
 
-    for (unsigned int i = 0; i < 6; ++i)
-    {
-        glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB32F, 32, 32, 0, GL_RGB, GL_FLOAT, nullptr);
-    }
+            for (unsigned int i = 0; i < 6; ++i)
+            {
+                glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, environmentFormat.internalFormat, 1024, 1024, 0, environmentFormat.format, environmentFormat.type, nullptr);
+            }
 
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-    glBindFramebuffer(GL_FRAMEBUFFER, capFBO);
-    glBindRenderbuffer(GL_RENDERBUFFER, captureRBO);
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, 32, 32);
 
-    glUseProgram(irradianceShaderProgram);
-    glUniform1i(glGetUniformLocation(irradianceShaderProgram, "environmentMap"), 0);
-    int convertIrradianceProjectionLocation = glGetUniformLocation(irradianceShaderProgram, "projection");
-    glUniformMatrix4fv(convertIrradianceProjectionLocation, 1, GL_FALSE, &captureProjection[0][0]);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, environmentCubmap);
+            unsigned int convertShaderProgram = shaderLibrary.get("convert");
+            glUseProgram(convertShaderProgram);
+            glUniform1i(glGetUniformLocation(convertShaderProgram, "recMap"), 0);
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, hdrTexture);
 
-    glViewport(0, 0, 32, 32);
-    glBindFramebuffer(GL_FRAMEBUFFER, capFBO);
-    for (unsigned int i = 0; i < 6; ++i)
-    {
-        int convertIrradianceViewLocation = glGetUniformLocation(irradianceShaderProgram, "view");
-        glUniformMatrix4fv(convertIrradianceViewLocation, 1, GL_FALSE, &captureViews[i][0][0]);
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, irradianceMap, 0);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            captureCubemapLevel(capFBO, environmentCubmap, 0, 1024, renderCube);
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
-        renderCube();
-    }
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            glBindTexture(GL_TEXTURE_CUBE_MAP, environmentCubmap);
+            glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
 
+            glGenTextures(1, &prefilterMap);
+            glBindTexture(GL_TEXTURE_CUBE_MAP, prefilterMap);
 
-    unsigned int prefilterMap;
-    glGenTextures(1, &prefilterMap);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, prefilterMap);
+            for (unsigned int i = 0; i < 6; ++i)
+            {
+                glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, prefilterFormat.internalFormat, 128, 128, 0, prefilterFormat.format, prefilterFormat.type, nullptr);
+            }
 
-    for (unsigned int i = 0; i < 6; ++i)
-    {
-        glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB32F, 128, 128, 0, GL_RGB, GL_FLOAT, nullptr);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
+
+            unsigned int skyPrefilterShaderProgram = shaderLibrary.get("prefilter");
+            glUseProgram(skyPrefilterShaderProgram);
+            glUniform1i(glGetUniformLocation(skyPrefilterShaderProgram, "environmentMap"), 0);
+            glUniform1i(glGetUniformLocation(skyPrefilterShaderProgram, "ggxSamples"), SAMPLE_TABLE_UNIT);
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_CUBE_MAP, environmentCubmap);
+
+            unsigned int maxMipLevels = 5;
+            int roughnessLocation = glGetUniformLocation(skyPrefilterShaderProgram, "roughness");
+            glUniform1f(glGetUniformLocation(skyPrefilterShaderProgram, "sourceResolution"), 1024.0f);
+            for (unsigned int mip = 0; mip < maxMipLevels; ++mip)
+            {
+                unsigned int mipSize = 128 >> mip;
+                float roughness = (float)mip / (float)(maxMipLevels - 1);
+                glUniform1f(roughnessLocation, roughness);
+                glUniform1f(glGetUniformLocation(skyPrefilterShaderProgram, "outputResolution"), (float)mipSize);
+                glUniform1i(glGetUniformLocation(skyPrefilterShaderProgram, "sampleCount"),
+                            prefilterSampleCount(roughness, mipSize, sampleTable.count, iblSettings.prefilterSampleDensity));
+                captureCubemapLevel(capFBO, prefilterMap, mip, mipSize, renderCube);
+            }
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        }
+        glFinish();
+        std::cout << "IBL GPU bake (" << (bakeIBLWithCompute ? "compute" : "layered capture") << "): "
+                  << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - gpuBakeStart).count()
+                  << " ms" << std::endl;
+
+        // the split-sum LUT does not depend on the environment; bake it on the CPU
+        packBRDFLUT(bakeBRDFLUT(iblSettings.brdfLUTSize, iblSettings.brdfLUTSamples), iblSettings.brdfLUTSize, iblProducts);
+        brdfLUTTexture = uploadBRDFLUT(iblProducts);
     }
 
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
-
-    glUseProgram(skyPrefilterShaderProgram);
-    glUniform1i(glGetUniformLocation(skyPrefilterShaderProgram, "environmentMap"), 0);
-    int convertPrefilterProjectionLocation = glGetUniformLocation(skyPrefilterShaderProgram, "projection");
-    glUniformMatrix4fv(convertPrefilterProjectionLocation, 1, GL_FALSE, &captureProjection[0][0]);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, environmentCubmap);
-
-    glBindFramebuffer(GL_FRAMEBUFFER, capFBO);
-    unsigned int maxMipLevels = 5;
-    for (unsigned int mip = 0; mip < maxMipLevels; ++mip)
+    // the compute bake stores RGB targets as RGBA, see computeStorageFormat
+    size_t iblBytes = bakeIBLWithCompute ? computeCubemapBytes(environmentStorage, 1024, 11) + computeCubemapBytes(prefilterStorage, 128, 5)
+                                         : hdrCubemapBytes(hdrRenderStorage(environmentStorage), 1024, 11) +
+                                               hdrCubemapBytes(hdrRenderStorage(prefilterStorage), 128, 5);
+    size_t iblReferenceBytes = hdrCubemapBytes(HDRStorage::RGB32F, 1024, 11) + hdrCubemapBytes(HDRStorage::RGB32F, 128, 5);
+    std::cout << "IBL cubemaps: " << iblBytes / (1024.0 * 1024.0) << " MB (RGB32F " << iblReferenceBytes / (1024.0 * 1024.0) << " MB)" << std::endl;
+
+    // diffuse irradiance is 9 SH coefficients in a uniform block instead of a cubemap.
+    // The manager owns the startup maps from here on and swaps in the ones from N.
+    EnvironmentManager environments(iblSettings);
+    EnvironmentMaps startupMaps;
+    startupMaps.environment = environmentCubmap;
+    startupMaps.prefilter = prefilterMap;
+    startupMaps.irradianceSH = irradianceSH;
+    environments.adopt(startupMaps);
+    const char* environmentPaths[] = { "glacier.hdr", "singaporecity.hdr" };
+    int environmentIndex = 0;
+
+    // Octahedral copies of the current maps, baked from the cubemaps with one draw per level
+    // the first time O is pressed and again after an environment swap
+    OctahedralBaker octahedralBaker;
+    unsigned int octahedralEnvironment = 0;
+    unsigned int octahedralPrefilter = 0;
+    unsigned int octahedralGeneration = 0;   // environments.generation() they were baked from, 0 for none
+    int octahedralEnvironmentLevels = 0;
+    int octahedralPrefilterLevels = 0;
+    const int environmentMips = static_cast<int>(std::log2(iblSettings.environmentSize)) + 1;
+    auto bakeOctahedralMaps = [&]() {
+        glDeleteTextures(1, &octahedralEnvironment);
+        glDeleteTextures(1, &octahedralPrefilter);
+        GLuint program = shaderLibrary.get("octahedral");
+        octahedralEnvironment = octahedralBaker.bake(program, environments.current().environment, iblSettings.environmentSize,
+                                                     environmentMips, iblSettings.environmentStorage, &octahedralEnvironmentLevels);
+        octahedralPrefilter = octahedralBaker.bake(program, environments.current().prefilter, iblSettings.prefilterSize,
+                                                   iblSettings.prefilterMips, iblSettings.prefilterStorage, &octahedralPrefilterLevels);
+        octahedralGeneration = environments.generation();
+    };
+    // reads both layouts back from whichever bake made them, compares them on the CPU and
+    // times a trilinear lookup from each on the GPU
+    if (octahedralReportFlag)
     {
-        unsigned int mipWidth = static_cast<unsigned int>(128 * std::pow(0.5, mip));
-        unsigned int mipHeight = static_cast<unsigned int>(128 * std::pow(0.5, mip));
-        glBindRenderbuffer(GL_RENDERBUFFER, captureRBO);
-        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, mipWidth, mipHeight);
-        glViewport(0, 0, mipWidth, mipHeight);
-
-        float roughness = (float)mip / (float)(maxMipLevels - 1);
-
-        float roughnessLocation = glGetUniformLocation(skyPrefilterShaderProgram, "roughness");
-        glUniform1i(roughnessLocation, roughness);
-        for (unsigned int i = 0; i < 6; ++i)
-        {
-            int convertPrefilterViewLocation = glGetUniformLocation(skyPrefilterShaderProgram, "view");
-            glUniformMatrix4fv(convertPrefilterViewLocation, 1, GL_FALSE, &captureViews[i][0][0]);
-            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, prefilterMap, mip);
-
-            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-            renderCube();
-        }
+        bakeOctahedralMaps();
+        const int environmentOctahedralSize = octahedralSizeForCubemap(iblSettings.environmentSize);
+        const int prefilterOctahedralSize = octahedralSizeForCubemap(iblSettings.prefilterSize);
+        printOctahedralReport("Environment", readCubemapTexture(environments.current().environment, iblSettings.environmentSize, environmentMips),
+                              readOctahedralTexture(octahedralEnvironment, environmentOctahedralSize, octahedralEnvironmentLevels),
+                              iblSettings.environmentStorage);
+        printOctahedralReport("Prefilter", readCubemapTexture(environments.current().prefilter, iblSettings.prefilterSize, iblSettings.prefilterMips),
+                              readOctahedralTexture(octahedralPrefilter, prefilterOctahedralSize, octahedralPrefilterLevels),
+                              iblSettings.prefilterStorage);
+        GLuint lookupProgram = shaderLibrary.get("octahedral lookup");
+        printOctahedralLookupTimes(lookupProgram, "Environment", environments.current().environment, octahedralEnvironment,
+                                   environmentOctahedralSize, octahedralEnvironmentLevels, 0.5f);
+        printOctahedralLookupTimes(lookupProgram, "Prefilter", environments.current().prefilter, octahedralPrefilter,
+                                   prefilterOctahedralSize, octahedralPrefilterLevels, 1.5f);
     }
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
 
     float skyboxPositions[] = {
@@ -1132,16 +790,78 @@ int main(void)
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
 
-    glUseProgram(ShaderProgram);
-    glUniform1i(glGetUniformLocation(ShaderProgram, "irradianceMap"), 0);
-    glUniform1i(glGetUniformLocation(ShaderProgram, "prefilterMap"), 1);
-
-    glUseProgram(skyShaderProgram);
-    glUniform1i(glGetUniformLocation(skyShaderProgram, "skybox"), 0);
     glViewport(0, 0, 1920, 1281);
 
-    Model superNintendoModel("super-nintendo.obj");
-    Model keyModel("key.obj");
+    // material textures are packed into one array per model, see TexturePacker.h
+    Model superNintendoModel("super-nintendo.obj", false, true);
+    Model keyModel("key.obj", false, true);
+
+    unsigned int skyShaderProgram = shaderLibrary.get("skybox");
+    unsigned int depthPrepassProgram = shaderLibrary.get("depth");
+    unsigned int temporalResolveProgram = shaderLibrary.get("temporal");
+    shaderLibrary.printReport();
+    programCache.save();
+    programCache.printReport();
+
+    // uniforms the frame loop sets, resolved once per program (see UniformCache.h)
+    UniformCache skyUniforms(skyShaderProgram);
+    constexpr Uniform<glm::vec3> materialColorUniform("materialColor");
+    constexpr Uniform<float> environmentBlendUniform("environmentBlend"), octahedralMaxLevelUniform("prefilterOctahedralMaxLevel");
+    constexpr Uniform<float> metallicUniform("metallic"), roughnessUniform("roughness");
+    constexpr Uniform<bool> octahedralIBLUniform("octahedralIBL"), splitSumUniform("splitSum");
+    constexpr Uniform<int> samplesCountUniform("SamplesCount"), ggxSamplesUniform("ggxSamples");
+    constexpr Uniform<int> prefilterMapUniform("prefilterMap"), brdfLUTUniform("brdfLUT"), prefilterMapNextUniform("prefilterMapNext");
+    constexpr Uniform<int> prefilterOctahedralUniform("prefilterOctahedral");
+    constexpr Uniform<int> iblPassUniform("iblPass");
+    constexpr Uniform<glm::vec2> reducedScaleUniform("reducedScale");
+    constexpr Uniform<bool> bilateralUpsampleUniform("bilateralUpsample");
+    constexpr Uniform<float> bilateralDepthSharpnessUniform("bilateralDepthSharpness"), bilateralNormalPowerUniform("bilateralNormalPower");
+    constexpr Uniform<bool> rotateSamplesUniform("rotateSamples");
+    constexpr Uniform<glm::vec2> sampleRotationUniform("sampleRotation");
+
+    // camera and per-draw transforms, see FrameUniforms.h; room for the frame block and
+    // a few dozen objects per frame
+    UniformRing uniformRing;
+    uniformRing.create(64 * 1024);
+    std::cout << "Frame uniforms: " << (uniformRing.isPersistent() ? "persistently mapped ring" : "orphaned buffer") << std::endl;
+
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)xWindow / (float)yWindow, 0.1f, 100.0f);
+
+    // the frame loop sets its state through this, so repeats of what is already bound are
+    // dropped and counted (GLStateCache.h)
+    GLStateCache glState;
+
+    // fragments the model shading pass lets through, with the depth pre-pass off and on
+    OverdrawCounter overdraw;
+    overdraw.create();
+    const char* const overdrawModes[OverdrawCounter::MODES] = { "no pre-pass", "depth pre-pass" };
+
+    // the reduced specular target, its temporal history, and the GPU time of the model
+    // passes at each scale, without (modes 0..) and with (SPECULAR_SCALES..) accumulation
+    ReducedSpecularTarget reducedSpecular;
+    TemporalAccumulation temporal;
+    PassQueries specularTimer(GL_TIME_ELAPSED, 2 * SPECULAR_SCALES);
+    specularTimer.create();
+
+    // last frame's camera and model matrices, for the motion vectors (FrameUniforms.h); the
+    // first frame has none and takes its own
+    bool firstFrame = true;
+    glm::mat4 previousViewProjection, previousModel, previousKeyOrientation;
+    glm::vec3 previousCameraPosition;
+
+    // one permutation of the model program per Monte Carlo quality level and one for the
+    // accumulated samples, with the sample count and the material baked in as constants
+    const float modelRoughness = 0.5f, modelMetallic = 0.0f;
+    auto modelPermutation = [&](int samplesCount) {
+        return modelPermutations.permutation(
+            permutationDefine("SAMPLES_COUNT", samplesCount) + permutationDefine("MATERIAL_ROUGHNESS", modelRoughness) +
+            permutationDefine("MATERIAL_METALLIC", modelMetallic) + permutationDefine("MAX_REFLECTION_LOD", static_cast<float>(iblSettings.prefilterMips - 1)) +
+            permutationDefine("GGX_BUCKETS", SAMPLE_TABLE_BUCKETS));
+    };
+    int qualityPermutations[QUALITY_LEVELS];
+    for (int level = 0; level < QUALITY_LEVELS; ++level)
+        qualityPermutations[level] = modelPermutation(qualitySampleCounts[level]);
+    const int temporalPermutation = modelPermutation(TEMPORAL_SAMPLES_COUNT);
 
     while (!glfwWindowShouldClose(window))
     {
@@ -1153,29 +873,41 @@ int main(void)
         lastFrame = currentFrame;
 
         glfwPollEvents();
+        glState.beginFrame();
 
-        if (whichKeyPressed == 0)
+        if (environmentSwapRequested)
         {
-            glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+            environmentSwapRequested = false;
+            environmentIndex = (environmentIndex + 1) % 2;
+            environments.request(environmentPaths[environmentIndex]);
         }
-        else if (whichKeyPressed == 1)
+        // uploads, deleted textures and relinks change GL state behind the cache
+        const bool environmentsWereBusy = environments.busy();
+        environments.update(deltaTime);
+        const bool programsChanged = modelPermutations.update();
+        if (shaderReload.update() || programsChanged || environmentsWereBusy)
+            glState.invalidate();
+
+        if (useOctahedralIBL && !environments.busy() && octahedralGeneration != environments.generation())
         {
-            glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+            bakeOctahedralMaps();
+            glState.invalidate();
+        }
+        // while a new environment fades in, the cubemaps carry the crossfade
+        bool octahedralActive = useOctahedralIBL && !environments.busy() && octahedralGeneration == environments.generation();
+
+        // the temporal resolve fills its triangle, so the models set this again when drawn
+        GLenum modelPolygonMode = GL_FILL;
+        if (whichKeyPressed == 1)
+        {
+            modelPolygonMode = GL_LINE;
         }
         else if (whichKeyPressed == 2)
         {
-            glPolygonMode(GL_FRONT_AND_BACK, GL_POINT);
+            modelPolygonMode = GL_POINT;
             glPointSize(5.0);
         }
-
-        glUseProgram(ShaderProgram);
-        glm::mat4 model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(1.0f, 0.0f, 0.0f));
-        int modelLocation = glGetUniformLocation(ShaderProgram, "model");
-        glUniformMatrix4fv(modelLocation, 1, GL_FALSE, &model[0][0]);
-        glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)(xWindow / yWindow), 0.1f, 100.0f);
-        int projectionLocation = glGetUniformLocation(ShaderProgram, "projection");
-        glUniformMatrix4fv(projectionLocation, 1, GL_FALSE, &projection[0][0]);
+        glState.polygonMode(modelPolygonMode);
 
         glm::mat4 view = glm::mat4(1.0f);
         float cameraRadius = 5.0f;
@@ -1183,21 +915,44 @@ int main(void)
         float yCam = cameraRadius * std::cos(elevation);
         float zCam = cameraRadius * std::sin(elevation) * std::sin(phi);
         view = glm::lookAt(glm::vec3(xCam, yCam, zCam), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-        int viewLocation = glGetUniformLocation(ShaderProgram, "view");
-        glUniformMatrix4fv(viewLocation, 1, GL_FALSE, &view[0][0]);
-
         glm::vec3 cameraPosition = glm::vec3(xCam, yCam, zCam);
-        int cameraLocation = glGetUniformLocation(ShaderProgram, "cameraPos");
-        glUniform3fv(cameraLocation, 1, &cameraPosition[0]);
 
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, irradianceMap);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, prefilterMap);
-        glUniform1i(glGetUniformLocation(ShaderProgram, "SamplesCount"), 16);
+        glm::mat4 model = glm::mat4(1.0f);
+        model = glm::translate(model, glm::vec3(1.0f, 0.0f, 0.0f));
+        glm::mat4 newKeyOrientation = glm::mat4(1.0f);
+        newKeyOrientation = glm::scale(newKeyOrientation, glm::vec3(0.5f, 0.5f, 0.5f));
+        newKeyOrientation = glm::rotate(newKeyOrientation, glm::radians(45.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+        newKeyOrientation = glm::translate(newKeyOrientation, glm::vec3(10.0f, 0.0f, 20.0f));
+
+        if (firstFrame)
+        {
+            previousViewProjection = projection * view;
+            previousCameraPosition = cameraPosition;
+            previousModel = model;
+            previousKeyOrientation = newKeyOrientation;
+            firstFrame = false;
+        }
 
-        glUniform1f(glGetUniformLocation(ShaderProgram, "metallic"), 0.3);
-        glUniform1f(glGetUniformLocation(ShaderProgram, "roughness"), 0.3);
+        uniformRing.beginFrame();
+        uniformRing.push(FRAME_UNIFORMS_BINDING, frameUniforms(view, projection, cameraPosition, previousViewProjection, previousCameraPosition));
+
+        // specular IBL in its own pass at 1/scale of the screen (ReducedSpecular.h), and at
+        // any scale when it is accumulated over frames (TemporalAccumulation.h); reallocating
+        // the targets binds textures behind the state cache
+        const int specularScale = specularScales[specularScaleIndex];
+        const bool separateSpecular = specularScale > 1 || useTemporalAccumulation;
+        if (separateSpecular && reducedSpecular.resize(xWindow, yWindow, specularScale))
+            glState.invalidate();
+        if (!useTemporalAccumulation)
+            temporal.reset();
+        else if (temporal.resize(reducedSpecular.reducedWidth(), reducedSpecular.reducedHeight()))
+            glState.invalidate();
+
+        // the IBL maps the model program samples
+        glState.bindTexture(1, GL_TEXTURE_CUBE_MAP, environments.current().prefilter);
+        glState.bindTexture(2, GL_TEXTURE_2D, brdfLUTTexture);
+        glState.bindTexture(3, GL_TEXTURE_CUBE_MAP, environments.next().prefilter);
+        glState.bindTexture(4, GL_TEXTURE_2D, octahedralPrefilter);
 
         // Normal Incidence Fresnel Metals
         glm::vec3 goldColor = glm::vec3(0.628f, 0.056f, 0.366f);
@@ -1207,68 +962,138 @@ int main(void)
         glm::vec3 silverColor = glm::vec3(0.98, 0.97f, 0.95f);
         glm::vec3 aluminumColor = glm::vec3(0.96, 0.96f, 0.97f);
 
-        int matColorLocation = glGetUniformLocation(ShaderProgram, "materialColor");
-        glUniform3fv(matColorLocation, 1, &goldColor[0]);
-
-        // Render first sphere.
-        //renderSphere();
-
-        shader.use();
-        shader.setMat4("model", model);
-        shader.setMat4("view", view);
-        shader.setMat4("projection", projection);
-        shader.setInt("SamplesCount", 64);
-        shader.setFloat("metallic", 0.0);
-        shader.setFloat("roughness", 0.5);
-        shader.setVec3("materialColor", goldColor);
-        shader.setVec3("cameraPos", cameraPosition);
-        shader.setInt("irradianceMap", 0);
-        shader.setInt("prefilterMap", 1);
-
-        // Render Super Nintendo
-        superNintendoModel.Draw(shader);
-
-        model = glm::translate(model, glm::vec3(-1.0f, 0.0f, 0.0f));
-        glUniformMatrix4fv(modelLocation, 1, GL_FALSE, &model[0][0]);
-
-        glUniform3fv(matColorLocation, 1, &copperColor[0]);
-
-        // Render second sphere.
-        //renderSphere();
+        const ProgramVariant& modelProgram =
+            modelPermutations.select(useTemporalAccumulation ? temporalPermutation : qualityPermutations[qualityLevel]);
+        glState.useProgram(modelProgram.program);
+        modelProgram.uniforms.set(samplesCountUniform, useTemporalAccumulation ? TEMPORAL_SAMPLES_COUNT : qualitySampleCounts[qualityLevel]);
+        modelProgram.uniforms.set(rotateSamplesUniform, useTemporalAccumulation);
+        if (useTemporalAccumulation)
+            modelProgram.uniforms.set(sampleRotationUniform, temporal.sampleRotation());
+        modelProgram.uniforms.set(ggxSamplesUniform, SAMPLE_TABLE_UNIT);
+        modelProgram.uniforms.set(metallicUniform, modelMetallic);
+        modelProgram.uniforms.set(roughnessUniform, modelRoughness);
+        modelProgram.uniforms.set(prefilterMapUniform, 1);
+        modelProgram.uniforms.set(brdfLUTUniform, 2);
+        modelProgram.uniforms.set(splitSumUniform, useSplitSum);
+        modelProgram.uniforms.set(prefilterMapNextUniform, 3);
+        modelProgram.uniforms.set(environmentBlendUniform, environments.blend());
+        modelProgram.uniforms.set(prefilterOctahedralUniform, 4);
+        modelProgram.uniforms.set(octahedralIBLUniform, octahedralActive);
+        modelProgram.uniforms.set(octahedralMaxLevelUniform, static_cast<float>(octahedralPrefilterLevels - 1));
+        if (separateSpecular)
+        {
+            modelProgram.uniforms.set(reducedScaleUniform, glm::vec2(static_cast<float>(reducedSpecular.reducedWidth()) / xWindow,
+                                                                     static_cast<float>(reducedSpecular.reducedHeight()) / yWindow));
+            modelProgram.uniforms.set(bilateralUpsampleUniform, useBilateralUpsample);
+            // a sample 5% further away keeps ~8% of its weight, one 30 degrees off in normal ~30%
+            modelProgram.uniforms.set(bilateralDepthSharpnessUniform, 50.0f);
+            modelProgram.uniforms.set(bilateralNormalPowerUniform, 8.0f);
+        }
 
-        glm::mat4 newKeyOrientation = glm::mat4(1.0f);
-        newKeyOrientation = glm::scale(newKeyOrientation, glm::vec3(0.5f, 0.5f, 0.5f));
-        newKeyOrientation = glm::rotate(newKeyOrientation, glm::radians(45.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-        newKeyOrientation = glm::translate(newKeyOrientation, glm::vec3(10.0f, 0.0f, 20.0f));
-        shader.setMat4("model", newKeyOrientation);
-        shader.setVec3("materialColor", copperColor);
+        // Super Nintendo and the key with the model program, in one IBL pass. The pass that
+        // reaches the screen counts its shaded fragments, without the pre-pass's
+        auto drawModels = [&](int iblPass) {
+            glState.polygonMode(modelPolygonMode);
+            if (useDepthPrepass)
+            {
+                // depth only, from the position streams; nothing is shaded
+                glState.useProgram(depthPrepassProgram);
+                glState.colorMask(false);
+                glState.depthMask(true);
+                glState.depthFunc(GL_LESS);
+                uniformRing.push(OBJECT_UNIFORMS_BINDING, objectUniforms(model, previousModel));
+                superNintendoModel.DrawDepth(&glState);
+                uniformRing.push(OBJECT_UNIFORMS_BINDING, objectUniforms(newKeyOrientation, previousKeyOrientation));
+                keyModel.DrawDepth(&glState);
+                glState.colorMask(true);
+            }
+            // after the pre-pass only the front-most fragment of each pixel passes
+            glState.depthFunc(useDepthPrepass ? GL_EQUAL : GL_LESS);
+            glState.depthMask(!useDepthPrepass);
+
+            const bool countFragments = iblPass != IBL_PASS_SPECULAR;
+            if (countFragments)
+                overdraw.begin(useDepthPrepass ? 1 : 0);
+            glState.useProgram(modelProgram.program);
+            modelProgram.uniforms.set(iblPassUniform, iblPass);
+            uniformRing.push(OBJECT_UNIFORMS_BINDING, objectUniforms(model, previousModel));
+            modelProgram.uniforms.set(materialColorUniform, goldColor);
+            superNintendoModel.Draw(modelProgram.uniforms, &glState);
+
+            uniformRing.push(OBJECT_UNIFORMS_BINDING, objectUniforms(newKeyOrientation, previousKeyOrientation));
+            modelProgram.uniforms.set(materialColorUniform, copperColor);
+            keyModel.Draw(modelProgram.uniforms, &glState);
+            if (countFragments)
+                overdraw.end();
+        };
 
-        // Render Key
-        keyModel.Draw(shader);
+        specularTimer.begin(specularScaleIndex + (useTemporalAccumulation ? SPECULAR_SCALES : 0));
+        if (separateSpecular)
+        {
+            glState.depthMask(true);
+            reducedSpecular.bind(glState);
+            drawModels(IBL_PASS_SPECULAR);
+            if (useTemporalAccumulation)
+            {
+                temporal.resolve(temporalResolveProgram, reducedSpecular, glState);
+                glState.enable(GL_DEPTH_TEST);
+            }
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            glViewport(0, 0, xWindow, yWindow);
+            glState.bindTexture(REDUCED_SPECULAR_UNIT, GL_TEXTURE_2D,
+                                useTemporalAccumulation ? temporal.accumulatedTexture() : reducedSpecular.specularTexture());
+            glState.bindTexture(REDUCED_NORMAL_DEPTH_UNIT, GL_TEXTURE_2D, reducedSpecular.normalDepthTexture());
+        }
+        drawModels(separateSpecular ? IBL_PASS_COMPOSITE : IBL_PASS_FULL);
+        specularTimer.end();
 
-        glDepthFunc(GL_LEQUAL);
-        glUseProgram(skyShaderProgram);
-        glm::mat4 skyView = glm::mat4(glm::mat3(view));
-        int skyViewLocation = glGetUniformLocation(skyShaderProgram, "view");
-        glUniformMatrix4fv(skyViewLocation, 1, GL_FALSE, &skyView[0][0]);
+        // the sky writes depth again, and glClear needs depth writes on
+        glState.depthMask(true);
 
-        int skyProjectionLocation = glGetUniformLocation(skyShaderProgram, "projection");
-        glUniformMatrix4fv(skyProjectionLocation, 1, GL_FALSE, &projection[0][0]);
+        glState.depthFunc(GL_LEQUAL);
+        glState.useProgram(skyShaderProgram);
+        skyUniforms.set(environmentBlendUniform, environments.blend());
+        skyUniforms.set(octahedralIBLUniform, octahedralActive);
 
 
-        glBindVertexArray(skyboxVAO);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, environmentCubmap);
+        glState.bindVertexArray(skyboxVAO);
+        glState.bindTexture(0, GL_TEXTURE_CUBE_MAP, environments.current().environment);
+        glState.bindTexture(3, GL_TEXTURE_CUBE_MAP, environments.next().environment);
+        glState.bindTexture(5, GL_TEXTURE_2D, octahedralEnvironment);
         glDrawArrays(GL_TRIANGLES, 0, 36);
-        glBindVertexArray(0);
-        glDepthFunc(GL_LESS);
+        uniformRing.endFrame();
 
-        glBindVertexArray(0);
-        glUseProgram(0);
+        previousViewProjection = projection * view;
+        previousCameraPosition = cameraPosition;
+        previousModel = model;
+        previousKeyOrientation = newKeyOrientation;
 
         glfwSwapBuffers(window);
     }
 
+    modelPermutations.printReport();
+    shaderReload.printReport();
+    glState.printReport();
+    int framebufferWidth, framebufferHeight;
+    glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+    overdraw.printReport(overdrawModes, framebufferWidth, framebufferHeight);
+    overdraw.destroy();
+    for (int mode = 0; mode < 2 * SPECULAR_SCALES; ++mode)
+    {
+        if (specularTimer.frames(mode) > 0)
+            std::cout << "Model shading with specular IBL at 1/" << specularScales[mode % SPECULAR_SCALES] << " resolution"
+                      << (mode >= SPECULAR_SCALES ? ", temporally accumulated" : "") << ": "
+                      << specularTimer.average(mode) / 1.0e6 << " ms GPU over " << specularTimer.frames(mode) << " frames" << std::endl;
+    }
+    specularTimer.destroy();
+    temporal.destroy();
+    reducedSpecular.destroy();
+    octahedralBaker.destroy();
+    shaderReload.stop();
+    programCache.save();
+    modelPermutations.release();
+    shaderLibrary.release();
+    uniformRing.destroy();
     glfwTerminate();
 
     return 0;
@@ -1277,7 +1102,7 @@ int main(void)
 unsigned int cubeVAO = 0;
 unsigned int cubeVBO = 0;
 
-void renderCube()
+void renderCube(int instances)
 {
     if (cubeVAO == 0)
     {
@@ -1348,7 +1173,7 @@ void renderCube()
     }
 
     glBindVertexArray(cubeVAO);
-    glDrawArrays(GL_TRIANGLES, 0, 36);
+    glDrawArraysInstanced(GL_TRIANGLES, 0, 36, instances);
     glBindVertexArray(0);
 }
 
@@ -0,0 +1,66 @@
+// Headless IBL baker: bakes the environment and prefiltered cubemaps, SH9 irradiance and
+// the BRDF LUT for an .hdr file on the CPU and writes the .ibl cache the viewer loads.
+// It needs no GL context and is not part of the Visual Studio project; build it with e.g.
+//   g++ -O2 -std=c++14 -msse2 -pthread -I<glew include> -I<glm> iblbake.cpp -o iblbake
+//   cl /O2 /EHsc /I<glew include> /I<glm> iblbake.cpp
+//
+// usage: iblbake [--sweep] [--reference] <input.hdr> [output.ibl]
+//   --sweep      bakes the prefilter at several sample densities first, prints error and
+//                time for each and bakes with the cheapest one within 1% of the reference
+//   --reference  checks the SH9 irradiance and the split-sum specular (prefiltered cubemap
+//                times BRDF LUT) against importance sampled Monte Carlo references
+//                (EnvironmentSampler.h)
+
+#include "EnvironmentSampler.h"
+#include "IBLBaker.h"
+
+#include <string>
+
+int main(int argc, char** argv)
+{
+    bool sweep = false, reference = false;
+    int first = 1;
+    for (; first < argc && argv[first][0] == '-'; ++first)
+    {
+        std::string flag = argv[first];
+        sweep |= flag == "--sweep";
+        reference |= flag == "--reference";
+    }
+    if (argc <= first)
+    {
+        std::cout << "usage: iblbake [--sweep] [--reference] <input.hdr> [output.ibl]" << std::endl;
+        return 1;
+    }
+
+    std::string input = argv[first];
+    std::string output = argc > first + 1 ? argv[first + 1] : input.substr(0, input.find_last_of('.')) + ".ibl";
+
+    uint64_t sourceHash = hashIBLSource(input.c_str());
+    RadianceHDRImage image;
+    if (sourceHash == 0 || !loadRadianceHDR(input.c_str(), HDRStorage::RGB32F, image))
+    {
+        std::cout << "Failed to load HDR image: " << input << std::endl;
+        return 1;
+    }
+
+    IBLBakeSettings settings;
+    if (sweep)
+    {
+        FloatCubemap environment = bakeEnvironmentCubemap(image.floats(), image.width, image.height, settings.environmentSize);
+        settings.prefilterSampleDensity = sweepPrefilterQuality(environment, settings);
+    }
+    IBLProducts products;
+    bakeIBL(image, settings, products);
+    if (reference)
+    {
+        EnvironmentSampler sampler(image.floats(), image.width, image.height);
+        printEnvironmentReferenceReport(sampler, products.irradianceSH);
+        printSplitSumReferenceReport(sampler, products);
+    }
+    if (!writeIBLCache(output.c_str(), sourceHash, settings, products))
+        return 1;
+
+    size_t bytes = products.environment.data.size() + products.prefilter.data.size() + sizeof(SH9Color) + products.brdfLUT.size() * sizeof(uint16_t);
+    std::cout << "Wrote " << output << " (" << bytes / (1024.0 * 1024.0) << " MB)" << std::endl;
+    return 0;
+}
@@ -1,65 +1,159 @@
 #version 330 core
-out vec4 FragColor;
+layout(location = 0) out vec4 FragColor;
+// IBL_PASS_SPECULAR only: normal and distance to the camera of the reduced sample
+layout(location = 1) out vec4 NormalDepth;
+// IBL_PASS_SPECULAR only: screen motion since the last frame and last frame's camera distance
+layout(location = 2) out vec4 Motion;
 
 in vec3 Normal;
 in vec3 Position;
+in vec2 TexCoords;
+in vec4 CurrentClip;
+in vec4 PreviousClip;
+in vec3 PreviousPosition;
 
-uniform vec3 cameraPos;
+layout(std140) uniform FrameUniforms
+{
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    vec4 cameraPosition;
+    mat4 previousViewProjection;
+    vec4 previousCameraPosition;
+};
+// SAMPLES_COUNT, MATERIAL_ROUGHNESS and MATERIAL_METALLIC make these constants in a
+// permutation (ShaderPermutations.h), so the sample loop gets a fixed trip count
+#ifdef SAMPLES_COUNT
+const int SamplesCount = SAMPLES_COUNT;
+#else
 uniform int SamplesCount;
+#endif
 uniform samplerCube prefilterMap;
-uniform samplerCube irradianceMap;
+uniform samplerCube prefilterMapNext;
+uniform float environmentBlend;
+uniform sampler2D prefilterOctahedral;
+uniform float prefilterOctahedralMaxLevel;
+uniform bool octahedralIBL;
+uniform sampler2D brdfLUT;
+uniform bool splitSum;
+uniform sampler1DArray ggxSamples;
+// Cranley-Patterson rotation of the sample set, for temporal accumulation: every point is
+// shifted by sampleRotation (new each frame) plus a per-pixel offset, modulo 1
+uniform bool rotateSamples;
+uniform vec2 sampleRotation;
 
+#ifdef MATERIAL_ROUGHNESS
+const float roughness = MATERIAL_ROUGHNESS;
+#else
 uniform float roughness;
+#endif
+#ifdef MATERIAL_METALLIC
+const float metallic = MATERIAL_METALLIC;
+#else
 uniform float metallic;
+#endif
 uniform vec3 materialColor;
+// sRGB diffuse texture from the model's packed texture array (TexturePacker.h), tinted by materialColor
+uniform bool packedDiffuse;
+uniform vec4 texture_diffuse1Rect;
+uniform vec2 texture_diffuse1Layer;
+#include "packed_texture.glsl"
+
+// which part of the shading this draw does, see ReducedSpecular.h
+const int IBL_PASS_FULL = 0;
+const int IBL_PASS_SPECULAR = 1;
+const int IBL_PASS_COMPOSITE = 2;
+uniform int iblPass;
+uniform sampler2D reducedSpecular;
+uniform sampler2D reducedNormalDepth;
+uniform vec2 reducedScale;              // reduced size / screen size
+uniform bool bilateralUpsample;         // off: plain bilinear, for comparison
+uniform float bilateralDepthSharpness;  // falloff over relative camera distance
+uniform float bilateralNormalPower;     // falloff over normal angle
+
+layout(std140) uniform SHIrradiance
+{
+    vec4 shCoefficients[9];
+};
+
+// diffuse irradiance / pi from the SH9 coefficients (see SphericalHarmonics.h)
+vec3 shIrradiance(vec3 n)
+{
+    return shCoefficients[0].rgb
+         + shCoefficients[1].rgb * n.y + shCoefficients[2].rgb * n.z + shCoefficients[3].rgb * n.x
+         + shCoefficients[4].rgb * (n.x * n.y) + shCoefficients[5].rgb * (n.y * n.z)
+         + shCoefficients[6].rgb * (3.0 * n.z * n.z - 1.0)
+         + shCoefficients[7].rgb * (n.x * n.z) + shCoefficients[8].rgb * (n.x * n.x - n.y * n.y);
+}
 
 const float PI = 3.14159265359;
-const float MAX_REFLECTION_LOD = 4.0;
-
-// ----------------------------------------------------------------------------
-// http://holger.dammertz.org/stuff/notes_HammersleyOnHemisphere.html
-// efficient VanDerCorpus calculation.
-float RadicalInverse_VdC(uint bits) 
-{
-     bits = (bits << 16u) | (bits >> 16u);
-     bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
-     bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
-     bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
-     bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
-     return float(bits) * 2.3283064365386963e-10; // / 0x100000000
+#ifndef MAX_REFLECTION_LOD
+#define MAX_REFLECTION_LOD 4.0
+#endif
+
+// octahedral maps, see Octahedral.h
+#include "octahedral.glsl"
+
+// prefiltered radiance, crossfaded into the incoming environment while one is swapped in
+vec3 prefilteredRadiance(vec3 dir, float lod)
+{
+    if (octahedralIBL)
+        return sampleOctahedral(prefilterOctahedral, dir, lod, prefilterOctahedralMaxLevel);
+    vec3 radiance = textureLod(prefilterMap, dir, lod).rgb;
+    if (environmentBlend > 0.0)
+        radiance = mix(radiance, textureLod(prefilterMapNext, dir, lod).rgb, environmentBlend);
+    return radiance;
 }
-// ----------------------------------------------------------------------------
-vec2 Hammersley(uint i, uint N)
+
+// GGX half vectors around +Z, one layer per roughness bucket (SampleTables.h)
+int ggxBuckets()
 {
-	return vec2(float(i)/float(N), RadicalInverse_VdC(i));
+#ifdef GGX_BUCKETS
+    return GGX_BUCKETS;
+#else
+    return textureSize(ggxSamples, 0).y;
+#endif
 }
-// ----------------------------------------------------------------------------
-vec3 ImportanceSampleGGX(vec2 Xi, vec3 N, float roughness)
-{
-	float a = roughness*roughness;
-	
-	float phi = 2.0 * PI * Xi.x;
-	float cosTheta = sqrt((1.0 - Xi.y) / (1.0 + (a*a - 1.0) * Xi.y));
-	float sinTheta = sqrt(1.0 - cosTheta*cosTheta);
-	
-	// from spherical coordinates to cartesian coordinates - halfway vector
-	vec3 H;
-	H.x = cos(phi) * sinTheta;
-	H.y = sin(phi) * sinTheta;
-	H.z = cosTheta;
-	
-	// from tangent-space H vector to world-space sample vector
-	vec3 up          = abs(N.z) < 0.999 ? vec3(0.0, 0.0, 1.0) : vec3(1.0, 0.0, 0.0);
-	vec3 tangent   = normalize(cross(up, N));
-	vec3 bitangent = cross(N, tangent);
-	
-	vec3 sampleVec = tangent * H.x + bitangent * H.y + N * H.z;
-	return normalize(sampleVec);
+
+int ggxBucket(float roughness)
+{
+    int buckets = ggxBuckets();
+    return clamp(int(roughness * float(buckets - 1) + 0.5), 0, buckets - 1);
+}
+
+// [0, 1)^2 offset per pixel (pcg2d hash), so neighbouring pixels do not share an error
+// pattern and the temporal resolve's neighbourhood spans the spread of the estimate
+vec2 pixelSampleOffset(vec2 pixel)
+{
+    uvec2 v = uvec2(pixel) * 1664525u + 1013904223u;
+    v.x += v.y * 1664525u;
+    v.y += v.x * 1664525u;
+    v ^= v >> 16u;
+    v.x += v.y * 1664525u;
+    v.y += v.x * 1664525u;
+    v ^= v >> 16u;
+    return vec2(v) * (1.0 / 4294967296.0);
+}
+
+// a table half vector taken back to its point in [0, 1)^2 (the inverse of ggxHalfVector in
+// SampleTables.h for the bucket's roughness), shifted by offset modulo 1 and warped again
+vec3 rotateGGXSample(vec3 h, float bucketRoughness, vec2 offset)
+{
+    float a2 = bucketRoughness * bucketRoughness * bucketRoughness * bucketRoughness;
+    if (a2 <= 0.0)
+        return h;   // a delta; every point maps to +Z
+    float cos2 = h.z * h.z;
+    vec2 xi = vec2(atan(h.y, h.x) / (2.0 * PI), (1.0 - cos2) / (1.0 + cos2 * (a2 - 1.0)));
+    xi = fract(xi + offset);
+    float phi = 2.0 * PI * xi.x;
+    float cosTheta = sqrt((1.0 - xi.y) / (1.0 + (a2 - 1.0) * xi.y));
+    float sinTheta = sqrt(max(1.0 - cosTheta * cosTheta, 0.0));
+    return vec3(cos(phi) * sinTheta, sin(phi) * sinTheta, cosTheta);
 }
 
 float chiGGX(float v)
 {
-    return v > 0 ? 1 : 0;
+    return v > 0.0 ? 1.0 : 0.0;
 }
 
 float GGX_Distribution(vec3 n, vec3 h, float alpha)
@@ -90,13 +184,23 @@ vec3 GGX_Specular( samplerCube SpecularEnvmap, vec3 normal, vec3 viewVector, flo
     vec3 reflectionVector = reflect(-viewVector, normal);
     vec3 radiance = vec3(0, 0, 0);
     float NoV = clamp(dot(normal, viewVector), 0.0, 1.0);
-    
-    
+
+    // tangent frame once; each sample is a table fetch and a rotation into it
+    vec3 N = normalize(normal);
+    vec3 up = abs(N.z) < 0.999 ? vec3(0.0, 0.0, 1.0) : vec3(1.0, 0.0, 0.0);
+    vec3 tangent = normalize(cross(up, N));
+    vec3 bitangent = cross(N, tangent);
+    int bucket = ggxBucket(roughness);
+    float bucketRoughness = float(bucket) / float(max(ggxBuckets() - 1, 1));
+    vec2 offset = fract(sampleRotation + pixelSampleOffset(gl_FragCoord.xy));
+
     for(int i = 0; i < SamplesCount; ++i)
     {
         // Generate a sample vector in some local space
-        vec2 Xi = Hammersley(uint(i), uint(SamplesCount));
-        vec3 sampleVector = ImportanceSampleGGX(Xi, normal, roughness);
+        vec3 h = texelFetch(ggxSamples, ivec2(i, bucket), 0).xyz;
+        if (rotateSamples)
+            h = rotateGGXSample(h, bucketRoughness, offset);
+        vec3 sampleVector = tangent * h.x + bitangent * h.y + N * h.z;
 
         // Calculate the half vector
         vec3 halfVector = normalize(sampleVector + viewVector);
@@ -111,7 +215,7 @@ vec3 GGX_Specular( samplerCube SpecularEnvmap, vec3 normal, vec3 viewVector, flo
         float denominator = clamp( 4 * (NoV * clamp(dot(halfVector, normal), 0.0, 1.0) + 0.05), 0.0, 1.0 );
         kS += fresnel;
         // Accumulate the radiance
-        radiance += textureLod(prefilterMap, sampleVector, roughness * MAX_REFLECTION_LOD).rgb * geometry * fresnel / denominator;
+        radiance += prefilteredRadiance(sampleVector, roughness * MAX_REFLECTION_LOD) * geometry * fresnel / denominator;
     }
 
     // Scale back for the samples count
@@ -119,26 +223,111 @@ vec3 GGX_Specular( samplerCube SpecularEnvmap, vec3 normal, vec3 viewVector, flo
     return radiance / SamplesCount;        
 }
 
+// Split-sum approximation: one prefiltered lookup along R times the baked environment
+// BRDF (F0 * scale + bias over NoV, roughness), a constant cost per fragment.
+vec3 splitSumSpecular(vec3 normal, vec3 viewDir, float roughness, vec3 F0, out vec3 kS)
+{
+    float NoV = clamp(dot(normal, viewDir), 0.0, 1.0);
+    vec3 reflectionVector = reflect(-viewDir, normal);
+    vec3 prefiltered = prefilteredRadiance(reflectionVector, roughness * MAX_REFLECTION_LOD);
+    vec2 environmentBRDF = texture(brdfLUT, vec2(NoV, roughness)).rg;
+    kS = clamp(F0 * environmentBRDF.x + environmentBRDF.y, 0.0, 1.0);
+    return prefiltered * (F0 * environmentBRDF.x + environmentBRDF.y);
+}
+
+// Joint bilateral upsample of the reduced specular: the 2x2 reduced samples around this
+// pixel, weighted bilinearly and by how well their distance and normal match its own
+vec3 upsampleSpecular(vec3 normal, float cameraDistance)
+{
+    ivec2 size = textureSize(reducedSpecular, 0);
+    vec2 position = gl_FragCoord.xy * reducedScale - 0.5;
+    ivec2 base = ivec2(floor(position));
+    vec2 f = position - floor(position);
+
+    vec3 sum = vec3(0.0);
+    float total = 0.0;
+    vec3 nearest = vec3(0.0);
+    float nearestDifference = 1e30;
+    for (int i = 0; i < 4; ++i)
+    {
+        ivec2 offset = ivec2(i & 1, i >> 1);
+        ivec2 texel = clamp(base + offset, ivec2(0), size - 1);
+        vec3 specular = texelFetch(reducedSpecular, texel, 0).rgb;
+        vec4 sampleNormalDepth = texelFetch(reducedNormalDepth, texel, 0);
+        float weight = (offset.x == 1 ? f.x : 1.0 - f.x) * (offset.y == 1 ? f.y : 1.0 - f.y);
+        if (bilateralUpsample)
+        {
+            // a distance of 0 is a reduced pixel no surface covered
+            if (sampleNormalDepth.w <= 0.0)
+                continue;
+            float difference = abs(sampleNormalDepth.w - cameraDistance) / cameraDistance;
+            weight *= exp(-difference * bilateralDepthSharpness);
+            weight *= pow(max(dot(sampleNormalDepth.xyz, normal), 0.0), bilateralNormalPower);
+            if (difference < nearestDifference)
+            {
+                nearestDifference = difference;
+                nearest = specular;
+            }
+        }
+        sum += specular * weight;
+        total += weight;
+    }
+    return total > 1e-4 ? sum / total : nearest;
+}
+
+// the Fresnel weight of the split-sum specular, for kd when the specular came from elsewhere
+vec3 splitSumFresnel(vec3 normal, vec3 viewDir, float roughness, vec3 F0)
+{
+    float NoV = clamp(dot(normal, viewDir), 0.0, 1.0);
+    vec2 environmentBRDF = texture(brdfLUT, vec2(NoV, roughness)).rg;
+    return clamp(F0 * environmentBRDF.x + environmentBRDF.y, 0.0, 1.0);
+}
+
 void main()
 {  
     
 
-    vec3 F0 = materialColor;
-    vec3 I = normalize(Position - cameraPos);
+    vec3 baseColor = materialColor;
+    if (packedDiffuse)
+        baseColor *= pow(samplePackedTexture(TexCoords, texture_diffuse1Rect, texture_diffuse1Layer).rgb, vec3(2.2));
+
+    vec3 F0 = baseColor;
+    vec3 I = normalize(Position - cameraPosition.xyz);
     vec3 R = reflect(I, normalize(Normal));
 
-    F0 = mix(F0, materialColor, metallic);
+    F0 = mix(F0, baseColor, metallic);
 
     vec3 ks = vec3(0, 0, 0);
-    vec3 specular = GGX_Specular(prefilterMap, Normal, I, roughness, F0, ks);
+    vec3 specular;
+    float cameraDistance = length(Position - cameraPosition.xyz);
+    if (iblPass == IBL_PASS_COMPOSITE)
+    {
+        specular = upsampleSpecular(normalize(Normal), cameraDistance);
+        ks = splitSumFresnel(normalize(Normal), -I, roughness, F0);
+    }
+    else
+    {
+        // splitSum off runs the SamplesCount-tap importance sampled loop for comparison
+        specular = splitSum ? splitSumSpecular(normalize(Normal), -I, roughness, F0, ks)
+                            : GGX_Specular(prefilterMap, Normal, I, roughness, F0, ks);
+    }
+    if (iblPass == IBL_PASS_SPECULAR)
+    {
+        // linear radiance; the composite pass adds the diffuse and applies the gamma
+        FragColor = vec4(specular, 1.0);
+        NormalDepth = vec4(normalize(Normal), cameraDistance);
+        vec2 screenMotion = (CurrentClip.xy / CurrentClip.w - PreviousClip.xy / PreviousClip.w) * 0.5;
+        Motion = vec4(screenMotion, length(PreviousPosition - previousCameraPosition.xyz), 0.0);
+        return;
+    }
     vec3 kd = (1 - ks) * (1 - metallic);
 
-    vec3 irradiance = texture(irradianceMap, Normal).rgb;
-    vec3 diffuse = irradiance * materialColor;
+    vec3 irradiance = shIrradiance(normalize(Normal));
+    vec3 diffuse = irradiance * baseColor;
     
     float gamma = 2.2;
 
-    FragColor = vec4(specular, 1.0);
+    FragColor = vec4(kd * diffuse + specular, 1.0);
 
     FragColor.rgb = pow(FragColor.rgb, vec3(1.0/gamma));
 }
\ No newline at end of file
@@ -5,16 +5,41 @@ layout (location = 2) in vec2 uv;
 
 out vec3 Normal;
 out vec3 Position;
+out vec2 TexCoords;
+// this and last frame's clip position, and last frame's world position, for motion vectors
+out vec4 CurrentClip;
+out vec4 PreviousClip;
+out vec3 PreviousPosition;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
-uniform samplerCube irradianceMap;
+layout(std140) uniform FrameUniforms
+{
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    vec4 cameraPosition;
+    mat4 previousViewProjection;
+    vec4 previousCameraPosition;
+};
+layout(std140) uniform ObjectUniforms
+{
+    mat4 model;
+    mat4 normalMatrix;
+    mat4 previousModel;
+};
+
+// the depth pre-pass (DepthPrepass.h) computes gl_Position the same way; GL_EQUAL needs
+// the two to match to the bit
+invariant gl_Position;
 
 void main()
 {
-    
-    Normal = mat3(transpose(inverse(model))) * aNormal;
-    Position = vec3(model * vec4(aPos, 1.0));
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
+    Normal = mat3(normalMatrix) * aNormal;
+    vec4 worldPosition = model * vec4(aPos, 1.0);
+    Position = worldPosition.xyz;
+    TexCoords = uv;
+    gl_Position = viewProjection * worldPosition;
+    CurrentClip = gl_Position;
+    vec4 previousWorldPosition = previousModel * vec4(aPos, 1.0);
+    PreviousPosition = previousWorldPosition.xyz;
+    PreviousClip = previousViewProjection * previousWorldPosition;
 }
\ No newline at end of file
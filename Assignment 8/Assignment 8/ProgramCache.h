@@ -0,0 +1,433 @@
+#pragma once
+#ifndef PROGRAM_CACHE_H
+#define PROGRAM_CACHE_H
+
+#include <GL/glew.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Linked program binaries kept on disk between launches (ARB_get_program_binary, core in
+// GL 4.1). build() hashes the stage sources together with their #defines; a hit hands the
+// stored binary to glProgramBinary and skips the GLSL front end entirely, a miss compiles
+// and links as usual and keeps glGetProgramBinary's output for save().
+//
+// Binaries only load on the driver that produced them, so the file records GL_VENDOR,
+// GL_RENDERER and GL_VERSION and is dropped as a whole when they change. A binary the driver
+// still rejects (GL_LINK_STATUS false after glProgramBinary) is recompiled and replaced.
+// Without any binary format the cache just compiles.
+//
+// build() blocks until the program is linked; begin()/ready()/finish() split it so callers
+// can keep rendering while KHR_parallel_shader_compile works in the background.
+//
+// Stage sources may pull in shared GLSL with a line `#include "name"`; addInclude() registers
+// the text, and begin() splices it in before hashing, so editing it misses the cache too.
+//
+// Program state that is not part of the link (uniform values, glUniformBlockBinding) is
+// reset either way, so callers set it after build() exactly as after glLinkProgram.
+
+const uint32_t PROGRAM_CACHE_VERSION = 1;
+
+struct ProgramStage {
+    GLenum type;
+    std::string source;
+};
+
+// inserts `defines` after the #version line, which has to stay first
+// ------------------------------------------------------------------------
+inline std::string injectDefines(const std::string& source, const std::string& defines)
+{
+    if (defines.empty())
+        return source;
+    size_t version = source.find("#version");
+    if (version == std::string::npos)
+        return defines + source;
+    size_t lineEnd = source.find('\n', version);
+    if (lineEnd == std::string::npos)
+        return source + "\n" + defines;
+    return source.substr(0, lineEnd + 1) + defines + source.substr(lineEnd + 1);
+}
+
+// replaces each `#include "name"` line with includes[name]; unknown names are left as is
+// and reported, so the GLSL compiler rejects them with the line in its log
+// ------------------------------------------------------------------------
+inline std::string expandIncludes(const std::string& source, const std::unordered_map<std::string, std::string>& includes)
+{
+    if (source.find("#include") == std::string::npos)
+        return source;
+    std::string expanded;
+    size_t lineStart = 0;
+    while (lineStart < source.size())
+    {
+        size_t lineEnd = source.find('\n', lineStart);
+        if (lineEnd == std::string::npos)
+            lineEnd = source.size();
+        std::string line = source.substr(lineStart, lineEnd - lineStart);
+        size_t directive = line.find_first_not_of(" \t");
+        size_t open = line.find('"');
+        size_t close = open == std::string::npos ? open : line.find('"', open + 1);
+        if (directive != std::string::npos && line.compare(directive, 8, "#include") == 0 && close != std::string::npos)
+        {
+            std::string name = line.substr(open + 1, close - open - 1);
+            auto include = includes.find(name);
+            if (include != includes.end())
+            {
+                expanded += include->second;
+                expanded += '\n';
+                lineStart = lineEnd + 1;
+                continue;
+            }
+            std::cout << "ERROR::PROGRAM_CACHE::UNKNOWN_INCLUDE: " << name << std::endl;
+        }
+        expanded += line;
+        expanded += '\n';
+        lineStart = lineEnd + 1;
+    }
+    return expanded;
+}
+
+// a build in flight between ProgramCache::begin and ProgramCache::finish
+struct PendingProgram {
+    std::string label;
+    uint64_t key = 0;
+    GLuint program = 0;
+    std::vector<GLuint> shaders;
+    std::chrono::steady_clock::time_point start;
+    double submitMs = 0.0;   // time begin() spent compiling on the calling thread
+    bool fromBinary = false;
+    bool failed = false;   // set by finish()
+};
+
+class ProgramCache
+{
+public:
+    // reads the cache file at path; a missing or foreign one starts empty
+    // ------------------------------------------------------------------------
+    explicit ProgramCache(const char* path) : path(path)
+    {
+        GLint formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        enabled = (GLEW_ARB_get_program_binary || GLEW_VERSION_4_1) && formats > 0;
+        driver = glString(GL_VENDOR) + "|" + glString(GL_RENDERER) + "|" + glString(GL_VERSION);
+        if (enabled)
+            load();
+        // let the driver compile on its own threads; begin() then returns before the link is done
+        parallelCompile = GLEW_KHR_parallel_shader_compile || GLEW_ARB_parallel_shader_compile;
+        if (GLEW_KHR_parallel_shader_compile)
+            glMaxShaderCompilerThreadsKHR(0xFFFFFFFFu);
+        else if (GLEW_ARB_parallel_shader_compile)
+            glMaxShaderCompilerThreadsARB(0xFFFFFFFFu);
+    }
+
+    // makes `#include "name"` in any later stage source stand for text
+    void addInclude(const std::string& name, const std::string& text) { includes[name] = text; }
+
+    // compiles and links `stages` with `defines`, or loads their cached binary
+    // ------------------------------------------------------------------------
+    GLuint build(const char* label, const std::vector<ProgramStage>& stages, const std::string& defines = std::string())
+    {
+        PendingProgram pending = begin(label, stages, defines);
+        return finish(pending);
+    }
+
+    // Starts a build without waiting for it. A cached binary is loaded right away; otherwise
+    // the stages are compiled and linked with no status queries in between, so with
+    // KHR_parallel_shader_compile the driver works on them in its own threads until
+    // ready() says the link is done. finish() then checks the result and stores the binary.
+    // ------------------------------------------------------------------------
+    PendingProgram begin(const char* label, const std::vector<ProgramStage>& stages, const std::string& defines = std::string())
+    {
+        PendingProgram pending;
+        pending.label = label;
+        std::vector<std::string> sources;
+        pending.key = 1469598103934665603ull;
+        pending.key = hash(pending.key, defines.data(), defines.size());
+        for (const ProgramStage& stage : stages)
+        {
+            sources.push_back(injectDefines(expandIncludes(stage.source, includes), defines));
+            pending.key = hash(pending.key, &stage.type, sizeof(stage.type));
+            pending.key = hash(pending.key, sources.back().data(), sources.back().size());
+        }
+
+        pending.start = Clock::now();
+        if (enabled)
+        {
+            auto cached = entries.find(pending.key);
+            if (cached != entries.end())
+            {
+                const Entry& entry = cached->second;
+                pending.program = glCreateProgram();
+                glProgramBinary(pending.program, entry.format, entry.binary.data(), static_cast<GLsizei>(entry.binary.size()));
+                GLint success = GL_FALSE;
+                glGetProgramiv(pending.program, GL_LINK_STATUS, &success);
+                if (success)
+                {
+                    pending.fromBinary = true;
+                    pending.submitMs = elapsedMs(pending.start);
+                    return pending;
+                }
+                std::cout << "Program cache: stored binary of " << label << " rejected, recompiling" << std::endl;
+                glDeleteProgram(pending.program);
+                entries.erase(cached);
+                dirty = true;
+                pending.start = Clock::now();
+            }
+        }
+
+        pending.program = glCreateProgram();
+        for (size_t i = 0; i < stages.size(); ++i)
+        {
+            const char* text = sources[i].c_str();
+            GLuint shader = glCreateShader(stages[i].type);
+            glShaderSource(shader, 1, &text, NULL);
+            glCompileShader(shader);
+            glAttachShader(pending.program, shader);
+            pending.shaders.push_back(shader);
+        }
+        if (enabled)
+            glProgramParameteri(pending.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        glLinkProgram(pending.program);
+        pending.submitMs = elapsedMs(pending.start);
+        return pending;
+    }
+
+    // true once finish() would not block; always true without parallel compile
+    bool ready(const PendingProgram& pending) const
+    {
+        if (pending.fromBinary || !parallelCompile)
+            return true;
+        GLint done = GL_FALSE;
+        glGetProgramiv(pending.program, GL_COMPLETION_STATUS_KHR, &done);
+        return done != GL_FALSE;
+    }
+
+    // waits for the link if needed, reports errors and keeps the binary of a good program
+    // ------------------------------------------------------------------------
+    GLuint finish(PendingProgram& pending)
+    {
+        const GLuint program = pending.program;
+        if (pending.fromBinary)
+        {
+            ++hits;
+            loadMs += pending.submitMs;
+            savedCompileMs += entries[pending.key].compileMs;
+            pending.program = 0;
+            return program;
+        }
+
+        const auto finishStart = Clock::now();
+        bool compiled = true;
+        for (GLuint shader : pending.shaders)
+        {
+            GLint success;
+            glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+            if (!success)
+            {
+                char message[1024];
+                glGetShaderInfoLog(shader, sizeof(message), NULL, message);
+                std::cout << "ERROR::PROGRAM_CACHE::COMPILATION_FAILED: " << pending.label << "\n" << message << std::endl;
+                compiled = false;
+            }
+        }
+        GLint linked;
+        glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        if (!linked)
+        {
+            char message[1024];
+            glGetProgramInfoLog(program, sizeof(message), NULL, message);
+            std::cout << "ERROR::PROGRAM_CACHE::LINKING_FAILED: " << pending.label << "\n" << message << std::endl;
+        }
+        for (GLuint shader : pending.shaders)
+        {
+            glDetachShader(program, shader);
+            glDeleteShader(shader);
+        }
+        pending.shaders.clear();
+        pending.program = 0;
+        pending.failed = !(compiled && linked);
+        // time the calling thread spent on the program, not the frames it compiled in the background
+        const double compileMs = pending.submitMs + elapsedMs(finishStart);
+        ++misses;
+        missCompileMs += compileMs;
+
+        if (enabled && !pending.failed)
+        {
+            GLint length = 0;
+            glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+            if (length > 0)
+            {
+                Entry entry;
+                entry.compileMs = static_cast<float>(compileMs);
+                entry.binary.resize(static_cast<size_t>(length));
+                GLsizei written = 0;
+                glGetProgramBinary(program, length, &written, &entry.format, entry.binary.data());
+                entry.binary.resize(static_cast<size_t>(written));
+                if (written > 0)
+                {
+                    entries[pending.key] = std::move(entry);
+                    dirty = true;
+                }
+            }
+        }
+        return program;
+    }
+
+    // writes the cache file if build() added or dropped anything
+    // ------------------------------------------------------------------------
+    bool save()
+    {
+        if (!enabled || !dirty)
+            return true;
+        FILE* file = std::fopen(path.c_str(), "wb");
+        if (!file)
+        {
+            std::cout << "Could not write program cache: " << path << std::endl;
+            return false;
+        }
+        FileHeader header = {};
+        std::memcpy(header.magic, "GLPB", 4);
+        header.version = PROGRAM_CACHE_VERSION;
+        header.driverLength = static_cast<uint32_t>(driver.size());
+        header.entryCount = static_cast<uint32_t>(entries.size());
+        bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1 &&
+                  std::fwrite(driver.data(), 1, driver.size(), file) == driver.size();
+        for (const auto& keyed : entries)
+        {
+            EntryHeader entryHeader = {};
+            entryHeader.key = keyed.first;
+            entryHeader.format = keyed.second.format;
+            entryHeader.compileMs = keyed.second.compileMs;
+            entryHeader.length = static_cast<uint32_t>(keyed.second.binary.size());
+            ok = ok && std::fwrite(&entryHeader, sizeof(entryHeader), 1, file) == 1 &&
+                 std::fwrite(keyed.second.binary.data(), 1, keyed.second.binary.size(), file) == keyed.second.binary.size();
+        }
+        ok = std::fclose(file) == 0 && ok;
+        dirty = !ok;
+        return ok;
+    }
+
+    // startup summary: binaries loaded against the compile time they replaced
+    // ------------------------------------------------------------------------
+    void printReport() const
+    {
+        if (!enabled)
+        {
+            std::cout << "Program cache: no program binary formats, " << misses << " programs compiled in " << missCompileMs << " ms" << std::endl;
+            return;
+        }
+        std::cout << "Program cache: " << hits << " programs from binaries in " << loadMs << " ms (compiling took " << savedCompileMs
+                  << " ms, " << (savedCompileMs - loadMs) << " ms saved), " << misses << " compiled in " << missCompileMs << " ms" << std::endl;
+    }
+
+    bool isEnabled() const { return enabled; }
+    bool isParallel() const { return parallelCompile; }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct FileHeader {
+        char magic[4];           // "GLPB"
+        uint32_t version;
+        uint32_t driverLength;   // followed by the vendor|renderer|version string
+        uint32_t entryCount;
+    };
+    struct EntryHeader {
+        uint64_t key;
+        uint32_t format;
+        float compileMs;         // what the program cost to compile and link when it was stored
+        uint32_t length;         // followed by the binary
+        uint32_t reserved;
+    };
+    struct Entry {
+        GLenum format = 0;
+        float compileMs = 0.0f;
+        std::vector<unsigned char> binary;
+    };
+
+    std::string path;
+    std::string driver;
+    bool enabled = false;
+    bool parallelCompile = false;
+    bool dirty = false;
+    std::unordered_map<uint64_t, Entry> entries;
+    std::unordered_map<std::string, std::string> includes;
+    int hits = 0, misses = 0;
+    double loadMs = 0.0, savedCompileMs = 0.0, missCompileMs = 0.0;
+
+    static std::string glString(GLenum name)
+    {
+        const GLubyte* value = glGetString(name);
+        return value ? reinterpret_cast<const char*>(value) : "";
+    }
+
+    static uint64_t hash(uint64_t hash, const void* data, size_t size)
+    {
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < size; ++i)
+        {
+            hash ^= bytes[i];
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    static double elapsedMs(Clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+
+    void load()
+    {
+        FILE* file = std::fopen(path.c_str(), "rb");
+        if (!file)
+            return;
+        // entry lengths are checked against what is left of the file before anything is allocated
+        long fileSize = std::fseek(file, 0, SEEK_END) == 0 ? std::ftell(file) : -1;
+        std::rewind(file);
+        uint64_t remaining = fileSize > 0 ? static_cast<uint64_t>(fileSize) : 0;
+        auto consume = [&remaining](uint64_t bytes) {
+            if (bytes > remaining)
+                return false;
+            remaining -= bytes;
+            return true;
+        };
+        FileHeader header;
+        bool ok = consume(sizeof(header)) && std::fread(&header, sizeof(header), 1, file) == 1 &&
+                  std::memcmp(header.magic, "GLPB", 4) == 0 &&
+                  header.version == PROGRAM_CACHE_VERSION && header.driverLength == driver.size() &&
+                  consume(header.driverLength);
+        std::string storedDriver(ok ? header.driverLength : 0, '\0');
+        ok = ok && std::fread(&storedDriver[0], 1, storedDriver.size(), file) == storedDriver.size() && storedDriver == driver;
+        for (uint32_t i = 0; ok && i < header.entryCount; ++i)
+        {
+            EntryHeader entryHeader;
+            Entry entry;
+            ok = consume(sizeof(entryHeader)) && std::fread(&entryHeader, sizeof(entryHeader), 1, file) == 1 &&
+                 consume(entryHeader.length);
+            if (ok)
+            {
+                entry.format = entryHeader.format;
+                entry.compileMs = entryHeader.compileMs;
+                entry.binary.resize(entryHeader.length);
+                ok = std::fread(entry.binary.data(), 1, entry.binary.size(), file) == entry.binary.size();
+            }
+            if (ok)
+                entries[entryHeader.key] = std::move(entry);
+        }
+        std::fclose(file);
+        if (!ok)
+        {
+            // other driver, older layout, truncated or corrupt: start over and rewrite it on save()
+            std::cout << "Program cache: " << path << " is from another driver or out of date, recompiling" << std::endl;
+            entries.clear();
+            dirty = true;
+        }
+    }
+};
+#endif
@@ -13,6 +13,9 @@
 #include <gtc/matrix_transform.hpp>
 #include <gtc/type_ptr.hpp>
 
+#include "ProgramCache.h"
+#include "ShaderLibrary.h"
+
 void renderCube();
 
 const char* srcVS = R"STOP(
@@ -162,57 +165,10 @@ int main(void)
     glfwSetKeyCallback(window, key_callback);
 
 
-    unsigned int shaderObjVS = glCreateShader(GL_VERTEX_SHADER);
-    int vertexLength = (int)strlen(srcVS);
-    glShaderSource(shaderObjVS, 1, &srcVS, &vertexLength);
-    glCompileShader(shaderObjVS);
-
-    // Check for errors.
-    int vertexSuccess;
-    glGetShaderiv(shaderObjVS, GL_COMPILE_STATUS, &vertexSuccess);
-    if (vertexSuccess == GL_FALSE) {
-        char message[1024];
-        glGetShaderInfoLog(shaderObjVS, sizeof(message), NULL, message);
-        std::cout << "Failed to compile: Vertex Shader" << std::endl;
-        std::cout << message << std::endl;
-        glDeleteShader(shaderObjVS);
-    }
-
-    // Check for errors.
-    unsigned int shaderObjFS = glCreateShader(GL_FRAGMENT_SHADER);
-    int fragmentLength = (int)strlen(srcFS);
-    glShaderSource(shaderObjFS, 1, &srcFS, &fragmentLength);
-    glCompileShader(shaderObjFS);
-
-    // Check for errors.
-    int fragmentSuccess;
-    glGetShaderiv(shaderObjFS, GL_COMPILE_STATUS, &fragmentSuccess);
-    if (fragmentSuccess == GL_FALSE) {
-        char message[1024];
-        glGetShaderInfoLog(shaderObjFS, sizeof(message), NULL, message);
-        std::cout << "Failed to compile: Fragment Shader" << std::endl;
-        std::cout << message << std::endl;
-        glDeleteShader(shaderObjFS);
-    }
-
-    unsigned int ShaderProgram = glCreateProgram();
-    glAttachShader(ShaderProgram, shaderObjVS);
-    glAttachShader(ShaderProgram, shaderObjFS);
-    glLinkProgram(ShaderProgram);
-
-    // Check for errors.
-    int shaderSuccess;
-    glGetProgramiv(ShaderProgram, GL_LINK_STATUS, &shaderSuccess);
-    if (shaderSuccess == GL_FALSE) {
-        char message[1024];
-        glGetProgramInfoLog(ShaderProgram,
-            sizeof(message), NULL, message);
-        std::cout << "Failed to link shaders:"
-            << std::endl;
-        std::cout << message << std::endl;
-    }
-
-    glValidateProgram(ShaderProgram);
+    // submitted now, checked once the color chart below is computed (ShaderLibrary.h)
+    ProgramCache programCache("assignment8.programs");
+    ShaderLibrary shaderLibrary(programCache);
+    shaderLibrary.add("chart", { { GL_VERTEX_SHADER, srcVS }, { GL_FRAGMENT_SHADER, srcFS } });
 
   
 
@@ -438,6 +394,16 @@ int main(void)
 
     }
 
+    unsigned int ShaderProgram = shaderLibrary.get("chart");
+    shaderLibrary.printReport();
+    programCache.save();
+    programCache.printReport();
+
+    int projectionLocation = glGetUniformLocation(ShaderProgram, "projection");
+    int viewLocation = glGetUniformLocation(ShaderProgram, "view");
+    int modelLocation = glGetUniformLocation(ShaderProgram, "model");
+    int rgbLocation = glGetUniformLocation(ShaderProgram, "rgb");
+
     while (!glfwWindowShouldClose(window))
     {
         glClearColor(0.4f, 0.6f, 0.7f, 1.0f);
@@ -467,7 +433,6 @@ int main(void)
         glUseProgram(ShaderProgram);
 
         glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)(xWindow / yWindow), 0.1f, 100.0f);
-        int projectionLocation = glGetUniformLocation(ShaderProgram, "projection");
         glUniformMatrix4fv(projectionLocation, 1, GL_FALSE, &projection[0][0]);
 
         glm::mat4 view = glm::mat4(1.0f);
@@ -476,16 +441,13 @@ int main(void)
         float viewY = cameraRadius * std::cos(elevation);
         float viewZ = cameraRadius * std::sin(elevation) * std::sin(phi);
         view = glm::lookAt(glm::vec3(viewX, viewY, viewZ), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-        int viewLocation = glGetUniformLocation(ShaderProgram, "view");
         glUniformMatrix4fv(viewLocation, 1, GL_FALSE, &view[0][0]);
 
         glm::mat4 model = glm::mat4(1.0f);
         model = glm::scale(model, glm::vec3(0.2f, 0.2f, 0.2f));
         model = glm::translate(model, glm::vec3(-7.5f, 5.0f, 0.0f));
-        int modelLocation = glGetUniformLocation(ShaderProgram, "model");
 
         int RGBNum = 0;
-        int rgbLocation = glGetUniformLocation(ShaderProgram, "rgb");
 
         for (int i = 0; i < 4; i++)
         {
@@ -503,6 +465,7 @@ int main(void)
         glfwSwapBuffers(window);
     }
 
+    shaderLibrary.release();
     glfwTerminate();
 
     return 0;
@@ -278,6 +278,9 @@ int main()
 
 
 
+    int projectionLocation = glGetUniformLocation(ShaderProgram, "projection");
+    int viewLocation = glGetUniformLocation(ShaderProgram, "view");
+
     while (!glfwWindowShouldClose(window))
     {
 
@@ -292,7 +295,6 @@ int main()
 
         // Create projection 
         glm::mat4 projection = glm::perspective(glm::radians(30.0f), (float)(xWindow / yWindow), 0.1f, 50.0f);
-        int projectionLocation = glGetUniformLocation(ShaderProgram, "projection");
         glUniformMatrix4fv(projectionLocation, 1, GL_FALSE, &projection[0][0]);
 
         glm::mat4 view = glm::mat4(1.0f);
@@ -302,7 +304,6 @@ int main()
         float z = radOfCamera * std::sin(elevation) * std::sin(alpha);
 
         view = glm::lookAt(glm::vec3(x, y, z), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-        int viewLocation = glGetUniformLocation(ShaderProgram, "view");
         glUniformMatrix4fv(viewLocation, 1, GL_FALSE, &view[0][0]);
 
         // Draw calls: